@@ -0,0 +1,59 @@
+#include <cmath>
+#include "audio.h"
+
+/**
+ * Creates a synthesizer for an output device with the specified sample rate in Hz.
+ */
+AudioSynthesizer::AudioSynthesizer(unsigned int sample_rate) : sample_rate(sample_rate) {}
+
+/**
+ * Fills a buffer with the next samples of the pattern.
+ * @param pattern - the 16 bytes of the audio pattern, the most significant bit of the first byte playing first
+ * @param pitch - the pitch register
+ * @param playing - whether the sound timer is running
+ * @param samples - the buffer to fill
+ * @param count - the number of samples to fill
+ */
+void AudioSynthesizer::synthesize(const unsigned char* pattern, unsigned char pitch, bool playing,
+        std::int16_t* samples, size_t count)
+{
+    // set_before[n] is the number of set bits among the first n bits of the pattern
+    unsigned int set_before[PATTERN_BITS + 1] = {};
+    for (unsigned int bit = 0; bit < PATTERN_BITS; ++bit)
+    {
+        set_before[bit + 1] = set_before[bit] + (pattern[bit / 8] >> (7 - bit % 8) & 1);
+    }
+    auto integrate = [&set_before, pattern](double position)
+    {
+        auto bit = static_cast<unsigned int>(position);
+        return set_before[bit] + (bit < PATTERN_BITS ? (pattern[bit / 8] >> (7 - bit % 8) & 1) * (position - bit) : 0);
+    };
+
+    double step = BASE_RATE * std::exp2((pitch - 64) / 48.0) / sample_rate;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (playing && volume < RAMP_SAMPLES)
+        {
+            ++volume;
+        }
+        else if (!playing && volume > 0)
+        {
+            --volume;
+        }
+        if (!volume)
+        {
+            samples[i] = 0;
+            continue;
+        }
+
+        // Average the pattern over [phase, phase + step), which may wrap around its end several times
+        double end = phase + step;
+        double set = -integrate(phase);
+        double laps = std::floor(end / PATTERN_BITS);
+        set += laps * set_before[PATTERN_BITS] + integrate(end - laps * PATTERN_BITS);
+        phase = end - laps * PATTERN_BITS;
+
+        double level = 2.0 * set / step - 1.0;
+        samples[i] = static_cast<std::int16_t>(level * AMPLITUDE * volume / RAMP_SAMPLES);
+    }
+}
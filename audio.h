@@ -0,0 +1,34 @@
+#ifndef CHIP8_EMU_AUDIO_H
+#define CHIP8_EMU_AUDIO_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Turns the XO-CHIP audio pattern into samples at the sample rate of the output device. The 128 pattern bits are
+ * played in a loop at 4000 * 2^((pitch - 64) / 48) bits per second; every output sample is the average of the
+ * pattern over the time it covers, which filters out the aliasing of pattern rates that are not a divisor of the
+ * sample rate. The position in the pattern carries over from one call to the next, so the buffers the device
+ * requests join without clicks, and the volume ramps up and down over a few samples when the sound starts and
+ * stops.
+ */
+class AudioSynthesizer
+{
+    static constexpr unsigned int PATTERN_BITS = 128;
+    static constexpr double BASE_RATE = 4000.0;
+    static constexpr unsigned int RAMP_SAMPLES = 64;
+
+    unsigned int sample_rate;
+    double phase = 0.0;
+    unsigned int volume = 0;
+
+public:
+    static constexpr std::int16_t AMPLITUDE = 8000;
+
+    explicit AudioSynthesizer(unsigned int sample_rate);
+
+    void synthesize(const unsigned char* pattern, unsigned char pitch, bool playing, std::int16_t* samples,
+            size_t count);
+};
+
+#endif //CHIP8_EMU_AUDIO_H
@@ -0,0 +1,234 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "machine_arena.h"
+
+/*
+ * Measures the cost of interleaving many interpreters, one instruction each in turn, so that no instance stays
+ * in cache between two of its instructions. The same interpreter loop runs over two replicas of the core
+ * layout: the legacy one, where the registers sit behind the font and the memory and the timers and keyboard
+ * live in separate allocations, and the hot/cold one, where everything an instruction touches shares one cache
+ * line ahead of the memory. The real Core is measured last for reference.
+ *
+ * Usage: chip8_bench_layout [instances] [rounds]
+ */
+
+namespace
+{
+    /**
+     * An endless loop of ALU, timer, keyboard and index instructions:
+     *  0x200: V0 += 1; V1 += V0; V2 += V1; V3 = DT; skip if key V4 not pressed; (skipped)
+     *  0x20C: I = 0x300; I += V0; jump to 0x200
+     */
+    const unsigned char PROGRAM[] =
+    {
+        0x70, 0x01, 0x81, 0x04, 0x82, 0x14, 0xF3, 0x07, 0xE4, 0xA1, 0x00, 0x00,
+        0xA3, 0x00, 0xF0, 0x1E, 0x12, 0x00
+    };
+
+    /**
+     * The member order of Core before the hot/cold split.
+     */
+    struct LegacyLayout
+    {
+        unsigned char font_data[80];
+        unsigned char ram[4096];
+        unsigned char V[16];
+        unsigned char SP;
+        unsigned short I;
+        unsigned short PC;
+        unsigned char display[64 * 32];
+        Timer* delay_timer;
+        Timer* sound_timer;
+        Keyboard* keyboard;
+        unsigned short in_address;
+        unsigned char in_constant_n;
+        unsigned char in_reg_x;
+        unsigned char in_reg_y;
+
+        Timer& delayTimer() { return *delay_timer; }
+        Keyboard& keys() { return *keyboard; }
+    };
+
+    /**
+     * The member order of Core after the hot/cold split, with flat memory instead of pages.
+     */
+    struct HotColdLayout
+    {
+        alignas(64) unsigned char V[16];
+        unsigned short I;
+        unsigned short PC;
+        unsigned char SP;
+        unsigned char in_reg_x;
+        unsigned char in_reg_y;
+        unsigned char in_constant_n;
+        unsigned short in_address;
+        Timer delay_timer;
+        Timer sound_timer;
+        Keyboard keyboard;
+        unsigned char ram[4096];
+        unsigned char display[64 * 32];
+
+        Timer& delayTimer() { return delay_timer; }
+        Keyboard& keys() { return keyboard; }
+    };
+
+    /**
+     * Executes one instruction of PROGRAM, decoding it the way Core::emulateCycle does.
+     */
+    template<class Layout>
+    void step(Layout& core)
+    {
+        unsigned short opcode = core.ram[core.PC & 0xFFF] << 8 | core.ram[(core.PC + 1) & 0xFFF];
+        core.in_address = opcode & 0x0FFF;
+        core.in_constant_n = opcode & 0x00FF;
+        core.in_reg_x = opcode >> 8 & 0x0F;
+        core.in_reg_y = opcode >> 4 & 0x0F;
+        core.PC += 2;
+
+        switch (opcode & 0xF000)
+        {
+            case 0x1000:
+                core.PC = core.in_address;
+                break;
+            case 0x7000:
+                core.V[core.in_reg_x] += core.in_constant_n;
+                break;
+            case 0x8000:
+                core.V[core.in_reg_x] += core.V[core.in_reg_y];
+                break;
+            case 0xA000:
+                core.I = core.in_address;
+                break;
+            case 0xE000:
+                if (!core.keys().getKey(core.V[core.in_reg_x] & 0x0F))
+                {
+                    core.PC += 2;
+                }
+                break;
+            case 0xF000:
+                if (core.in_constant_n == 0x07)
+                {
+                    core.V[core.in_reg_x] = core.delayTimer().getValue();
+                }
+                else
+                {
+                    core.I += core.V[core.in_reg_x];
+                }
+                break;
+        }
+    }
+
+    template<class Layout>
+    double measure(std::vector<Layout*>& cores, unsigned int rounds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int round = 0; round < rounds; ++round)
+        {
+            for (Layout* core : cores)
+            {
+                step(*core);
+            }
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / (static_cast<double>(rounds) * cores.size());
+    }
+
+    template<class Layout>
+    void load(Layout& core)
+    {
+        std::memset(core.ram, 0, sizeof(core.ram));
+        std::memcpy(core.ram + 0x200, PROGRAM, sizeof(PROGRAM));
+        std::memset(core.V, 0, sizeof(core.V));
+        core.PC = 0x200;
+        core.I = 0;
+        core.SP = 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    size_t instance_count = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 16384;
+    unsigned int rounds = argc > 2 ? static_cast<unsigned int>(std::strtoul(argv[2], nullptr, 0)) : 200;
+
+    // Legacy cores are interleaved with their separately allocated timers and keyboards, as in main.cpp.
+    std::vector<std::unique_ptr<LegacyLayout>> legacy_storage;
+    std::vector<std::unique_ptr<Timer>> timer_storage;
+    std::vector<std::unique_ptr<Keyboard>> keyboard_storage;
+    std::vector<LegacyLayout*> legacy;
+    for (size_t i = 0; i < instance_count; ++i)
+    {
+        timer_storage.push_back(std::make_unique<Timer>());
+        timer_storage.push_back(std::make_unique<Timer>());
+        keyboard_storage.push_back(std::make_unique<Keyboard>());
+        legacy_storage.push_back(std::make_unique<LegacyLayout>());
+        LegacyLayout& core = *legacy_storage.back();
+        load(core);
+        core.delay_timer = timer_storage[2 * i].get();
+        core.sound_timer = timer_storage[2 * i + 1].get();
+        core.keyboard = keyboard_storage.back().get();
+        core.delay_timer->setValue(0);
+        legacy.push_back(&core);
+    }
+
+    std::vector<std::unique_ptr<HotColdLayout>> hot_cold_storage;
+    std::vector<HotColdLayout*> hot_cold;
+    for (size_t i = 0; i < instance_count; ++i)
+    {
+        hot_cold_storage.push_back(std::make_unique<HotColdLayout>());
+        load(*hot_cold_storage.back());
+        hot_cold_storage.back()->delay_timer.setValue(0);
+        hot_cold.push_back(hot_cold_storage.back().get());
+    }
+
+    MachineArena arena;
+    arena.reserve(instance_count);
+    Machine root{};
+    root.core.initialize();
+    auto state = std::make_unique<Core::State>();
+    root.core.saveState(*state);
+    std::memcpy(state->ram + 0x200, PROGRAM, sizeof(PROGRAM));
+    root.core.loadState(*state);
+    std::vector<Machine*> machines;
+    for (size_t i = 0; i < instance_count; ++i)
+    {
+        machines.push_back(arena.acquire());
+        root.fork(*machines.back());
+    }
+
+    // Warm up every instance once, so that all memory is mapped and every shared page has been copied.
+    measure(legacy, 1);
+    measure(hot_cold, 1);
+    for (Machine* machine : machines)
+    {
+        machine->core.emulateCycle();
+    }
+
+    double legacy_ns = measure(legacy, rounds);
+    double hot_cold_ns = measure(hot_cold, rounds);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < rounds; ++round)
+    {
+        for (Machine* machine : machines)
+        {
+            machine->core.emulateCycle();
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    double core_ns = elapsed.count() / (static_cast<double>(rounds) * instance_count);
+
+    std::printf("%zu instances, %u instructions each\n", instance_count, rounds);
+    std::printf("legacy layout:   %6.2f ns/instruction\n", legacy_ns);
+    std::printf("hot/cold layout: %6.2f ns/instruction\n", hot_cold_ns);
+    std::printf("Core:            %6.2f ns/instruction\n", core_ns);
+
+    for (Machine* machine : machines)
+    {
+        arena.release(machine);
+    }
+    return 0;
+}
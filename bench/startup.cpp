@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include "machine.h"
+
+/*
+ * Measures the headless part of startup, from an unconstructed core to its first emulated frame, phase by phase:
+ * constructing the core, Core::initialize, Core::readProgram, Core::loadProgram and the first frame. The first
+ * run in the process is reported on its own, since it builds the boot image that later initializations share;
+ * the median of the other runs is reported as the warm startup. The SDL phases are measured by
+ * chip8_emu --timeline, as they need a display.
+ *
+ * Usage: chip8_bench_startup [-r runs] [-c cycles_per_frame] program
+ */
+
+namespace
+{
+    const char* const PHASES[] = {"construct", "initialize", "readProgram", "loadProgram", "first_frame"};
+    constexpr size_t PHASE_COUNT = sizeof(PHASES) / sizeof(PHASES[0]);
+
+    struct Run
+    {
+        double phases[PHASE_COUNT];
+        double total;
+    };
+
+    Run startup(const std::string& program_name, unsigned int cycles_per_frame)
+    {
+        Run run{};
+        auto time = std::chrono::steady_clock::now();
+        auto mark = [&](size_t phase)
+        {
+            auto now = std::chrono::steady_clock::now();
+            run.phases[phase] = std::chrono::duration<double, std::micro>(now - time).count();
+            run.total += run.phases[phase];
+            time = now;
+        };
+
+        auto machine = std::make_unique<Machine>();
+        mark(0);
+        machine->core.initialize();
+        mark(1);
+        std::vector<unsigned char> program = Core::readProgram(program_name);
+        mark(2);
+        machine->core.loadProgram(program.data(), program.size());
+        mark(3);
+        machine->runFrame(0, cycles_per_frame);
+        mark(4);
+        return run;
+    }
+
+    void printRun(const char* name, const Run& run)
+    {
+        std::printf("    \"%s\": {", name);
+        for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+        {
+            std::printf("\"%s_us\": %.3f, ", PHASES[phase], run.phases[phase]);
+        }
+        std::printf("\"total_us\": %.3f}", run.total);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int runs = 1000;
+    unsigned int cycles_per_frame = 8;
+    std::string program_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-r") && has_value)
+        {
+            runs = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10)));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10)));
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_bench_startup [-r runs] [-c cycles_per_frame] program\n");
+        return 2;
+    }
+
+    Run first;
+    std::vector<Run> warm;
+    try
+    {
+        first = startup(program_name, cycles_per_frame);
+        for (unsigned int run = 0; run < runs; ++run)
+        {
+            warm.push_back(startup(program_name, cycles_per_frame));
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+
+    // Take the median of every phase on its own
+    Run median{};
+    for (size_t phase = 0; phase < PHASE_COUNT; ++phase)
+    {
+        std::vector<double> times;
+        for (const Run& run : warm)
+        {
+            times.push_back(run.phases[phase]);
+        }
+        std::nth_element(times.begin(), times.begin() + static_cast<std::ptrdiff_t>(times.size() / 2), times.end());
+        median.phases[phase] = times[times.size() / 2];
+        median.total += median.phases[phase];
+    }
+
+    std::printf("{\"program\": \"%s\", \"runs\": %u,\n", program_name.c_str(), runs);
+    printRun("first", first);
+    std::printf(",\n");
+    printRun("warm_median", median);
+    std::printf("\n}\n");
+    return 0;
+}
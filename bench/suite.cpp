@@ -0,0 +1,610 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "machine.h"
+#include "perf_counters.h"
+#include "recording.h"
+
+/*
+ * The benchmark suite of the core, reporting every benchmark as a JSON object with its instructions per second,
+ * nanoseconds per instruction and frames per second:
+ * - micro: a loop of a single instruction for every opcode family, DXYN at every sprite height and alignment,
+ *   and the Keyboard and Timer operations the interpreter calls
+ * - synthetic: small programs that stress instruction dispatch, sprite drawing and memory operations
+ * - macro: recordings replayed with their inputs from their first keyframe, and plain programs run without input
+ * Every benchmark is warmed up once and then measured several times; the median is reported.
+ *
+ * With -p, the hardware performance counters of the median run are reported as well, per emulated instruction and
+ * per frame, and summed up per execution engine (the interpreter of every quirk profile) at the end.
+ *
+ * Usage: chip8_bench [-r repetitions] [-n instructions] [-c cycles_per_frame] [-f filter] [-p]
+ *                    [recording or program...]
+ */
+
+namespace
+{
+    struct Options
+    {
+        unsigned int repetitions = 5;
+        unsigned long instructions = 1 << 22;
+        unsigned int cycles_per_frame = 8;
+        std::string filter;
+        PerfCounters* counters = nullptr;
+    };
+
+    struct Result
+    {
+        std::string name;
+        const char* kind;
+        unsigned long instructions;
+        double seconds;
+        unsigned int cycles_per_frame; // 0 if the benchmark does not emulate frames
+        const char* engine; // nullptr if the benchmark does not run the interpreter
+        PerfCounters::Sample counters;
+    };
+
+    /**
+     * A program under construction: setup instructions, then a body that loops forever, then data placed at fixed
+     * addresses. Data that would overwrite code, or code emitted after data, aborts, since the benchmark would
+     * otherwise measure a corrupted program.
+     */
+    class Program
+    {
+        std::vector<unsigned char> bytes;
+        size_t code_size = 0;
+
+    public:
+        unsigned short here() const
+        {
+            return static_cast<unsigned short>(0x200 + code_size);
+        }
+
+        void emit(unsigned short opcode)
+        {
+            if (bytes.size() != code_size)
+            {
+                std::fprintf(stderr, "ERROR: Code emitted at 0x%03X follows data.\n", here());
+                std::abort();
+            }
+            bytes.push_back(static_cast<unsigned char>(opcode >> 8));
+            bytes.push_back(static_cast<unsigned char>(opcode));
+            code_size = bytes.size();
+        }
+
+        void place(unsigned short address, const std::vector<unsigned char>& data)
+        {
+            if (address < here())
+            {
+                std::fprintf(stderr, "ERROR: Data placed at 0x%03X overlaps code that runs up to 0x%03X.\n", address,
+                        here());
+                std::abort();
+            }
+            size_t offset = address - 0x200u;
+            bytes.resize(std::max(bytes.size(), offset + data.size()));
+            std::copy(data.begin(), data.end(), bytes.begin() + static_cast<std::ptrdiff_t>(offset));
+        }
+
+        const std::vector<unsigned char>& data() const
+        {
+            return bytes;
+        }
+    };
+
+    /**
+     * A benchmark of the interpreter running a program with fixed keys.
+     */
+    struct ProgramBenchmark
+    {
+        std::string name;
+        const char* kind;
+        Program program;
+        QuirkProfile quirks;
+        unsigned short keys;
+    };
+
+    const unsigned int BODY_REPEATS = 64;
+    const unsigned short DATA_ADDRESS = 0xE00;
+
+    /**
+     * Builds a program that runs the setup instructions once and then loops over BODY_REPEATS copies of the body.
+     * The body may depend on the address it is placed at, for jumps to the next instruction.
+     */
+    Program loop(const std::vector<unsigned short>& setup,
+            const std::function<std::vector<unsigned short>(unsigned short)>& body)
+    {
+        Program program;
+        for (unsigned short opcode : setup)
+        {
+            program.emit(opcode);
+        }
+        unsigned short start = program.here();
+        for (unsigned int repeat = 0; repeat < BODY_REPEATS; ++repeat)
+        {
+            for (unsigned short opcode : body(program.here()))
+            {
+                program.emit(opcode);
+            }
+        }
+        program.emit(static_cast<unsigned short>(0x1000 | start));
+        program.place(DATA_ADDRESS, std::vector<unsigned char>(16, 0xFF));
+        return program;
+    }
+
+    Program loop(const std::vector<unsigned short>& setup, const std::vector<unsigned short>& body)
+    {
+        return loop(setup, [&body](unsigned short) { return body; });
+    }
+
+    /**
+     * Adds a benchmark per opcode family. Skips are set up not to skip and key tests run with the keys that
+     * keep them in line, so that every body executes completely. FX55 and FX65 run under SUPER-CHIP, where I
+     * stays put.
+     */
+    void addOpcodeBenchmarks(std::vector<ProgramBenchmark>& benchmarks)
+    {
+        const std::vector<unsigned short> setup = {0x6001, 0x6102, 0x6203, 0xA000 | DATA_ADDRESS};
+        auto add = [&benchmarks](const char* family, Program program, QuirkProfile quirks, unsigned short keys)
+        {
+            benchmarks.push_back({std::string("micro/opcode/") + family, "micro", std::move(program), quirks, keys});
+        };
+        auto simple = [&](const char* family, std::vector<unsigned short> body)
+        {
+            add(family, loop(setup, body), QuirkProfile::DEFAULT, 0);
+        };
+
+        simple("00E0", {0x00E0});
+        {
+            Program program = loop(setup, {0x2000 | (DATA_ADDRESS + 0x10)});
+            program.place(DATA_ADDRESS + 0x10, {0x00, 0xEE});
+            add("2NNN+00EE", program, QuirkProfile::DEFAULT, 0);
+        }
+        add("1NNN", loop(setup, [](unsigned short address)
+        {
+            return std::vector<unsigned short>{static_cast<unsigned short>(0x1000 | (address + 2))};
+        }), QuirkProfile::DEFAULT, 0);
+        simple("3XNN", {0x3000});
+        simple("4XNN", {0x4001});
+        simple("5XY0", {0x5010});
+        simple("6XNN", {0x6342});
+        simple("7XNN", {0x7301});
+        simple("8XY0", {0x8310});
+        simple("8XY1", {0x8311});
+        simple("8XY2", {0x8312});
+        simple("8XY3", {0x8313});
+        simple("8XY4", {0x8314});
+        simple("8XY5", {0x8315});
+        simple("8XY6", {0x8316});
+        simple("8XY7", {0x8317});
+        simple("8XYE", {0x831E});
+        simple("9XY0", {0x9000});
+        simple("ANNN", {0xA000 | DATA_ADDRESS});
+        add("BNNN", loop({0x6000}, [](unsigned short address)
+        {
+            return std::vector<unsigned short>{static_cast<unsigned short>(0xB000 | (address + 2))};
+        }), QuirkProfile::DEFAULT, 0);
+        simple("CXNN", {0xC3FF});
+        simple("DXYN", {0xD125});
+        add("EX9E", loop(setup, {0xE19E}), QuirkProfile::DEFAULT, 0);
+        add("EXA1", loop(setup, {0xE1A1}), QuirkProfile::DEFAULT, 1 << 2);
+        simple("FX07", {0xF307});
+        add("FX0A", loop(setup, {0xF30A}), QuirkProfile::DEFAULT, 1 << 5);
+        simple("FX15", {0xF315});
+        simple("FX18", {0xF318});
+        simple("FX1E", {0xF31E});
+        simple("FX29", {0xF329});
+        simple("FX33", {0xF333});
+        add("FX55", loop(setup, {0xF355}), QuirkProfile::SUPER_CHIP, 0);
+        add("FX65", loop(setup, {0xF365}), QuirkProfile::SUPER_CHIP, 0);
+    }
+
+    /**
+     * Adds a benchmark of DXYN for every sprite height and every alignment of the sprite to a display byte.
+     */
+    void addSpriteBenchmarks(std::vector<ProgramBenchmark>& benchmarks)
+    {
+        for (unsigned short height = 1; height <= 15; ++height)
+        {
+            for (unsigned short alignment = 0; alignment < 8; ++alignment)
+            {
+                benchmarks.push_back({"micro/DXYN/height" + std::to_string(height) + "/x" + std::to_string(alignment),
+                        "micro", loop({static_cast<unsigned short>(0x6100 | (8 + alignment)), 0x6204,
+                        0xA000 | DATA_ADDRESS}, {static_cast<unsigned short>(0xD120 | height)}),
+                        QuirkProfile::DEFAULT, 0});
+            }
+        }
+    }
+
+    /**
+     * Adds the synthetic programs:
+     * - dispatch: a different opcode family on every instruction, so that the dispatch is never predicted by
+     *   repetition alone
+     * - sprites: digits drawn at positions that move across the display, wrapping at its edges
+     * - memory: BCD conversion, register saves and loads and index arithmetic
+     */
+    void addSyntheticBenchmarks(std::vector<ProgramBenchmark>& benchmarks)
+    {
+        benchmarks.push_back({"synthetic/dispatch", "synthetic", loop({0x6001, 0x6102, 0x6203},
+                {0x7301, 0x8314, 0x3400, 0x8432, 0xA000 | DATA_ADDRESS, 0x8516, 0x4601, 0xF51E, 0x8651, 0x9340,
+                 0x8347, 0xF315, 0xF407, 0x843E, 0x5010, 0x8723}), QuirkProfile::DEFAULT, 0});
+        benchmarks.push_back({"synthetic/sprites", "synthetic", loop({0x6000, 0x6100, 0x6200},
+                {0x7105, 0x7203, 0x7001, 0xF029, 0xD125, 0x7307, 0xF329, 0xD315}), QuirkProfile::DEFAULT, 0});
+        benchmarks.push_back({"synthetic/memory", "synthetic", loop({0x6001, 0x6102, 0x6203},
+                {0xA000 | DATA_ADDRESS, 0xF333, 0xF755, 0xA000 | (DATA_ADDRESS + 0x20), 0xF765, 0x7001, 0xF01E,
+                 0xF233}), QuirkProfile::DEFAULT, 0});
+    }
+
+    double elapsedSeconds(std::chrono::steady_clock::time_point start)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    /**
+     * Measures a benchmark repetitions times after one warm-up run and returns the median time.
+     * @param run - runs the benchmark once
+     * @param counters - receives the performance counters of the median run, if they are measured
+     */
+    double median(const Options& options, const std::function<void()>& run, PerfCounters::Sample& counters)
+    {
+        run();
+        std::vector<std::pair<double, PerfCounters::Sample>> runs;
+        for (unsigned int repetition = 0; repetition < options.repetitions; ++repetition)
+        {
+            PerfCounters::Sample sample{};
+            if (options.counters)
+            {
+                options.counters->start();
+            }
+            auto start = std::chrono::steady_clock::now();
+            run();
+            double seconds = elapsedSeconds(start);
+            if (options.counters)
+            {
+                sample = options.counters->stop();
+            }
+            runs.emplace_back(seconds, sample);
+        }
+        std::sort(runs.begin(), runs.end(), [](const auto& a, const auto& b)
+        {
+            return a.first < b.first;
+        });
+        counters = runs[runs.size() / 2].second;
+        return runs[runs.size() / 2].first;
+    }
+
+    Result runProgram(const ProgramBenchmark& benchmark, const Options& options)
+    {
+        Machine base{};
+        base.core.initialize();
+        base.core.setQuirks(benchmark.quirks);
+        base.core.loadProgram(benchmark.program.data().data(), benchmark.program.data().size());
+        unsigned long frames = options.instructions / options.cycles_per_frame;
+
+        Machine machine{};
+        PerfCounters::Sample counters{};
+        double seconds = median(options, [&]()
+        {
+            base.fork(machine);
+            for (unsigned long frame = 0; frame < frames; ++frame)
+            {
+                machine.runFrame(benchmark.keys, options.cycles_per_frame);
+            }
+        }, counters);
+        return {benchmark.name, benchmark.kind, frames * options.cycles_per_frame, seconds,
+                options.cycles_per_frame, getQuirkProfileName(benchmark.quirks), counters};
+    }
+
+    /**
+     * Benchmarks Keyboard::getPressedKey over every key mask with at most one key held, and none.
+     */
+    Result runKeyboard(const Options& options)
+    {
+        Keyboard keyboard{};
+        volatile char sink = 0;
+        PerfCounters::Sample counters{};
+        double seconds = median(options, [&]()
+        {
+            char sum = 0;
+            for (unsigned long call = 0; call < options.instructions; ++call)
+            {
+                unsigned int key = call % 17;
+                keyboard.setKeys(static_cast<unsigned short>(key < 16 ? 1u << key : 0u));
+                sum = static_cast<char>(sum + keyboard.getPressedKey());
+            }
+            sink = sum;
+        }, counters);
+        static_cast<void>(sink);
+        return {"micro/Keyboard::getPressedKey", "micro", options.instructions, seconds, 0, nullptr, counters};
+    }
+
+    /**
+     * Benchmarks a Timer being set, read and decremented, as FX15, FX07 and the 60 Hz tick do.
+     */
+    Result runTimer(const Options& options)
+    {
+        Timer timer{};
+        volatile unsigned char sink = 0;
+        unsigned long rounds = options.instructions / 3;
+        PerfCounters::Sample counters{};
+        double seconds = median(options, [&]()
+        {
+            unsigned char sum = 0;
+            for (unsigned long round = 0; round < rounds; ++round)
+            {
+                timer.setValue(static_cast<unsigned char>(round));
+                timer.decrement();
+                sum = static_cast<unsigned char>(sum + timer.getValue());
+            }
+            sink = sum;
+        }, counters);
+        static_cast<void>(sink);
+        return {"micro/Timer", "micro", rounds * 3, seconds, 0, nullptr, counters};
+    }
+
+    /**
+     * Replays a recording from its first keyframe with its inputs, or runs a program without input for as many
+     * frames as the instruction budget allows.
+     */
+    Result runMacro(const std::string& file_name, const Options& options)
+    {
+        Machine base{};
+        base.core.initialize();
+        std::vector<unsigned short> inputs;
+        unsigned int cycles_per_frame = options.cycles_per_frame;
+
+        bool is_recording = file_name.size() > 4 && file_name.compare(file_name.size() - 4, 4, ".c8r") == 0;
+        if (is_recording)
+        {
+            Recording recording;
+            recording.load(file_name);
+            base.core.setQuirks(recording.quirks);
+            base.core.loadState(recording.keyframes.front().state);
+            inputs = recording.inputs;
+            cycles_per_frame = recording.cycles_per_frame;
+        }
+        else
+        {
+            base.core.loadProgram(file_name);
+            inputs.assign(options.instructions / cycles_per_frame, 0);
+        }
+
+        Machine machine{};
+        PerfCounters::Sample counters{};
+        double seconds = median(options, [&]()
+        {
+            base.fork(machine);
+            for (unsigned short keys : inputs)
+            {
+                machine.runFrame(keys, cycles_per_frame);
+            }
+        }, counters);
+        return {"macro/" + file_name, "macro", inputs.size() * static_cast<unsigned long>(cycles_per_frame), seconds,
+                cycles_per_frame, getQuirkProfileName(base.core.getQuirks()), counters};
+    }
+
+    /**
+     * Prints the counts of a sample divided by a number of instructions or frames, as a JSON object with null for
+     * the counters that are not available.
+     */
+    void printCounters(const PerfCounters::Sample& counters, double divisor)
+    {
+        std::printf("{");
+        for (int event = 0; event < PerfCounters::EVENT_COUNT; ++event)
+        {
+            std::printf(event ? ", \"%s\": " : "\"%s\": ", PerfCounters::NAMES[event]);
+            if (counters.counts[event] < 0)
+            {
+                std::printf("null");
+            }
+            else
+            {
+                std::printf("%.4f", counters.counts[event] / divisor);
+            }
+        }
+        std::printf("}");
+    }
+
+    /**
+     * The counters of every benchmark that ran the interpreter of an execution engine, summed up.
+     */
+    struct Engine
+    {
+        const char* name;
+        unsigned long instructions;
+        double frames;
+        PerfCounters::Sample counters;
+
+        void add(const Result& result)
+        {
+            for (int event = 0; event < PerfCounters::EVENT_COUNT; ++event)
+            {
+                bool available = result.counters.counts[event] >= 0
+                        && (instructions == 0 || counters.counts[event] >= 0);
+                counters.counts[event] = available ? counters.counts[event] + result.counters.counts[event] : -1;
+            }
+            instructions += result.instructions;
+            frames += static_cast<double>(result.instructions) / result.cycles_per_frame;
+        }
+    };
+
+    void printResult(const Result& result, bool first, bool with_counters)
+    {
+        double instructions_per_second = result.instructions / result.seconds;
+        std::printf("%s    {\"name\": \"%s\", \"kind\": \"%s\", \"engine\": ", first ? "" : ",\n",
+                result.name.c_str(), result.kind);
+        if (result.engine)
+        {
+            std::printf("\"%s\"", result.engine);
+        }
+        else
+        {
+            std::printf("null");
+        }
+        std::printf(", \"instructions\": %lu, \"seconds\": %.6f, \"instructions_per_second\": %.0f, "
+                "\"ns_per_instruction\": %.3f, \"frames_per_second\": ", result.instructions, result.seconds,
+                instructions_per_second, result.seconds * 1e9 / result.instructions);
+        if (result.cycles_per_frame)
+        {
+            std::printf("%.1f", instructions_per_second / result.cycles_per_frame);
+        }
+        else
+        {
+            std::printf("null");
+        }
+        if (with_counters)
+        {
+            std::printf(", \"per_instruction\": ");
+            printCounters(result.counters, static_cast<double>(result.instructions));
+            std::printf(", \"per_frame\": ");
+            if (result.cycles_per_frame)
+            {
+                printCounters(result.counters, static_cast<double>(result.instructions) / result.cycles_per_frame);
+            }
+            else
+            {
+                std::printf("null");
+            }
+        }
+        std::printf("}");
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    std::vector<std::string> file_names;
+    bool with_counters = false;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-r") && has_value)
+        {
+            options.repetitions = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10)));
+        }
+        else if (!std::strcmp(argv[arg], "-n") && has_value)
+        {
+            options.instructions = std::strtoul(argv[++arg], nullptr, 0);
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            options.cycles_per_frame = std::max(1u, static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10)));
+        }
+        else if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            options.filter = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "-p"))
+        {
+            with_counters = true;
+        }
+        else if (argv[arg][0] == '-')
+        {
+            std::fprintf(stderr, "Usage: chip8_bench [-r repetitions] [-n instructions] [-c cycles_per_frame] "
+                    "[-f filter] [-p] [recording or program...]\n");
+            return 2;
+        }
+        else
+        {
+            file_names.emplace_back(argv[arg]);
+        }
+    }
+
+    std::unique_ptr<PerfCounters> counters;
+    if (with_counters)
+    {
+        counters = std::make_unique<PerfCounters>();
+        if (!counters->isAvailable())
+        {
+            std::fprintf(stderr, "No hardware performance counters are available; they are reported as null.\n");
+        }
+        options.counters = counters.get();
+    }
+
+    std::vector<ProgramBenchmark> benchmarks;
+    addOpcodeBenchmarks(benchmarks);
+    addSpriteBenchmarks(benchmarks);
+    addSyntheticBenchmarks(benchmarks);
+    auto selected = [&options](const std::string& name)
+    {
+        return name.find(options.filter) != std::string::npos;
+    };
+
+    std::printf("{\"cycles_per_frame\": %u, \"repetitions\": %u, \"benchmarks\": [\n", options.cycles_per_frame,
+            options.repetitions);
+    bool first = true;
+    std::vector<Engine> engines;
+    auto report = [&](const Result& result)
+    {
+        printResult(result, first, with_counters);
+        first = false;
+        if (result.engine)
+        {
+            auto engine = std::find_if(engines.begin(), engines.end(), [&](const Engine& engine)
+            {
+                return !std::strcmp(engine.name, result.engine);
+            });
+            if (engine == engines.end())
+            {
+                engine = engines.insert(engines.end(), Engine{result.engine, 0, 0, {}});
+            }
+            engine->add(result);
+        }
+    };
+    for (const ProgramBenchmark& benchmark : benchmarks)
+    {
+        if (selected(benchmark.name))
+        {
+            report(runProgram(benchmark, options));
+        }
+    }
+    if (selected("micro/Keyboard::getPressedKey"))
+    {
+        report(runKeyboard(options));
+    }
+    if (selected("micro/Timer"))
+    {
+        report(runTimer(options));
+    }
+    int failed_files = 0;
+    for (const std::string& file_name : file_names)
+    {
+        if (!selected("macro/" + file_name))
+        {
+            continue;
+        }
+        try
+        {
+            report(runMacro(file_name, options));
+        }
+        catch (int)
+        {
+            ++failed_files;
+        }
+    }
+    std::printf("\n]");
+    if (with_counters)
+    {
+        std::printf(",\n\"engines\": [\n");
+        for (size_t index = 0; index < engines.size(); ++index)
+        {
+            const Engine& engine = engines[index];
+            std::printf("%s    {\"engine\": \"%s\", \"instructions\": %lu, \"per_instruction\": ",
+                    index ? ",\n" : "", engine.name, engine.instructions);
+            printCounters(engine.counters, static_cast<double>(engine.instructions));
+            std::printf(", \"per_frame\": ");
+            printCounters(engine.counters, engine.frames);
+            std::printf("}");
+        }
+        std::printf("\n]");
+    }
+    std::printf("}\n");
+    return failed_files ? 1 : 0;
+}
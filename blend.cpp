@@ -0,0 +1,155 @@
+#include "blend.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * Every mode works on the four 8-bit channels of a pixel independently, so the SSE2 kernel blends four pixels at
+ * once as sixteen channels, widened to 16 bits where a mode multiplies. The scalar code uses the same integer
+ * arithmetic, so that both produce the same pixels and therefore the same state hashes.
+ */
+
+namespace
+{
+    template<BlendMode MODE>
+    unsigned int blendChannel(unsigned int destination, unsigned int source)
+    {
+        switch (MODE)
+        {
+            case BlendMode::QUARTER:
+                return (destination * 3 + source) >> 2;
+            case BlendMode::HALF:
+                return (destination + source) >> 1;
+            case BlendMode::THREE_QUARTERS:
+                return (destination + source * 3) >> 2;
+            case BlendMode::ADD:
+                return destination + source > 0xFF ? 0xFF : destination + source;
+            case BlendMode::MULTIPLY:
+                {
+                    // destination * source / 255, rounded
+                    unsigned int product = destination * source + 128;
+                    return (product + (product >> 8)) >> 8;
+                }
+            default:
+                return source;
+        }
+    }
+
+    template<BlendMode MODE>
+    std::uint32_t blendPixel(std::uint32_t destination, std::uint32_t source)
+    {
+        std::uint32_t pixel = 0;
+        for (unsigned int shift = 0; shift < 32; shift += 8)
+        {
+            pixel |= blendChannel<MODE>(destination >> shift & 0xFF, source >> shift & 0xFF) << shift;
+        }
+        return pixel;
+    }
+
+#if defined(__SSE2__)
+    /**
+     * Blends eight channels widened to 16 bits.
+     */
+    template<BlendMode MODE>
+    __m128i blendWide(__m128i destination, __m128i source)
+    {
+        switch (MODE)
+        {
+            case BlendMode::QUARTER:
+                return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(destination, 1), destination),
+                        source), 2);
+            case BlendMode::HALF:
+                return _mm_srli_epi16(_mm_add_epi16(destination, source), 1);
+            case BlendMode::THREE_QUARTERS:
+                return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(_mm_slli_epi16(source, 1), source),
+                        destination), 2);
+            default:
+                {
+                    __m128i product = _mm_add_epi16(_mm_mullo_epi16(destination, source), _mm_set1_epi16(128));
+                    return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+                }
+        }
+    }
+
+    /**
+     * Blends four pixels.
+     */
+    template<BlendMode MODE>
+    __m128i blendPixels(__m128i destination, __m128i source)
+    {
+        switch (MODE)
+        {
+            case BlendMode::NORMAL:
+                return source;
+            case BlendMode::ADD:
+                return _mm_adds_epu8(destination, source);
+            default:
+                {
+                    __m128i zero = _mm_setzero_si128();
+                    __m128i low = blendWide<MODE>(_mm_unpacklo_epi8(destination, zero),
+                            _mm_unpacklo_epi8(source, zero));
+                    __m128i high = blendWide<MODE>(_mm_unpackhi_epi8(destination, zero),
+                            _mm_unpackhi_epi8(source, zero));
+                    return _mm_packus_epi16(low, high);
+                }
+        }
+    }
+#endif
+
+    template<BlendMode MODE>
+    void blendSpan(std::uint32_t* destination, const std::uint32_t* source, const std::uint32_t* mask, size_t count)
+    {
+        size_t i = 0;
+#if defined(__SSE2__)
+        for (; i + 4 <= count; i += 4)
+        {
+            auto* target = reinterpret_cast<__m128i*>(destination + i);
+            __m128i pixels = _mm_loadu_si128(target);
+            __m128i blended = blendPixels<MODE>(pixels, _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + i)));
+            __m128i opaque = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask + i));
+            _mm_storeu_si128(target, _mm_or_si128(_mm_and_si128(opaque, blended), _mm_andnot_si128(opaque, pixels)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            if (mask[i])
+            {
+                destination[i] = blendPixel<MODE>(destination[i], source[i]);
+            }
+        }
+    }
+}
+
+/**
+ * Blends a row of sprite pixels onto a row of the display.
+ * @param destination - the display pixels, as 0xAARRGGBB
+ * @param source - the sprite pixels, as 0xAARRGGBB
+ * @param mask - 0xFFFFFFFF for every sprite pixel that is drawn, 0 for every transparent one
+ * @param count - the number of pixels
+ * @param mode - how sprite and display are combined
+ */
+void blendRow(std::uint32_t* destination, const std::uint32_t* source, const std::uint32_t* mask, size_t count,
+        BlendMode mode)
+{
+    switch (mode)
+    {
+        case BlendMode::QUARTER:
+            blendSpan<BlendMode::QUARTER>(destination, source, mask, count);
+            break;
+        case BlendMode::HALF:
+            blendSpan<BlendMode::HALF>(destination, source, mask, count);
+            break;
+        case BlendMode::THREE_QUARTERS:
+            blendSpan<BlendMode::THREE_QUARTERS>(destination, source, mask, count);
+            break;
+        case BlendMode::ADD:
+            blendSpan<BlendMode::ADD>(destination, source, mask, count);
+            break;
+        case BlendMode::MULTIPLY:
+            blendSpan<BlendMode::MULTIPLY>(destination, source, mask, count);
+            break;
+        default:
+            blendSpan<BlendMode::NORMAL>(destination, source, mask, count);
+            break;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef CHIP8_EMU_BLEND_H
+#define CHIP8_EMU_BLEND_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * The ways a MEGA-CHIP sprite is combined with the pixels beneath it, set by 080N.
+ */
+enum class BlendMode : unsigned char
+{
+    NORMAL,         // The sprite replaces the display
+    QUARTER,        // 25% sprite, 75% display
+    HALF,           // 50% sprite, 50% display
+    THREE_QUARTERS, // 75% sprite, 25% display
+    ADD,            // Sprite and display are added, saturating at white
+    MULTIPLY,       // Sprite and display are multiplied
+    COUNT
+};
+
+void blendRow(std::uint32_t* destination, const std::uint32_t* source, const std::uint32_t* mask, size_t count,
+        BlendMode mode);
+
+#endif //CHIP8_EMU_BLEND_H
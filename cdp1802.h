@@ -0,0 +1,343 @@
+#ifndef CHIP8_EMU_CDP1802_H
+#define CHIP8_EMU_CDP1802_H
+
+#include <cstdint>
+
+/**
+ * An interpreter of the RCA CDP1802, the processor of the COSMAC VIP, for the machine code routines that CHIP-8
+ * programs call with 0NNN. It runs on a bus supplied by the caller, a class with the members
+ *  - unsigned char read(unsigned short address)
+ *  - void write(unsigned short address, unsigned char value)
+ *  - void output(unsigned char port, unsigned char value)  (OUT 1-7)
+ *  - unsigned char input(unsigned char port)               (INP 1-7)
+ *  - bool flag(unsigned char line)                         (EF1-EF4)
+ * so that every access compiles to a direct call. Interrupts and DMA are not emulated; a routine runs until it
+ * returns to the CHIP-8 interpreter, all within one CHIP-8 instruction.
+ */
+class Cdp1802
+{
+public:
+    /**
+     * The ways a call into machine code ends.
+     */
+    enum class Exit : unsigned char
+    {
+        RETURNED,   // The routine selected the return register as program counter (SEP)
+        IDLE,       // The routine executed IDL to wait for an interrupt; run resumes after it
+        TIMED_OUT   // The routine used up its instruction budget without returning
+    };
+
+    std::uint16_t R[16] = {};
+    unsigned char D = 0;
+    unsigned char P = 0;
+    unsigned char X = 0;
+    unsigned char T = 0;
+    bool DF = false;
+    bool Q = false;
+    bool IE = true;
+
+    template<class Bus> Exit run(Bus& bus, unsigned char return_register, unsigned long& budget);
+
+private:
+    template<class Bus> unsigned char fetch(Bus& bus)
+    {
+        return bus.read(R[P]++);
+    }
+
+    template<class Bus> void shortBranch(Bus& bus, bool condition)
+    {
+        unsigned char target = bus.read(R[P]);
+        R[P] = condition ? static_cast<std::uint16_t>((R[P] & 0xFF00) | target) : static_cast<std::uint16_t>(R[P] + 1);
+    }
+
+    template<class Bus> void longBranch(Bus& bus, bool condition)
+    {
+        if (condition)
+        {
+            R[P] = static_cast<std::uint16_t>(bus.read(R[P]) << 8 | bus.read(static_cast<std::uint16_t>(R[P] + 1)));
+        }
+        else
+        {
+            R[P] += 2;
+        }
+    }
+
+    void add(unsigned int a, unsigned int b, unsigned int carry)
+    {
+        unsigned int sum = a + b + carry;
+        D = static_cast<unsigned char>(sum);
+        DF = sum > 0xFF;
+    }
+};
+
+/**
+ * Runs machine code from R[P] until it selects the return register as program counter.
+ * @param bus - the memory and I/O the processor is connected to
+ * @param return_register - the register that holds the return address of the caller
+ * @param budget - the number of instructions left before a routine is considered stuck, reduced by every
+ *                 instruction executed, so that it spans the runs a routine is resumed for after IDL
+ * @return why the routine stopped
+ */
+template<class Bus>
+Cdp1802::Exit Cdp1802::run(Bus& bus, unsigned char return_register, unsigned long& budget)
+{
+    while (budget > 0)
+    {
+        --budget;
+        unsigned char opcode = fetch(bus);
+        unsigned char n = opcode & 0x0F;
+        switch (opcode >> 4)
+        {
+            case 0x0: // IDL, LDN
+                if (n == 0)
+                {
+                    return Exit::IDLE;
+                }
+                D = bus.read(R[n]);
+                break;
+            case 0x1: // INC
+                ++R[n];
+                break;
+            case 0x2: // DEC
+                --R[n];
+                break;
+            case 0x3: // Short branches; the upper eight test the inverse condition
+                {
+                    bool condition;
+                    switch (n & 7)
+                    {
+                        case 0x0:
+                            condition = true;
+                            break;
+                        case 0x1:
+                            condition = Q;
+                            break;
+                        case 0x2:
+                            condition = D == 0;
+                            break;
+                        case 0x3:
+                            condition = DF;
+                            break;
+                        default:
+                            condition = bus.flag(static_cast<unsigned char>((n & 7) - 3));
+                            break;
+                    }
+                    if (n == 0x8) // SKP
+                    {
+                        ++R[P];
+                        break;
+                    }
+                    shortBranch(bus, (n & 8) ? !condition : condition);
+                }
+                break;
+            case 0x4: // LDA
+                D = bus.read(R[n]++);
+                break;
+            case 0x5: // STR
+                bus.write(R[n], D);
+                break;
+            case 0x6: // IRX, OUT, INP
+                if (n == 0)
+                {
+                    ++R[X];
+                }
+                else if (n < 8)
+                {
+                    bus.output(n, bus.read(R[X]++));
+                }
+                else if (n > 8)
+                {
+                    D = bus.input(static_cast<unsigned char>(n - 8));
+                    bus.write(R[X], D);
+                }
+                break;
+            case 0x7:
+                switch (n)
+                {
+                    case 0x0: // RET
+                    case 0x1: // DIS
+                        {
+                            unsigned char value = bus.read(R[X]++);
+                            X = value >> 4;
+                            P = value & 0x0F;
+                            IE = n == 0x0;
+                        }
+                        break;
+                    case 0x2: // LDXA
+                        D = bus.read(R[X]++);
+                        break;
+                    case 0x3: // STXD
+                        bus.write(R[X]--, D);
+                        break;
+                    case 0x4: // ADC
+                        add(bus.read(R[X]), D, DF);
+                        break;
+                    case 0x5: // SDB
+                        add(bus.read(R[X]), D ^ 0xFF, DF);
+                        break;
+                    case 0x6: // SHRC
+                        {
+                            bool carry = D & 1;
+                            D = static_cast<unsigned char>(D >> 1 | DF << 7);
+                            DF = carry;
+                        }
+                        break;
+                    case 0x7: // SMB
+                        add(D, bus.read(R[X]) ^ 0xFF, DF);
+                        break;
+                    case 0x8: // SAV
+                        bus.write(R[X], T);
+                        break;
+                    case 0x9: // MARK
+                        T = static_cast<unsigned char>(X << 4 | P);
+                        bus.write(R[2]--, T);
+                        X = P;
+                        break;
+                    case 0xA: // REQ
+                        Q = false;
+                        break;
+                    case 0xB: // SEQ
+                        Q = true;
+                        break;
+                    case 0xC: // ADCI
+                        add(fetch(bus), D, DF);
+                        break;
+                    case 0xD: // SDBI
+                        add(fetch(bus), D ^ 0xFF, DF);
+                        break;
+                    case 0xE: // SHLC
+                        {
+                            bool carry = D >> 7;
+                            D = static_cast<unsigned char>(D << 1 | DF);
+                            DF = carry;
+                        }
+                        break;
+                    default: // SMBI
+                        add(D, fetch(bus) ^ 0xFF, DF);
+                        break;
+                }
+                break;
+            case 0x8: // GLO
+                D = static_cast<unsigned char>(R[n]);
+                break;
+            case 0x9: // GHI
+                D = static_cast<unsigned char>(R[n] >> 8);
+                break;
+            case 0xA: // PLO
+                R[n] = static_cast<std::uint16_t>((R[n] & 0xFF00) | D);
+                break;
+            case 0xB: // PHI
+                R[n] = static_cast<std::uint16_t>((R[n] & 0x00FF) | D << 8);
+                break;
+            case 0xC: // Long branches and skips
+                {
+                    bool condition;
+                    switch (n & 3)
+                    {
+                        case 0x0:
+                            condition = n == 0xC ? IE : true;
+                            break;
+                        case 0x1:
+                            condition = Q;
+                            break;
+                        case 0x2:
+                            condition = D == 0;
+                            break;
+                        default:
+                            condition = DF;
+                            break;
+                    }
+                    if (n == 0x4) // NOP
+                    {
+                        break;
+                    }
+                    if (n == 0x8) // LSKP
+                    {
+                        R[P] += 2;
+                        break;
+                    }
+                    if (n >= 0xC) // LSIE, LSQ, LSZ, LSDF
+                    {
+                        R[P] += condition ? 2 : 0;
+                    }
+                    else if (n >= 0x5 && n <= 0x7) // LSNQ, LSNZ, LSNF
+                    {
+                        R[P] += condition ? 0 : 2;
+                    }
+                    else // LBR, LBQ, LBZ, LBDF, and LBNQ, LBNZ, LBNF testing the inverse condition
+                    {
+                        longBranch(bus, n >= 0x8 ? !condition : condition);
+                    }
+                }
+                break;
+            case 0xD: // SEP
+                P = n;
+                if (P == return_register)
+                {
+                    return Exit::RETURNED;
+                }
+                break;
+            case 0xE: // SEX
+                X = n;
+                break;
+            default:
+                switch (n)
+                {
+                    case 0x0: // LDX
+                        D = bus.read(R[X]);
+                        break;
+                    case 0x1: // OR
+                        D |= bus.read(R[X]);
+                        break;
+                    case 0x2: // AND
+                        D &= bus.read(R[X]);
+                        break;
+                    case 0x3: // XOR
+                        D ^= bus.read(R[X]);
+                        break;
+                    case 0x4: // ADD
+                        add(bus.read(R[X]), D, 0);
+                        break;
+                    case 0x5: // SD
+                        add(bus.read(R[X]), D ^ 0xFF, 1);
+                        break;
+                    case 0x6: // SHR
+                        DF = D & 1;
+                        D >>= 1;
+                        break;
+                    case 0x7: // SM
+                        add(D, bus.read(R[X]) ^ 0xFF, 1);
+                        break;
+                    case 0x8: // LDI
+                        D = fetch(bus);
+                        break;
+                    case 0x9: // ORI
+                        D |= fetch(bus);
+                        break;
+                    case 0xA: // ANI
+                        D &= fetch(bus);
+                        break;
+                    case 0xB: // XRI
+                        D ^= fetch(bus);
+                        break;
+                    case 0xC: // ADI
+                        add(fetch(bus), D, 0);
+                        break;
+                    case 0xD: // SDI
+                        add(fetch(bus), D ^ 0xFF, 1);
+                        break;
+                    case 0xE: // SHL
+                        DF = D >> 7;
+                        D = static_cast<unsigned char>(D << 1);
+                        break;
+                    default: // SMI
+                        add(D, fetch(bus) ^ 0xFF, 1);
+                        break;
+                }
+                break;
+        }
+    }
+    return Exit::TIMED_OUT;
+}
+
+#endif //CHIP8_EMU_CDP1802_H
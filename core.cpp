@@ -1,93 +1,1028 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include "cdp1802.h"
 #include "core.h"
+#include "coverage.h"
+#include "heatmap.h"
+#include "trace.h"
+#if defined(CHIP8_OPCODE_PROFILER)
+#include "opcode_profiler.h"
+#endif
 
-Core::Core(Keyboard& keyboard, Timer& delay_timer, Timer& sound_timer) : keyboard(keyboard),
-        delay_timer(delay_timer), sound_timer(sound_timer) {}
+/**
+ * Copies the display into the specified array, one byte per pixel in RGB332: black when unset, white when set on
+ * the first plane only, and grey tones for pixels set on the second plane.
+ * @param pixels - an array of at least RESOLUTION bytes
+ */
+void Core::getPixels(unsigned char* pixels) const
+{
+    static constexpr unsigned char COLORS[4] = {0x00, 0xFF, 0x92, 0x49};
+    const std::uint64_t* first = display.readPage(0);
+    const std::uint64_t* second = display.readPage(1);
+    for (unsigned short word = 0; word < DISPLAY_WORDS; ++word)
+    {
+        for (int bit = 63; bit >= 0; --bit)
+        {
+            *pixels++ = COLORS[(first[word] >> bit & 1) | (second[word] >> bit & 1) << 1];
+        }
+    }
+}
+
+/**
+ * Determines whether the colour display of MEGA-CHIP is shown instead of the bitplanes.
+ */
+bool Core::isMegaMode() const
+{
+    return mega_mode;
+}
+
+/**
+ * Copies the colour display into the specified array as opaque 0xFFRRGGBB pixels, faded by the screen alpha.
+ * @param pixels - an array of at least MEGA_RESOLUTION pixels
+ */
+void Core::getColorPixels(std::uint32_t* pixels) const
+{
+    for (unsigned int page = 0; page < MEGA_RESOLUTION / MEGA_PAGE_SIZE; ++page)
+    {
+        const std::uint32_t* colors = mega_colors.readPage(page);
+        for (unsigned int i = 0; i < MEGA_PAGE_SIZE; ++i)
+        {
+            std::uint32_t color = 0xFF000000;
+            for (unsigned int shift = 0; shift < 24; shift += 8)
+            {
+                color |= (colors[i] >> shift & 0xFF) * screen_alpha / 0xFF << shift;
+            }
+            *pixels++ = color;
+        }
+    }
+}
+
+/**
+ * Reads a byte of memory.
+ * @param address - the address to read
+ */
+unsigned char Core::getMemory(unsigned short address) const
+{
+    return ram[address];
+}
+
+/**
+ * Reads one of the general purpose registers.
+ * @param x - the index of the register, V0 to VF
+ */
+unsigned char Core::getRegister(unsigned char x) const
+{
+    return V[x & 0xF];
+}
+
+/**
+ * Returns the address of the next instruction.
+ */
+unsigned short Core::getPC() const
+{
+    return PC;
+}
+
+/**
+ * Copies the addresses of the subroutine calls (2NNN) that have not returned yet, outermost first.
+ * @param call_addresses - receives up to STACK_DEPTH addresses
+ * @return the number of addresses
+ */
+unsigned char Core::getCallStack(unsigned short* call_addresses) const
+{
+    unsigned char depth = std::min(SP, STACK_DEPTH);
+    std::copy(stack, stack + depth, call_addresses);
+    return depth;
+}
+
+/**
+ * Returns the input of this core.
+ */
+Keyboard& Core::getKeyboard()
+{
+    return keyboard;
+}
+
+/**
+ * Returns the delay timer of this core.
+ */
+Timer& Core::getDelayTimer()
+{
+    return delay_timer;
+}
+
+/**
+ * Returns the sound timer of this core.
+ */
+Timer& Core::getSoundTimer()
+{
+    return sound_timer;
+}
+
+/**
+ * Decrements both timers; called at 60 Hz.
+ */
+void Core::tickTimers()
+{
+    delay_timer.decrement();
+    sound_timer.decrement();
+}
+
+/**
+ * Returns the 16-byte audio pattern that plays while the sound timer runs, most significant bit first.
+ */
+const unsigned char* Core::getAudioPattern() const
+{
+    return pattern;
+}
+
+/**
+ * Returns the pitch register; the pattern plays at 4000 * 2 ^ ((pitch - 64) / 48) bits per second.
+ */
+unsigned char Core::getPitch() const
+{
+    return pitch;
+}
+
+/**
+ * Copies the complete machine state into the specified snapshot.
+ * @param state - the snapshot that will receive the state
+ */
+void Core::saveState(State& state) const
+{
+    ram.copyTo(state.ram);
+    display.copyTo(state.display[0]);
+    state.high_res = high_res;
+    state.plane_mask = plane_mask;
+    std::memcpy(state.flags, flags, sizeof(flags));
+    std::memcpy(state.stack, stack, sizeof(stack));
+    std::memcpy(state.pattern, pattern, sizeof(pattern));
+    state.pitch = pitch;
+    state.mega_mode = mega_mode;
+    state.mega.reset();
+    bool mega_blank = true;
+    for (std::uint32_t color : palette)
+    {
+        mega_blank &= color == 0;
+    }
+    for (size_t page = 0; page < MEGA_RESOLUTION / MEGA_PAGE_SIZE && mega_blank; ++page)
+    {
+        mega_blank = mega_indices.isZero(page) && mega_colors.isZero(page);
+    }
+    if (!mega_blank)
+    {
+        auto mega = std::make_shared<MegaChipState>();
+        mega_indices.copyTo(mega->indices, MEGA_RESOLUTION);
+        mega_colors.copyTo(mega->colors, MEGA_RESOLUTION);
+        std::memcpy(mega->palette, palette, sizeof(palette));
+        state.mega = std::move(mega);
+    }
+    state.sprite_width = sprite_width;
+    state.sprite_height = sprite_height;
+    state.blend_mode = blend_mode;
+    state.collision_color = collision_color;
+    state.screen_alpha = screen_alpha;
+    std::memcpy(state.V, V, sizeof(V));
+    state.I = I;
+    state.PC = PC;
+    state.SP = SP;
+    state.delay_timer = delay_timer.getValue();
+    state.sound_timer = sound_timer.getValue();
+    state.random_seed = random.getSeed();
+    state.random_counter = random.getCounter();
+}
+
+/**
+ * Restores the complete machine state from the specified snapshot.
+ * @param state - the snapshot to restore
+ */
+void Core::loadState(const State& state)
+{
+    ram.assign(state.ram);
+    display.assign(state.display[0]);
+    high_res = state.high_res;
+    plane_mask = state.plane_mask;
+    std::memcpy(flags, state.flags, sizeof(flags));
+    std::memcpy(stack, state.stack, sizeof(stack));
+    std::memcpy(pattern, state.pattern, sizeof(pattern));
+    pitch = state.pitch;
+    mega_mode = state.mega_mode;
+    if (state.mega)
+    {
+        mega_indices.assign(state.mega->indices, MEGA_RESOLUTION);
+        mega_colors.assign(state.mega->colors, MEGA_RESOLUTION);
+        std::memcpy(palette, state.mega->palette, sizeof(palette));
+    }
+    else
+    {
+        mega_indices.clear();
+        mega_colors.clear();
+        std::memset(palette, 0, sizeof(palette));
+    }
+    sprite_width = state.sprite_width;
+    sprite_height = state.sprite_height;
+    blend_mode = state.blend_mode;
+    collision_color = state.collision_color;
+    screen_alpha = state.screen_alpha;
+    std::memcpy(V, state.V, sizeof(V));
+    I = state.I;
+    PC = state.PC;
+    SP = state.SP;
+    delay_timer.setValue(state.delay_timer);
+    sound_timer.setValue(state.sound_timer);
+    random.setState(state.random_seed, state.random_counter);
+    rehash();
+
+    draw_display = true;
+}
+
+/**
+ * Returns a 64-bit hash of the complete machine state.
+ * The hash of memory, registers and display is kept up to date on every write (see rehash()), so this only
+ * folds in the remaining scalar registers. Two cores with equal hashes are, for all practical purposes, in the
+ * same state.
+ * @return the hash of the current state
+ */
+std::uint64_t Core::hashState() const
+{
+    return memory_hash ^ display_hash
+            ^ zobrist(PC_SLOT, PC) ^ zobrist(I_SLOT, I) ^ zobrist(SP_SLOT, SP)
+            ^ zobrist(DELAY_TIMER_SLOT, delay_timer.getValue()) ^ zobrist(SOUND_TIMER_SLOT, sound_timer.getValue())
+            ^ zobrist(RANDOM_SEED_SLOT, random.getSeed()) ^ zobrist(RANDOM_COUNTER_SLOT, random.getCounter())
+            ^ zobrist(HIGH_RES_SLOT, high_res) ^ zobrist(PLANE_MASK_SLOT, plane_mask) ^ zobrist(PITCH_SLOT, pitch)
+            ^ mega_hash ^ zobrist(MEGA_MODE_SLOT, mega_mode) ^ zobrist(SPRITE_WIDTH_SLOT, sprite_width)
+            ^ zobrist(SPRITE_HEIGHT_SLOT, sprite_height)
+            ^ zobrist(BLEND_MODE_SLOT, static_cast<unsigned char>(blend_mode))
+            ^ zobrist(COLLISION_COLOR_SLOT, collision_color) ^ zobrist(SCREEN_ALPHA_SLOT, screen_alpha);
+}
+
+/**
+ * Recomputes the incrementally maintained hashes from scratch, after memory was replaced wholesale.
+ * Every byte of ram, every register, flag register, stack entry and pattern byte and every 64-pixel word of the
+ * display is a slot; the hash is the XOR of zobrist(slot, value) over all slots. Zero values contribute nothing, so
+ * only non-zero slots are visited.
+ */
+void Core::rehash()
+{
+    memory_hash = 0;
+    for (size_t page = 0; page < ram.SIZE / PAGE_SIZE; ++page)
+    {
+        if (!ram.isZero(page))
+        {
+            memory_hash ^= hashRamSpan(page * PAGE_SIZE, ram.readPage(page), PAGE_SIZE);
+        }
+    }
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        memory_hash ^= zobrist(V_SLOT + x, V[x]) ^ zobrist(FLAG_SLOT + x, flags[x])
+                ^ zobrist(STACK_SLOT + x, stack[x]) ^ zobrist(PATTERN_SLOT + x, pattern[x]);
+    }
+    for (unsigned short index = 0; index < 256; ++index)
+    {
+        memory_hash ^= zobrist(PALETTE_SLOT + index, palette[index]);
+    }
+    rehashDisplay();
+    rehashMega();
+}
+
+/**
+ * Returns the part of the memory hash contributed by a span of bytes in ram.
+ * @param address - the address of the first byte
+ * @param data - the bytes
+ * @param size - the number of bytes
+ */
+std::uint64_t Core::hashRamSpan(size_t address, const unsigned char* data, size_t size)
+{
+    std::uint64_t hash = 0;
+    for (size_t offset = 0; offset < size; ++offset)
+    {
+        hash ^= zobrist(RAM_SLOT + address + offset, data[offset]);
+    }
+    return hash;
+}
+
+/**
+ * Recomputes the hash of the display from scratch, after it was scrolled.
+ */
+void Core::rehashDisplay()
+{
+    display_hash = 0;
+    for (unsigned char plane = 0; plane < PLANES; ++plane)
+    {
+        if (display.isZero(plane))
+        {
+            continue;
+        }
+        for (unsigned short word = 0; word < DISPLAY_WORDS; ++word)
+        {
+            display_hash ^= hashDisplayWord(plane, word);
+        }
+    }
+}
+
+/**
+ * Returns the Zobrist key of a slot holding a value, or 0 if the value is 0.
+ */
+std::uint64_t Core::zobrist(std::uint64_t slot, std::uint64_t value)
+{
+    return value ? Random::at(slot * 0xD1B54A32D192ED03, value) : 0;
+}
+
+/**
+ * Returns the Zobrist key of the specified 64-pixel word of a display plane.
+ */
+std::uint64_t Core::hashDisplayWord(unsigned char plane, unsigned short word) const
+{
+    return zobrist(DISPLAY_SLOT + plane * DISPLAY_WORDS + word, display[plane * DISPLAY_WORDS + word]);
+}
+
+/**
+ * XORs a row of sprite pixels onto a display plane, keeping the state hash up to date.
+ * @param plane - the display plane
+ * @param y - the display row
+ * @param x - the column of the leftmost pixel
+ * @param bits - the pixels, in the lowest width bits with the leftmost pixel as the most significant one
+ * @param width - the number of pixels, at most 32
+ * @return whether a set pixel was unset
+ */
+template<bool WRAP>
+bool Core::drawRow(unsigned char plane, unsigned char y, unsigned char x, std::uint32_t bits, unsigned char width)
+{
+    // Lay the pixels out over the 128 bits of the row, as they will be XORed onto it
+    std::uint64_t mask[2] = {};
+    auto place = [&mask](unsigned char x, std::uint64_t bits, unsigned char width)
+    {
+        unsigned char offset = x % 64;
+        if (offset + width <= 64)
+        {
+            mask[x / 64] |= bits << (64 - offset - width);
+        }
+        else
+        {
+            unsigned char overflow = offset + width - 64;
+            mask[x / 64] |= bits >> overflow;
+            mask[x / 64 + 1] |= bits << (64 - overflow);
+        }
+    };
+    if (x + width <= WIDTH)
+    {
+        place(x, bits, width);
+    }
+    else
+    {
+        auto visible = static_cast<unsigned char>(WIDTH - x);
+        place(x, bits >> (width - visible), visible);
+        if (WRAP)
+        {
+            place(0, bits & ((std::uint32_t{1} << (width - visible)) - 1), width - visible);
+        }
+    }
+
+    bool collision = false;
+    for (unsigned char i = 0; i < 2; ++i)
+    {
+        if (!mask[i])
+        {
+            continue;
+        }
+        unsigned short word = plane * DISPLAY_WORDS + y * 2 + i;
+        std::uint64_t pixels = display[word];
+        collision |= (pixels & mask[i]) != 0;
+        display_hash ^= zobrist(DISPLAY_SLOT + word, pixels) ^ zobrist(DISPLAY_SLOT + word, pixels ^ mask[i]);
+        display.write(word, pixels ^ mask[i]);
+    }
+    return collision;
+}
+
+/**
+ * Draws the sprite at I at (Vx, Vy) on every selected plane and sets VF to whether it unset any pixel. Sprites
+ * are 8 or 16 pixels wide, with 1 or 2 bytes per row; with two planes selected, the sprite for the second plane
+ * follows the one for the first. In low resolution mode every pixel is drawn as 2 x 2 pixels.
+ */
+template<class Quirks>
+void Core::drawSprite(unsigned char width, unsigned char height)
+{
+    unsigned char screen_width = high_res ? WIDTH : LOW_RES_WIDTH;
+    unsigned char screen_height = high_res ? HEIGHT : LOW_RES_HEIGHT;
+    unsigned char first_x = V[in_reg_x] % screen_width;
+    unsigned char first_y = V[in_reg_y] % screen_height;
+    unsigned char bytes_per_row = width / 8;
+    unsigned short address = I;
+
+    bool collision = false;
+    for (unsigned char plane = 0; plane < PLANES; ++plane)
+    {
+        if (!(plane_mask >> plane & 1))
+        {
+            continue;
+        }
+        for (unsigned char row = 0; row < height; ++row)
+        {
+            unsigned char y = first_y + row;
+            if (y >= screen_height)
+            {
+                if (!Quirks::SPRITES_WRAP)
+                {
+                    break;
+                }
+                y %= screen_height;
+            }
+            traceRead<Quirks>(address + row * bytes_per_row, bytes_per_row);
+            std::uint32_t bits = ram[(address + row * bytes_per_row) & (Quirks::MEMORY_SIZE - 1)];
+            if (bytes_per_row == 2)
+            {
+                bits = bits << 8 | ram[(address + row * 2 + 1) & (Quirks::MEMORY_SIZE - 1)];
+            }
+
+            if (high_res)
+            {
+                collision |= drawRow<Quirks::SPRITES_WRAP>(plane, y, first_x, bits, width);
+                continue;
+            }
+            std::uint32_t doubled = 0;
+            for (unsigned char bit = 0; bit < width; ++bit)
+            {
+                doubled |= (bits >> bit & 1) * (std::uint32_t{3} << (2 * bit));
+            }
+            collision |= drawRow<Quirks::SPRITES_WRAP>(plane, y * 2, first_x * 2, doubled, width * 2);
+            collision |= drawRow<Quirks::SPRITES_WRAP>(plane, y * 2 + 1, first_x * 2, doubled, width * 2);
+        }
+        address += height * bytes_per_row;
+    }
+    setRegister(0xF, collision);
+    draw_display = true;
+}
+
+/**
+ * Clears the selected display planes.
+ */
+void Core::clearDisplay()
+{
+    for (unsigned char plane = 0; plane < PLANES; ++plane)
+    {
+        if (plane_mask >> plane & 1 && !display.isZero(plane))
+        {
+            std::memset(display.writablePage(plane), 0, DISPLAY_WORDS * sizeof(std::uint64_t));
+        }
+    }
+    rehashDisplay();
+    draw_display = true;
+}
+
+/**
+ * Scrolls the selected display planes down by the specified number of pixel rows, or up if it is negative, by
+ * moving whole words.
+ */
+void Core::scrollVertically(int rows)
+{
+    size_t shift = std::min<size_t>(static_cast<size_t>(rows < 0 ? -rows : rows) * 2, DISPLAY_WORDS);
+    for (unsigned char plane = 0; plane < PLANES; ++plane)
+    {
+        if (!(plane_mask >> plane & 1) || display.isZero(plane))
+        {
+            continue;
+        }
+        std::uint64_t* words = display.writablePage(plane);
+        if (rows > 0)
+        {
+            std::memmove(words + shift, words, (DISPLAY_WORDS - shift) * sizeof(*words));
+            std::memset(words, 0, shift * sizeof(*words));
+        }
+        else
+        {
+            std::memmove(words, words + shift, (DISPLAY_WORDS - shift) * sizeof(*words));
+            std::memset(words + DISPLAY_WORDS - shift, 0, shift * sizeof(*words));
+        }
+    }
+    rehashDisplay();
+    draw_display = true;
+}
+
+/**
+ * Scrolls the selected display planes right by the specified number of pixels, or left if it is negative, by
+ * shifting the two words of every row as one 128-bit word.
+ */
+void Core::scrollHorizontally(int pixels)
+{
+    for (unsigned char plane = 0; plane < PLANES; ++plane)
+    {
+        if (!(plane_mask >> plane & 1) || display.isZero(plane))
+        {
+            continue;
+        }
+        std::uint64_t* words = display.writablePage(plane);
+        for (unsigned short row = 0; row < DISPLAY_WORDS; row += 2)
+        {
+            std::uint64_t left = words[row];
+            std::uint64_t right = words[row + 1];
+            if (pixels > 0)
+            {
+                words[row] = left >> pixels;
+                words[row + 1] = right >> pixels | left << (64 - pixels);
+            }
+            else
+            {
+                words[row] = left << -pixels | right >> (64 + pixels);
+                words[row + 1] = right << -pixels;
+            }
+        }
+    }
+    rehashDisplay();
+    draw_display = true;
+}
+
+/**
+ * Sets a general purpose register, keeping the state hash up to date.
+ */
+void Core::setRegister(unsigned char x, unsigned char value)
+{
+    memory_hash ^= zobrist(V_SLOT + x, V[x]) ^ zobrist(V_SLOT + x, value);
+    V[x] = value;
+}
+
+/**
+ * Writes a byte of memory, keeping the state hash up to date.
+ */
+void Core::writeMemory(unsigned short address, unsigned char value)
+{
+    address &= ram.SIZE - 1;
+    memory_hash ^= zobrist(RAM_SLOT + address, ram[address]) ^ zobrist(RAM_SLOT + address, value);
+    ram.write(address, value);
+    if (coverage && coverage->track_accesses)
+    {
+        Coverage::mark(coverage->written, address);
+    }
+    if (heatmap)
+    {
+        Heatmap::count(heatmap->writes, address);
+    }
+}
+
+/**
+ * Marks a span of memory that an instruction reads as data in the coverage, if it tracks accesses, and counts it in
+ * the heatmap.
+ * @param address - the first address, which may lie beyond the end of memory
+ * @param size - the number of bytes
+ */
+template<class Quirks>
+void Core::traceRead(unsigned int address, unsigned int size)
+{
+    if (coverage && coverage->track_accesses)
+    {
+        for (unsigned int offset = 0; offset < size; ++offset)
+        {
+            Coverage::mark(coverage->read, (address + offset) & (Quirks::MEMORY_SIZE - 1));
+        }
+    }
+    if (heatmap)
+    {
+        for (unsigned int offset = 0; offset < size; ++offset)
+        {
+            Heatmap::count(heatmap->reads, (address + offset) & (Quirks::MEMORY_SIZE - 1));
+        }
+    }
+}
+
+/**
+ * The memory of a core right after initialization, with the fonts loaded, and the hash of everything that
+ * initialization sets to a value other than 0. Initialization starts from it instead of loading the fonts and
+ * hashing them again, sharing its pages copy-on-write.
+ */
+struct Core::BootImage
+{
+    decltype(Core::ram) ram;
+    std::uint64_t memory_hash = 0;
+};
+
+/**
+ * Returns the boot image, which is built on first use. It is never destroyed, so that its pages outlive the
+ * free lists they would be returned to.
+ */
+const Core::BootImage& Core::bootImage()
+{
+    static const BootImage* boot_image = []()
+    {
+        auto image = new BootImage();
+        std::memcpy(image->ram.writablePage(FONT_ADDRESS / PAGE_SIZE) + FONT_ADDRESS % PAGE_SIZE, FONT_DATA,
+                sizeof(FONT_DATA));
+        std::memcpy(image->ram.writablePage(BIG_FONT_ADDRESS / PAGE_SIZE) + BIG_FONT_ADDRESS % PAGE_SIZE,
+                BIG_FONT_DATA, sizeof(BIG_FONT_DATA));
+        image->memory_hash = hashRamSpan(0, image->ram.readPage(0), PAGE_SIZE);
+        for (unsigned char index = 0; index < 16; ++index)
+        {
+            image->memory_hash ^= zobrist(PATTERN_SLOT + index, DEFAULT_PATTERN[index]);
+        }
+        return image;
+    }();
+    return *boot_image;
+}
+
+/**
+ * Initializes the core by setting up all registers and memory.
+ * @param seed - the seed of the random number generator; equal seeds give reproducible runs
+ */
+void Core::initialize(std::uint64_t seed)
+{
+    random.setSeed(seed);
+
+    delay_timer.setValue(0);
+    sound_timer.setValue(0);
+
+    draw_display = false;
+    faults = Faults{};
+
+    PC = PROGRAM_ADDRESS;
+    SP = 0;
+    I = 0;
+    for (char i = 0; i < 16; ++i)
+    {
+        V[i] = 0;
+    }
+
+    // Point all display pages at the shared zero page, and the memory at the pages of the boot image
+    display.clear();
+    high_res = false;
+    plane_mask = 1;
+    ram = bootImage().ram;
+    std::memset(flags, 0, sizeof(flags));
+    std::memset(stack, 0, sizeof(stack));
+    std::memcpy(pattern, DEFAULT_PATTERN, sizeof(pattern));
+    pitch = DEFAULT_PITCH;
+    mega_mode = false;
+    mega_indices.clear();
+    mega_colors.clear();
+    std::memset(palette, 0, sizeof(palette));
+    sprite_width = 0;
+    sprite_height = 0;
+    blend_mode = BlendMode::NORMAL;
+    collision_color = 0;
+    screen_alpha = 0xFF;
+
+    // Everything else is 0, which contributes nothing to the hashes
+    memory_hash = bootImage().memory_hash;
+    display_hash = 0;
+    mega_hash = 0;
+}
+
+/**
+ * Puts the specified core in the same state as this one.
+ * Memory and display pages are shared with this core and only copied when either core writes to them, so
+ * the font and the program are never duplicated.
+ * @param child - the core that becomes a fork of this core
+ */
+void Core::fork(Core& child) const
+{
+    Coverage* child_coverage = child.coverage;
+    Heatmap* child_heatmap = child.heatmap;
+    Trace* child_trace = child.trace;
+    child = *this;
+    child.coverage = child_coverage;
+    child.heatmap = child_heatmap;
+    child.trace = child_trace;
+    child.setQuirks(quirks);
+}
+
+/**
+ * Creates a new core in the same state as this one. Like a new core, it has no coverage, heatmap or trace attached,
+ * so that it never marks those of this core.
+ * @return the new core, sharing memory pages with this one
+ */
+Core Core::fork() const
+{
+    Core child = *this;
+    child.coverage = nullptr;
+    child.heatmap = nullptr;
+    child.setTrace(nullptr);
+    return child;
+}
+
+/**
+ * Reads the specified program file.
+ * @param program_name - the name of the program file
+ * @return the contents of the file
+ */
+std::vector<unsigned char> Core::readProgram(const std::string& program_name)
+{
+    FILE * program = std::fopen(program_name.c_str(), "rb");
+    if (!program)
+    {
+        std::cerr << "ERROR: File " << program_name << " could not be read." << std::endl;
+        throw(errno);
+    }
+
+    // Read in one go into an uninitialized buffer, one byte more than fits, instead of seeking for the size first
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[MEMORY_SIZE - PROGRAM_ADDRESS + 1]);
+    size_t program_size = std::fread(buffer.get(), 1, MEMORY_SIZE - PROGRAM_ADDRESS + 1, program);
+    std::fclose(program);
+    if (program_size > MEMORY_SIZE - PROGRAM_ADDRESS)
+    {
+        std::cerr << "ERROR: File " << program_name << " is too large." << std::endl;
+        errno = ENOMEM;
+        throw(errno);
+    }
+    return std::vector<unsigned char>(buffer.get(), buffer.get() + program_size);
+}
+
+/**
+ * Loads the specified program into memory.
+ * @param program_name - the name of the program that will be loaded into memory.
+ */
+void Core::loadProgram(const std::string& program_name)
+{
+    std::vector<unsigned char> program = readProgram(program_name);
+    loadProgram(program.data(), program.size());
+}
+
+/**
+ * Loads the specified program into memory.
+ * @param program - the program code
+ * @param size - the size of the program in bytes, at most the memory above the program address of the selected
+ *               quirk profile
+ */
+void Core::loadProgram(const unsigned char* program, size_t size)
+{
+    if (size > getMemorySize(quirks) - PROGRAM_ADDRESS)
+    {
+        std::cerr << "ERROR: Program is too large." << std::endl;
+        errno = ENOMEM;
+        throw(errno);
+    }
+
+    // Copy page by page, hashing out the old contents and in the new
+    for (size_t offset = 0; offset < size;)
+    {
+        size_t address = PROGRAM_ADDRESS + offset;
+        size_t length = std::min(size - offset, PAGE_SIZE - address % PAGE_SIZE);
+        unsigned char* data = ram.writablePage(address / PAGE_SIZE) + address % PAGE_SIZE;
+        memory_hash ^= hashRamSpan(address, data, length) ^ hashRamSpan(address, program + offset, length);
+        std::memcpy(data, program + offset, length);
+        offset += length;
+    }
+}
+
+/**
+ * Selects the interpreter of the specified quirk profile.
+ * @param profile - the interpreter the program was written for
+ */
+void Core::setQuirks(QuirkProfile profile)
+{
+    quirks = profile;
+    switch (profile)
+    {
+        case QuirkProfile::VIP:
+            selectInterpreter<VipQuirks>();
+            break;
+        case QuirkProfile::SUPER_CHIP:
+            selectInterpreter<SuperChipQuirks>();
+            break;
+        case QuirkProfile::XO_CHIP:
+            selectInterpreter<XoChipQuirks>();
+            break;
+        case QuirkProfile::MEGA_CHIP:
+            selectInterpreter<MegaChipQuirks>();
+            break;
+        default:
+            quirks = QuirkProfile::DEFAULT;
+            selectInterpreter<DefaultQuirks>();
+            break;
+    }
+}
 
-unsigned char* Core::getPixels()
+/**
+ * Selects the interpreter of a quirk profile, wrapped in the tracer if a trace is attached.
+ */
+template<class Quirks>
+void Core::selectInterpreter()
 {
-    return display;
+    cycle = trace ? &Core::emulateTraced<Quirks> : &Core::emulate<Quirks>;
 }
 
 /**
- * Initializes the core by setting up all registers and memory.
+ * Returns the selected quirk profile.
  */
-void Core::initialize()
+QuirkProfile Core::getQuirks() const
 {
-    srand(static_cast<unsigned int>(time(nullptr)));
+    return quirks;
+}
 
-    delay_timer.setValue(0);
-    sound_timer.setValue(0);
+/**
+ * Attaches a coverage that this core marks the addresses it executes in, and its memory accesses if the coverage
+ * tracks them.
+ * @param coverage - the coverage, or nullptr to stop marking
+ */
+void Core::setCoverage(Coverage* coverage)
+{
+    this->coverage = coverage;
+}
 
-    draw_display = false;
+/**
+ * Attaches a heatmap that this core counts its instruction fetches, memory accesses and calls in. Like coverage, a
+ * fork keeps the heatmap it had.
+ * @param heatmap - the heatmap, or nullptr to stop counting
+ */
+void Core::setHeatmap(Heatmap* heatmap)
+{
+    this->heatmap = heatmap;
+}
 
-    PC = PROGRAM_ADDRESS;
-    SP = 0;
-    I = 0;
-    for (char i = 0; i < 16; ++i)
+/**
+ * Attaches an instruction trace that this core records every cycle in, with the registers the instruction changed.
+ * @param trace - the trace, or nullptr to stop tracing
+ */
+void Core::setTrace(Trace* trace)
+{
+    this->trace = trace;
+    setQuirks(quirks);
+}
+
+/**
+ * Returns the faults of the program since the last initialization.
+ */
+const Core::Faults& Core::getFaults() const
+{
+    return faults;
+}
+
+/**
+ * Counts a fault of the current instruction and prints it if log_faults is set.
+ * @param counter - the counter of the kind of fault
+ * @param description - what went wrong
+ */
+void Core::reportFault(unsigned int& counter, const char* description)
+{
+    ++counter;
+    if (log_faults)
     {
-        V[i] = 0;
-        display[i] = 0;
+        std::printf("%s: 0x%04X at 0x%04X.\n", description, ram[PC] << 8 | ram[PC + 1], PC);
+    }
+}
+
+/**
+ * The memory and I/O of the VIP as the CDP1802 sees them while a machine code routine runs. Writes go through
+ * writeMemory, so that the state hash stays up to date; OUT 2 latches the key that EF3 reports.
+ */
+struct Core::MachineCodeBus
+{
+    Core& core;
+    unsigned char key_latch = 0;
+
+    unsigned char read(unsigned short address)
+    {
+        core.traceRead<VipQuirks>(address, 1);
+        return core.ram[address & (MACHINE_CODE_MEMORY - 1)];
     }
-    for (char i = 16; i < FONT_ADDRESS + 80; ++i) // 5 bytes per character, 16 characters = 80 bytes
+
+    void write(unsigned short address, unsigned char value)
     {
-        display[i] = 0;
+        core.writeMemory(address & (MACHINE_CODE_MEMORY - 1), value);
     }
-    for (short i = FONT_ADDRESS + 5 * 0xF; i < RESOLUTION; ++i)
+
+    void output(unsigned char port, unsigned char value)
     {
-        display[i] = 0;
-        ram[i] = 0;
+        if (port == 2)
+        {
+            key_latch = value & 0x0F;
+        }
     }
-    for (short i = RESOLUTION; i < 4096; ++i)
+
+    unsigned char input(unsigned char)
     {
-        ram[i] = 0;
+        return 0;
     }
 
-    // Load font data into memory
-    for (char i = 0; i < 80; ++i)
+    bool flag(unsigned char line)
     {
-        ram[i] = font_data[i];
+        return line == 3 && core.keyboard.getKey(static_cast<char>(key_latch));
     }
-}
+};
 
 /**
- * Loads the specified program into memory.
- * @param program_name - the name of the program that will be loaded into memory.
+ * Runs the CDP1802 machine code routine at NNN, as the VIP interpreter does for 0NNN. The routine finds the
+ * registers where the VIP keeps them:
+ *  - V0-VF at 0xEF0-0xEFF, with R6 and R7 pointing to Vx and Vy
+ *  - the 64x32 display at 0xF00-0xFFF, a bit per pixel with the leftmost as the most significant, and RB.1 = 0x0F
+ *  - I in RA and the address of the next CHIP-8 instruction in R5
+ *  - the delay timer in R8.1 and the sound timer in R8.0
+ *  - a stack at R2 = 0xECF, X = 2, and the program counter R3 = NNN
+ * and returns to the interpreter with SEP R4 (D4), after which the registers, I, PC, the timers and the display
+ * are read back. IDL waits for the next frame interrupt, which is not emulated, so execution simply continues; the
+ * instruction budget of a routine spans all of its IDLs, so that a routine looping through IDL still times out.
  */
-void Core::loadProgram(const std::string& program_name)
+void Core::callMachineCode()
 {
-    FILE * program = std::fopen(program_name.c_str(), "rb");
-    if (!program)
+    for (unsigned char x = 0; x < 16; ++x)
     {
-        std::cerr << "ERROR: File " << program_name << " could not be read." << std::endl;
-        throw(errno);
+        writeMemory(V_ADDRESS + x, V[x]);
     }
 
-    std::fseek(program, 0, SEEK_END);
-    long program_size = std::ftell(program);
-    if (program_size > STACK_ADDRESS - PROGRAM_ADDRESS)
+    // Every low resolution pixel covers 2 x 2 pixels of plane 0; take the left one of each pair on the even rows
+    unsigned char bitmap[VIP_DISPLAY_SIZE];
+    for (unsigned short byte = 0; byte < VIP_DISPLAY_SIZE; ++byte)
     {
-        std::cerr << "ERROR: File " << program_name << " is too large." << std::endl;
-        errno = ENOMEM;
-        throw(errno);
+        unsigned char y = static_cast<unsigned char>(byte / 8);
+        unsigned char column = byte % 8;
+        std::uint64_t word = display[y * 4 + column / 4];
+        unsigned int pixels = static_cast<unsigned int>(word >> (48 - column % 4 * 16)) & 0xFFFF;
+        unsigned char bits = 0;
+        for (unsigned char bit = 0; bit < 8; ++bit)
+        {
+            bits = static_cast<unsigned char>(bits << 1 | (pixels >> (15 - bit * 2) & 1));
+        }
+        bitmap[byte] = bits;
+        writeMemory(VIP_DISPLAY_ADDRESS + byte, bits);
     }
 
-    std::rewind(program);
-    std::fread(&ram[PROGRAM_ADDRESS], 1, static_cast<size_t>(program_size), program);
-    std::fclose(program);
+    Cdp1802 cpu;
+    cpu.R[2] = VIP_STACK_ADDRESS;
+    cpu.R[3] = in_address;
+    cpu.R[5] = static_cast<std::uint16_t>(PC + 2);
+    cpu.R[6] = static_cast<std::uint16_t>(V_ADDRESS + in_reg_x);
+    cpu.R[7] = static_cast<std::uint16_t>(V_ADDRESS + in_reg_y);
+    cpu.R[8] = static_cast<std::uint16_t>(delay_timer.getValue() << 8 | sound_timer.getValue());
+    cpu.R[0xA] = I;
+    cpu.R[0xB] = VIP_DISPLAY_ADDRESS;
+    cpu.P = 3;
+    cpu.X = 2;
+
+    MachineCodeBus bus{*this};
+    unsigned long budget = MAX_MACHINE_CODE_INSTRUCTIONS;
+    Cdp1802::Exit exit;
+    while ((exit = cpu.run(bus, 4, budget)) == Cdp1802::Exit::IDLE)
+    {
+    }
+    if (exit == Cdp1802::Exit::TIMED_OUT)
+    {
+        reportFault(faults.invalid_opcodes, "RCA 1802 program did not return");
+        return;
+    }
+
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        setRegister(x, ram[V_ADDRESS + x]);
+    }
+    I = cpu.R[0xA] & (MACHINE_CODE_MEMORY - 1);
+    PC = static_cast<unsigned short>(cpu.R[5] - 2);
+    delay_timer.setValue(static_cast<unsigned char>(cpu.R[8] >> 8));
+    sound_timer.setValue(static_cast<unsigned char>(cpu.R[8]));
+
+    bool changed = false;
+    for (unsigned short byte = 0; byte < VIP_DISPLAY_SIZE; ++byte)
+    {
+        changed |= bitmap[byte] != ram[VIP_DISPLAY_ADDRESS + byte];
+    }
+    if (!changed)
+    {
+        return;
+    }
+    std::uint64_t* pixels = display.writablePage(0);
+    for (unsigned char y = 0; y < LOW_RES_HEIGHT; ++y)
+    {
+        for (unsigned char half = 0; half < 2; ++half)
+        {
+            std::uint64_t word = 0;
+            for (unsigned char column = 0; column < 4; ++column)
+            {
+                unsigned char bits = ram[VIP_DISPLAY_ADDRESS + y * 8 + half * 4 + column];
+                for (unsigned char bit = 0; bit < 8; ++bit)
+                {
+                    word = word << 2 | (bits >> (7 - bit) & 1) * 3;
+                }
+            }
+            pixels[y * 4 + half] = word;
+            pixels[y * 4 + 2 + half] = word;
+        }
+    }
+    rehashDisplay();
+    draw_display = true;
 }
 
 /**
- * Emulates one cycle.
+ * Emulates one cycle. Every quirk is a compile-time constant, so each profile gets its own interpreter.
  */
-void Core::emulateCycle()
+template<class Quirks>
+void Core::emulate()
 {
-    //std::printf("Instruction: %X\n", ram[PC] << 8 | ram[PC+1]);
-
+    PC &= Quirks::MEMORY_SIZE - 1;
+    if (coverage)
+    {
+        Coverage::mark(coverage->executed, PC);
+    }
+    if (heatmap)
+    {
+        Heatmap::count(heatmap->fetches, PC);
+        Heatmap::count(heatmap->fetches, (PC + 1) & (Quirks::MEMORY_SIZE - 1));
+    }
+    unsigned char low = ram[(PC + 1) & (Quirks::MEMORY_SIZE - 1)];
+#if defined(CHIP8_OPCODE_PROFILER)
+    OpcodeProfiler::Scope profile(static_cast<unsigned short>(ram[PC] << 8 | low), PC);
+#endif
     in_reg_x = ram[PC] & static_cast<unsigned char>(0x0F);
-    in_reg_y = ram[PC + 1] >> 4;
-    in_constant_n = ram[PC + 1] & static_cast<unsigned char>(0x0F);
-    in_address = in_reg_x << 8 | ram[PC + 1];
+    in_reg_y = low >> 4;
+    in_constant_n = low & static_cast<unsigned char>(0x0F);
+    in_address = in_reg_x << 8 | low;
 
     switch (ram[PC] >> 4)
     {
@@ -95,174 +1030,208 @@ void Core::emulateCycle()
             switch (in_address)
             {
                 case 0x0E0: // Clear display
-                    for (short i = 0; i < RESOLUTION; ++i)
+                    if (Quirks::MEGA_CHIP_OPCODES && mega_mode)
                     {
-                        display[i] = 0;
+                        clearMegaDisplay();
+                    }
+                    else
+                    {
+                        clearDisplay();
                     }
-                    draw_display = true;
                     break;
                 case 0x0EE: // Return from subroutine
-                    SP -= 2;
+                    if (SP == 0)
+                    {
+                        reportFault(faults.stack_underflows, "Stack underflow");
+                    }
+                    --SP;
+                    if (heatmap)
                     {
-                        short address = STACK_ADDRESS + SP;
-                        PC = ram[address] << 8 | ram[address + 1];
+                        heatmap->countReturn(SP);
                     }
+                    PC = stack[SP % STACK_DEPTH];
                     break;
                 default:
-                    // TODO: Call RCA 1802 program: rca(in_address)
-                    std::printf("Call to RCA 1802 program at 0x%X.\n", in_address);
+                    if ((!Quirks::MEGA_CHIP_OPCODES || !emulateMegaChip<Quirks>())
+                            && (!Quirks::SUPER_CHIP_OPCODES || !emulateSuperChip<Quirks>())
+                            && (!Quirks::XO_CHIP_OPCODES || !emulateXoChip<Quirks>()))
+                    {
+                        if (Quirks::MACHINE_CODE_ROUTINES)
+                        {
+                            callMachineCode();
+                        }
+                        else
+                        {
+                            reportFault(faults.invalid_opcodes, "Call to RCA 1802 program");
+                        }
+                    }
                     break;
             }
             PC += 2;
             break;
         case 0x2: // Call subroutine at NNN
+            if (SP >= STACK_DEPTH)
+            {
+                reportFault(faults.stack_overflows, "Stack overflow");
+            }
+            {
+                unsigned char level = SP % STACK_DEPTH;
+                memory_hash ^= zobrist(STACK_SLOT + level, stack[level]) ^ zobrist(STACK_SLOT + level, PC);
+                stack[level] = PC;
+            }
+            ++SP;
+            if (heatmap)
             {
-                short address = STACK_ADDRESS + SP;
-                ram[address] = static_cast<unsigned char>(PC >> 8);
-                ram[address + 1] = static_cast<unsigned char>(PC & 0x00FF);
+                heatmap->countCall(SP);
             }
-            SP += 2;
         case 0x1: // Jump to address NNN
             PC = in_address;
             break;
         case 0x3: // Skip the next instruction if Vx == NN
-            PC += (V[in_reg_x] == ram[PC+1]) ? 4 : 2;
+            PC += (V[in_reg_x] == low) ? skip<Quirks>() : 2;
             break;
         case 0x4: // Skip the next instruction if Vx != NN
-            PC += (V[in_reg_x] != ram[PC+1]) ? 4 : 2;
+            PC += (V[in_reg_x] != low) ? skip<Quirks>() : 2;
             break;
         case 0x5:
             if (in_constant_n)
             {
-                printf("Invalid opcode: 0x%X\n", ram[PC] << 8 | ram[PC+1]);
+                if (!Quirks::XO_CHIP_OPCODES || !emulateXoChip<Quirks>())
+                {
+                    reportFault(faults.invalid_opcodes, "Invalid opcode");
+                }
                 PC += 2;
             }
             else // Skip the next instruction if Vx == Vy
             {
-                PC += (V[in_reg_x] == V[in_reg_y]) ? 4 : 2;
+                PC += (V[in_reg_x] == V[in_reg_y]) ? skip<Quirks>() : 2;
             }
             break;
         case 0x6: // Set Vx to NN
-            V[in_reg_x] = ram[PC+1];
+            setRegister(in_reg_x, low);
             PC += 2;
             break;
         case 0x7: // Add NN to Vx (no carry flag)
-            V[in_reg_x] += ram[PC+1];
+            setRegister(in_reg_x, V[in_reg_x] + low);
             PC += 2;
             break;
         case 0x8:
             switch (in_constant_n)
             {
                 case 0x0: // Set Vx to Vy
-                    V[in_reg_x] = V[in_reg_y];
+                    setRegister(in_reg_x, V[in_reg_y]);
                     break;
                 case 0x1: // Set Vx to Vx OR Vy
-                    V[in_reg_x] |= V[in_reg_y];
+                    setRegister(in_reg_x, V[in_reg_x] | V[in_reg_y]);
+                    if (Quirks::LOGIC_RESETS_VF)
+                    {
+                        setRegister(0xF, 0);
+                    }
                     break;
                 case 0x2: // Set Vx to Vx AND Vy
-                    V[in_reg_x] &= V[in_reg_y];
+                    setRegister(in_reg_x, V[in_reg_x] & V[in_reg_y]);
+                    if (Quirks::LOGIC_RESETS_VF)
+                    {
+                        setRegister(0xF, 0);
+                    }
                     break;
                 case 0x3: // Set Vx to Vx XOR Vy
-                    V[in_reg_x] ^= V[in_reg_y];
+                    setRegister(in_reg_x, V[in_reg_x] ^ V[in_reg_y]);
+                    if (Quirks::LOGIC_RESETS_VF)
+                    {
+                        setRegister(0xF, 0);
+                    }
                     break;
                 case 0x4: // Add Vy to Vx (set carry flag VF to 1 on carry, 0 otherwise)
                     {
                         unsigned short sum = V[in_reg_x] + V[in_reg_y];
-                        V[in_reg_x] = static_cast<unsigned char>(sum);
-                        V[0xF] = static_cast<unsigned char>((sum > 0xFF) ? 1 : 0);
+                        setRegister(in_reg_x, static_cast<unsigned char>(sum));
+                        setRegister(0xF, static_cast<unsigned char>((sum > 0xFF) ? 1 : 0));
                     }
                     break;
                 case 0x5: // Subtract Vy from Vx (set borrow flag VF to 0 on borrow, 1 otherwise)
                     {
                         unsigned short diff = V[in_reg_x] - V[in_reg_y];
-                        V[in_reg_x] = static_cast<unsigned char>(diff);
-                        V[0xF] = static_cast<unsigned char>((diff > 0xFF) ? 0 : 1);
+                        setRegister(in_reg_x, static_cast<unsigned char>(diff));
+                        setRegister(0xF, static_cast<unsigned char>((diff > 0xFF) ? 0 : 1));
                     }
                     break;
-                case 0x6: // Set VF to Vy & 1, set Vx = Vy = Vy >> 1
+                case 0x6: // Set Vx = Vy >> 1 (or Vx >> 1), set VF to the bit shifted out
                     {
-                        auto lsb = static_cast<unsigned char>(V[in_reg_y] & 1);
-                        V[in_reg_x] = V[in_reg_y] >>= 1;
-                        V[0xF] = lsb;
+                        unsigned char source = V[Quirks::SHIFT_READS_VY ? in_reg_y : in_reg_x];
+                        setRegister(in_reg_x, source >> 1);
+                        setRegister(0xF, static_cast<unsigned char>(source & 1));
                     }
                     break;
                 case 0x7: // Set Vx to Vy - Vx (set borrow flag VF to 0 on borrow, 1 otherwise)
                     {
                         unsigned short diff = V[in_reg_y] - V[in_reg_x];
-                        V[in_reg_x] = static_cast<unsigned char>(diff);
-                        V[0xF] = static_cast<unsigned char>((diff > 0xFF) ? 0 : 1);
+                        setRegister(in_reg_x, static_cast<unsigned char>(diff));
+                        setRegister(0xF, static_cast<unsigned char>((diff > 0xFF) ? 0 : 1));
                     }
                     break;
-                case 0xE: // Set VF to Vy >> 7, set Vx = Vy = Vy << 1
+                case 0xE: // Set Vx = Vy << 1 (or Vx << 1), set VF to the bit shifted out
                     {
-                        unsigned char msb = V[in_reg_y] >> 7;
-                        V[in_reg_x] = V[in_reg_y] <<= 1;
-                        V[0xF] = msb;
+                        unsigned char source = V[Quirks::SHIFT_READS_VY ? in_reg_y : in_reg_x];
+                        setRegister(in_reg_x, static_cast<unsigned char>(source << 1));
+                        setRegister(0xF, static_cast<unsigned char>(source >> 7));
                     }
                     break;
                 default:
-                    printf("Invalid opcode: 0x%X\n", ram[PC] << 8 | ram[PC+1]);
+                    reportFault(faults.invalid_opcodes, "Invalid opcode");
                     break;
             }
             PC += 2;
             break;
         case 0x9: // Skip the next instruction if Vx != Vy
-            PC += (V[in_reg_x] != V[in_reg_y]) ? 4 : 2;
+            PC += (V[in_reg_x] != V[in_reg_y]) ? skip<Quirks>() : 2;
             break;
         case 0xA: // Set I = NNN
             I = in_address;
             PC += 2;
             break;
-        case 0xB: // Jump to address NNN + V0
-            PC = in_address + V[0];
+        case 0xB: // Jump to address NNN + V0 (or XNN + Vx)
+            PC = in_address + V[Quirks::JUMP_USES_VX ? in_reg_x : 0];
             break;
         case 0xC: // Set Vx = NN & random number
-            V[in_reg_x] = static_cast<unsigned char>(rand() & ram[PC + 1]);
+            setRegister(in_reg_x, static_cast<unsigned char>(random.next() >> 56 & low));
             PC += 2;
             break;
-        case 0xD: // Draw a sprite at Vx, Vy, 8 pixels wide and N pixels high, which is stored at I
+        case 0xD: // Draw a sprite at Vx, Vy, 8 pixels wide and N pixels high (or 16 x 16 if N is 0), stored at I
+            if (Quirks::MEGA_CHIP_OPCODES && mega_mode)
             {
-                V[0xF] = 0;
-                unsigned char pixel_row;
-                short pixel_index;
-                unsigned char pixel_data;
-                for (unsigned char row = 0; row < in_constant_n; ++row)
-                {
-                    pixel_row = ram[I+row];
-                    for (unsigned char col = 0; col < 8; ++col)
-                    {
-                        pixel_data = static_cast<unsigned char>((pixel_row >> (7 - col) & 1) ? -1 : 0);
-                        pixel_index = (V[in_reg_x] + col + (V[in_reg_y] + row) * WIDTH) % RESOLUTION;
-                        display[pixel_index] ^= pixel_data;
-                        if (!V[0xF])
-                        {
-                            V[0xF] = static_cast<unsigned char>(pixel_data & ~display[pixel_index] ? 1 : 0); // Set collision flag VF to 1 if a pixel is unset
-                        }
-                    }
-                }
+                drawMegaSprite<Quirks>();
+            }
+            else if (Quirks::SUPER_CHIP_OPCODES && in_constant_n == 0)
+            {
+                drawSprite<Quirks>(16, 16);
+            }
+            else
+            {
+                drawSprite<Quirks>(8, in_constant_n);
             }
-            draw_display = true;
             PC += 2;
             break;
         case 0xE:
-            switch (ram[PC+1])
+            switch (low)
             {
                 case 0x9E: // Skip the next instruction if the key stored in Vx is pressed
-                    PC += keyboard.getKey(V[in_reg_x]) ? 4 : 2;
+                    PC += keyboard.getKey(V[in_reg_x]) ? skip<Quirks>() : 2;
                     break;
                 case 0xA1: // Skip the next instruction if the key stored in Vx is not pressed
-                    PC += keyboard.getKey(V[in_reg_x]) ? 2 : 4;
+                    PC += keyboard.getKey(V[in_reg_x]) ? 2 : skip<Quirks>();
                     break;
                 default:
+                    reportFault(faults.invalid_opcodes, "Invalid opcode");
                     PC += 2;
                     break;
             }
             break;
         case 0xF:
-            switch (ram[PC+1])
+            switch (low)
             {
                 case 0x07: // Set Vx to the value of the delay timer
-                    V[in_reg_x] = delay_timer.getValue();
+                    setRegister(in_reg_x, delay_timer.getValue());
                     break;
                 case 0x0A: // Halt program execution until a key is pressed, and store the key in Vx
                     {
@@ -271,7 +1240,7 @@ void Core::emulateCycle()
                         {
                             return;
                         }
-                        V[in_reg_x] = static_cast<unsigned char>(key);
+                        setRegister(in_reg_x, static_cast<unsigned char>(key));
                     }
                     break;
                 case 0x15: // Set delay timer to Vx
@@ -280,42 +1249,57 @@ void Core::emulateCycle()
                 case 0x18: // Set sound timer to Vx
                     sound_timer.setValue(V[in_reg_x]);
                     break;
-                case 0x1E: // Add Vx to I (set carry flag VF to 1 on carry, 0 otherwise)
+                case 0x1E: // Add Vx to I (set carry flag VF to 1 on carry, 0 otherwise, unless I spans 64 KB)
                     I += V[in_reg_x];
+                    if (Quirks::MEMORY_SIZE > 0x1000)
+                    {
+                        break;
+                    }
                     if (I > 0xFFF)
                     {
                         I &= 0xFFF;
-                        V[0xF] = 1;
+                        setRegister(0xF, 1);
                     }
                     else
                     {
-                        V[0xF] = 0;
+                        setRegister(0xF, 0);
                     }
                     break;
                 case 0x29: // Set I to the address of the font for the character in Vx
                     I = static_cast<unsigned short>(FONT_ADDRESS + 5 * V[in_reg_x]);
                     break;
                 case 0x33: // Store the BCD representation of Vx at address I, I+1, I+2
-                    ram[I] = static_cast<unsigned char>((V[in_reg_x] >> 2) / 25);
-                    ram[I+1] = static_cast<unsigned char>(V[in_reg_x] / 10 % 10);
-                    ram[I+2] = static_cast<unsigned char>(V[in_reg_x] % 10);
+                    writeMemory(I & (Quirks::MEMORY_SIZE - 1), static_cast<unsigned char>((V[in_reg_x] >> 2) / 25));
+                    writeMemory((I + 1) & (Quirks::MEMORY_SIZE - 1), static_cast<unsigned char>(V[in_reg_x] / 10 % 10));
+                    writeMemory((I + 2) & (Quirks::MEMORY_SIZE - 1), static_cast<unsigned char>(V[in_reg_x] % 10));
                     break;
                 case 0x55: // Store V0 to Vx at address I to I+x
                     for (int reg = 0; reg <= in_reg_x; ++reg)
                     {
-                        ram[I] = V[reg];
-                        ++I;
+                        writeMemory((I + reg) & (Quirks::MEMORY_SIZE - 1), V[reg]);
+                    }
+                    if (Quirks::LOAD_STORE_INCREMENTS_I)
+                    {
+                        I += in_reg_x + 1;
                     }
                     break;
                 case 0x65: // Load values stored at address I to I+x into V0 to Vx
+                    traceRead<Quirks>(I, in_reg_x + 1u);
                     for (int reg = 0; reg <= in_reg_x; ++reg)
                     {
-                        V[reg] = ram[I];
-                        ++I;
+                        setRegister(reg, ram[(I + reg) & (Quirks::MEMORY_SIZE - 1)]);
+                    }
+                    if (Quirks::LOAD_STORE_INCREMENTS_I)
+                    {
+                        I += in_reg_x + 1;
                     }
                     break;
                 default:
-                    printf("Invalid opcode: 0x%X\n", ram[PC] << 8 | ram[PC+1]);
+                    if ((!Quirks::SUPER_CHIP_OPCODES || !emulateSuperChip<Quirks>())
+                            && (!Quirks::XO_CHIP_OPCODES || !emulateXoChip<Quirks>()))
+                    {
+                        reportFault(faults.invalid_opcodes, "Invalid opcode");
+                    }
                     break;
             }
         default:
@@ -323,3 +1307,418 @@ void Core::emulateCycle()
             break;
     }
 }
+
+/**
+ * Emulates one cycle and records it in the trace, with every register that the instruction changed.
+ */
+template<class Quirks>
+void Core::emulateTraced()
+{
+    unsigned short address = PC & (Quirks::MEMORY_SIZE - 1);
+    auto opcode = static_cast<unsigned short>(ram[address] << 8 | ram[(address + 1) & (Quirks::MEMORY_SIZE - 1)]);
+    unsigned char previous_V[16];
+    std::memcpy(previous_V, V, sizeof(V));
+    unsigned short previous_I = I;
+
+    emulate<Quirks>();
+
+    bool changed = false;
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        if (V[x] != previous_V[x])
+        {
+            trace->push(address, opcode, x, V[x]);
+            changed = true;
+        }
+    }
+    if (I != previous_I)
+    {
+        trace->push(address, opcode, TraceRecord::I_REGISTER, I);
+        changed = true;
+    }
+    if (!changed)
+    {
+        trace->push(address, opcode, TraceRecord::NO_REGISTER, 0);
+    }
+    trace->endCycle();
+}
+
+/**
+ * Emulates the SUPER-CHIP opcodes of the 0 and F groups that CHIP-8 does not have. PC is advanced by the caller.
+ * XO-CHIP scrolls by low resolution pixels in low resolution mode, where SUPER-CHIP scrolls by display pixels.
+ * @return whether the current instruction is one of them
+ */
+template<class Quirks>
+bool Core::emulateSuperChip()
+{
+    int scale = Quirks::XO_CHIP_OPCODES && !high_res ? 2 : 1;
+    unsigned char high = ram[PC] >> 4;
+    if (high == 0x0 && (in_address & 0xFF0) == 0x0C0) // Scroll down N rows
+    {
+        scrollVertically(in_constant_n * scale);
+        return true;
+    }
+    switch (high << 12 | (high == 0x0 ? in_address : ram[(PC + 1) & (Quirks::MEMORY_SIZE - 1)]))
+    {
+        case 0x00FB: // Scroll right by 4 pixels
+            scrollHorizontally(4 * scale);
+            return true;
+        case 0x00FC: // Scroll left by 4 pixels
+            scrollHorizontally(-4 * scale);
+            return true;
+        case 0x00FD: // Exit the interpreter; the program stays on this instruction from now on
+            PC -= 2;
+            return true;
+        case 0x00FE: // Switch to low resolution
+        case 0x00FF: // Switch to high resolution
+            high_res = in_address == 0x0FF;
+            if (Quirks::XO_CHIP_OPCODES)
+            {
+                unsigned char selected = plane_mask;
+                plane_mask = (1 << PLANES) - 1;
+                clearDisplay();
+                plane_mask = selected;
+            }
+            draw_display = true;
+            return true;
+        case 0xF030: // Set I to the address of the big font for the digit in Vx
+            I = static_cast<unsigned short>(BIG_FONT_ADDRESS + 10 * (V[in_reg_x] % 10));
+            return true;
+        case 0xF075: // Store V0 to Vx in the flag registers (x < 8, or any x under XO-CHIP)
+            for (unsigned char reg = 0; reg <= (Quirks::XO_CHIP_OPCODES ? in_reg_x : in_reg_x & 7); ++reg)
+            {
+                memory_hash ^= zobrist(FLAG_SLOT + reg, flags[reg]) ^ zobrist(FLAG_SLOT + reg, V[reg]);
+                flags[reg] = V[reg];
+            }
+            return true;
+        case 0xF085: // Load V0 to Vx from the flag registers (x < 8, or any x under XO-CHIP)
+            for (unsigned char reg = 0; reg <= (Quirks::XO_CHIP_OPCODES ? in_reg_x : in_reg_x & 7); ++reg)
+            {
+                setRegister(reg, flags[reg]);
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Emulates the XO-CHIP opcodes that neither CHIP-8 nor SUPER-CHIP have. PC is advanced by the caller, except for
+ * the long load, which skips its second word itself.
+ * @return whether the current instruction is one of them
+ */
+template<class Quirks>
+bool Core::emulateXoChip()
+{
+    unsigned char high = ram[PC] >> 4;
+    unsigned char low = ram[(PC + 1) & (Quirks::MEMORY_SIZE - 1)];
+    if (high == 0x0 && (in_address & 0xFF0) == 0x0D0) // Scroll up N rows
+    {
+        scrollVertically(-in_constant_n * (high_res ? 1 : 2));
+        return true;
+    }
+    if (high == 0x5 && (in_constant_n == 0x2 || in_constant_n == 0x3)) // Store or load Vx to Vy at I
+    {
+        int step = in_reg_x <= in_reg_y ? 1 : -1;
+        for (int offset = 0; offset <= std::abs(in_reg_y - in_reg_x); ++offset)
+        {
+            auto reg = static_cast<unsigned char>(in_reg_x + step * offset);
+            auto address = static_cast<unsigned short>((I + offset) & (Quirks::MEMORY_SIZE - 1));
+            if (in_constant_n == 0x2)
+            {
+                writeMemory(address, V[reg]);
+            }
+            else
+            {
+                traceRead<Quirks>(address, 1);
+                setRegister(reg, ram[address]);
+            }
+        }
+        return true;
+    }
+    if (high != 0xF)
+    {
+        return false;
+    }
+    switch (low)
+    {
+        case 0x00: // Set I to the 16-bit address in the next word (F000 NNNN)
+            if (in_reg_x)
+            {
+                return false;
+            }
+            I = static_cast<unsigned short>(ram[(PC + 2) & (Quirks::MEMORY_SIZE - 1)] << 8
+                    | ram[(PC + 3) & (Quirks::MEMORY_SIZE - 1)]);
+            PC += 2;
+            return true;
+        case 0x01: // Select the display planes in the mask N
+            plane_mask = in_reg_x & ((1 << PLANES) - 1);
+            return true;
+        case 0x02: // Load the audio pattern from the 16 bytes at I
+            if (in_reg_x)
+            {
+                return false;
+            }
+            traceRead<Quirks>(I, sizeof(pattern));
+            for (unsigned char i = 0; i < sizeof(pattern); ++i)
+            {
+                unsigned char value = ram[(I + i) & (Quirks::MEMORY_SIZE - 1)];
+                memory_hash ^= zobrist(PATTERN_SLOT + i, pattern[i]) ^ zobrist(PATTERN_SLOT + i, value);
+                pattern[i] = value;
+            }
+            return true;
+        case 0x3A: // Set the pitch of the audio pattern to Vx
+            pitch = V[in_reg_x];
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Returns the number of bytes to advance PC by to skip the next instruction, which under XO-CHIP may be the
+ * four-byte long load.
+ */
+template<class Quirks>
+unsigned short Core::skip() const
+{
+    if (Quirks::XO_CHIP_OPCODES && ram[(PC + 2) & (Quirks::MEMORY_SIZE - 1)] == 0xF0
+            && ram[(PC + 3) & (Quirks::MEMORY_SIZE - 1)] == 0x00)
+    {
+        return 6;
+    }
+    return 4;
+}
+
+/**
+ * Emulates the MEGA-CHIP opcodes of the 0 group. The scrolls of SUPER-CHIP are taken over while the colour
+ * display is on. PC is advanced by the caller, except for the long load, which skips its second word itself.
+ * @return whether the current instruction is one of them
+ */
+template<class Quirks>
+bool Core::emulateMegaChip()
+{
+    unsigned char low = ram[(PC + 1) & (Quirks::MEMORY_SIZE - 1)];
+    switch (in_reg_x)
+    {
+        case 0x0:
+            switch (in_address)
+            {
+                case 0x010: // Switch the colour display off
+                    mega_mode = false;
+                    draw_display = true;
+                    return true;
+                case 0x011: // Switch the colour display on and clear it
+                    mega_mode = true;
+                    clearMegaDisplay();
+                    return true;
+                case 0x0FB: // Scroll right by 4 pixels
+                case 0x0FC: // Scroll left by 4 pixels
+                    if (!mega_mode)
+                    {
+                        return false;
+                    }
+                    scrollMega(in_address == 0x0FB ? 4 : -4, 0);
+                    return true;
+                default:
+                    if (!mega_mode || ((in_address & 0xFF0) != 0x0B0 && (in_address & 0xFF0) != 0x0C0))
+                    {
+                        return false;
+                    }
+                    // Scroll up (00BN) or down (00CN) N rows
+                    scrollMega(0, (in_address & 0xFF0) == 0x0B0 ? -in_constant_n : in_constant_n);
+                    return true;
+            }
+        case 0x1: // Set I to the 24-bit address NNNNNN, of which the address space holds the lowest 16 bits
+            I = static_cast<unsigned short>(ram[(PC + 2) & (Quirks::MEMORY_SIZE - 1)] << 8
+                    | ram[(PC + 3) & (Quirks::MEMORY_SIZE - 1)]);
+            PC += 2;
+            return true;
+        case 0x2: // Load palette entries 1 to NN from I, 4 bytes each, alpha first
+            traceRead<Quirks>(I, 4u * low);
+            for (unsigned short index = 1; index <= low; ++index)
+            {
+                std::uint32_t color = 0;
+                for (unsigned short byte = 0; byte < 4; ++byte)
+                {
+                    color = color << 8 | ram[(I + 4 * (index - 1) + byte) & (Quirks::MEMORY_SIZE - 1)];
+                }
+                memory_hash ^= zobrist(PALETTE_SLOT + index, palette[index]) ^ zobrist(PALETTE_SLOT + index, color);
+                palette[index] = color;
+            }
+            return true;
+        case 0x3: // Set the sprite width to NN
+            sprite_width = low;
+            return true;
+        case 0x4: // Set the sprite height to NN
+            sprite_height = low;
+            return true;
+        case 0x5: // Set the screen alpha to NN
+            screen_alpha = low;
+            draw_display = true;
+            return true;
+        case 0x6: // Play the digitised sound at I; sampled sound is not supported, so it stays silent
+        case 0x7: // Stop the digitised sound
+            return true;
+        case 0x8: // Set the blend mode to N
+            if (low >= static_cast<unsigned char>(BlendMode::COUNT))
+            {
+                return false;
+            }
+            blend_mode = static_cast<BlendMode>(low);
+            return true;
+        case 0x9: // Set the collision colour to palette index NN
+            collision_color = low;
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Returns the Zobrist keys of the colour display from pixel x of row y over width pixels, widened to whole slots.
+ */
+std::uint64_t Core::hashMegaSpan(unsigned char y, unsigned short x, unsigned short width) const
+{
+    if (!width)
+    {
+        return 0;
+    }
+    size_t offset = y % 16 * MEGA_WIDTH;
+    const unsigned char* indices = mega_indices.readPage(y / 16) + offset;
+    const std::uint32_t* colors = mega_colors.readPage(y / 16) + offset;
+    std::uint64_t hash = 0;
+    for (unsigned short word = x / 8; word <= (x + width - 1) / 8; ++word)
+    {
+        std::uint64_t packed;
+        std::memcpy(&packed, indices + word * 8, sizeof(packed));
+        hash ^= zobrist(MEGA_INDEX_SLOT + y * MEGA_WIDTH / 8 + word, packed);
+    }
+    for (unsigned short pair = x / 2; pair <= (x + width - 1) / 2; ++pair)
+    {
+        std::uint64_t packed = static_cast<std::uint64_t>(colors[pair * 2]) << 32 | colors[pair * 2 + 1];
+        hash ^= zobrist(MEGA_COLOR_SLOT + y * MEGA_WIDTH / 2 + pair, packed);
+    }
+    return hash;
+}
+
+/**
+ * Recomputes the hash of the colour display from scratch.
+ */
+void Core::rehashMega()
+{
+    mega_hash = 0;
+    for (unsigned char y = 0; y < MEGA_HEIGHT; ++y)
+    {
+        if (!mega_indices.isZero(y / 16) || !mega_colors.isZero(y / 16))
+        {
+            mega_hash ^= hashMegaSpan(y, 0, MEGA_WIDTH);
+        }
+    }
+}
+
+/**
+ * Draws the sprite at I at (Vx, Vy) on the colour display, clipped at its edges, and sets VF to whether it drew
+ * over a pixel of the collision colour. Every row is looked up in the palette and then blended as a whole. The
+ * fonts below the program are 1-bit sprites, 8 pixels wide and N rows high, drawn in palette entry 255.
+ */
+template<class Quirks>
+void Core::drawMegaSprite()
+{
+    bool font = I < PROGRAM_ADDRESS;
+    unsigned short width = font ? 8 : (sprite_width ? sprite_width : 256);
+    unsigned short height = font ? in_constant_n : (sprite_height ? sprite_height : 256);
+    unsigned char first_x = V[in_reg_x];
+    unsigned char first_y = V[in_reg_y];
+    auto visible = static_cast<unsigned short>(std::min<int>(width, MEGA_WIDTH - first_x));
+
+    std::uint32_t colors[MEGA_WIDTH];
+    std::uint32_t mask[MEGA_WIDTH];
+    bool collision = false;
+    for (unsigned short row = 0; row < height && first_y + row < MEGA_HEIGHT; ++row)
+    {
+        auto y = static_cast<unsigned char>(first_y + row);
+        mega_hash ^= hashMegaSpan(y, first_x, visible);
+        size_t offset = y % 16 * MEGA_WIDTH + first_x;
+        unsigned char* indices = mega_indices.writablePage(y / 16) + offset;
+        std::uint32_t* pixels = mega_colors.writablePage(y / 16) + offset;
+        unsigned int address = I + row * (font ? 1 : width);
+        traceRead<Quirks>(address, font ? 1 : visible);
+
+        for (unsigned short column = 0; column < visible; ++column)
+        {
+            unsigned char index = font ? (ram[address & (Quirks::MEMORY_SIZE - 1)] >> (7 - column) & 1) * 0xFF
+                    : ram[(address + column) & (Quirks::MEMORY_SIZE - 1)];
+            colors[column] = palette[index];
+            mask[column] = index ? 0xFFFFFFFF : 0;
+            if (index)
+            {
+                collision |= indices[column] == collision_color;
+                indices[column] = index;
+            }
+        }
+        blendRow(pixels, colors, mask, visible, blend_mode);
+        mega_hash ^= hashMegaSpan(y, first_x, visible);
+    }
+    setRegister(0xF, collision);
+    draw_display = true;
+}
+
+/**
+ * Clears the colour display.
+ */
+void Core::clearMegaDisplay()
+{
+    mega_indices.clear();
+    mega_colors.clear();
+    mega_hash = 0;
+    draw_display = true;
+}
+
+/**
+ * Scrolls the colour display right by the specified number of pixels and down by the specified number of rows,
+ * or left and up if they are negative, one row at a time.
+ */
+void Core::scrollMega(int pixels, int rows)
+{
+    pixels = std::max(-static_cast<int>(MEGA_WIDTH), std::min<int>(pixels, MEGA_WIDTH));
+    size_t kept = MEGA_WIDTH - static_cast<size_t>(std::abs(pixels));
+    size_t target = pixels > 0 ? pixels : 0;
+    size_t source_x = pixels < 0 ? -pixels : 0;
+    size_t cleared = pixels > 0 ? 0 : kept;
+    for (int step = 0; step < MEGA_HEIGHT; ++step)
+    {
+        // Rows are moved starting from the far end of the scroll, so that every source row is still unchanged
+        int y = rows > 0 ? MEGA_HEIGHT - 1 - step : step;
+        int source_y = y - rows;
+        bool outside = source_y < 0 || source_y >= MEGA_HEIGHT;
+        if (mega_indices.isZero(y / 16) && mega_colors.isZero(y / 16) && (outside
+                || (mega_indices.isZero(source_y / 16) && mega_colors.isZero(source_y / 16))))
+        {
+            // Leave blank pages on the zero page
+            continue;
+        }
+        unsigned char* indices = mega_indices.writablePage(y / 16) + y % 16 * MEGA_WIDTH;
+        std::uint32_t* colors = mega_colors.writablePage(y / 16) + y % 16 * MEGA_WIDTH;
+        if (outside)
+        {
+            std::memset(indices, 0, MEGA_WIDTH);
+            std::memset(colors, 0, MEGA_WIDTH * sizeof(*colors));
+            continue;
+        }
+        const unsigned char* source_indices = mega_indices.readPage(source_y / 16) + source_y % 16 * MEGA_WIDTH;
+        const std::uint32_t* source_colors = mega_colors.readPage(source_y / 16) + source_y % 16 * MEGA_WIDTH;
+        std::memmove(indices + target, source_indices + source_x, kept);
+        std::memmove(colors + target, source_colors + source_x, kept * sizeof(*colors));
+        std::memset(indices + cleared, 0, MEGA_WIDTH - kept);
+        std::memset(colors + cleared, 0, (MEGA_WIDTH - kept) * sizeof(*colors));
+    }
+    rehashMega();
+    draw_display = true;
+}
+
+template void Core::emulate<DefaultQuirks>();
+template void Core::emulate<VipQuirks>();
+template void Core::emulate<SuperChipQuirks>();
+template void Core::emulate<XoChipQuirks>();
+template void Core::emulate<MegaChipQuirks>();
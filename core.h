@@ -1,29 +1,73 @@
 #ifndef CHIP8_EMU_CORE_H
 #define CHIP8_EMU_CORE_H
 
+#include "blend.h"
 #include "keyboard.h"
+#include "paged_memory.h"
+#include "quirks.h"
+#include "random.h"
 #include "timer.h"
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+class Coverage;
+class Heatmap;
+class Trace;
 
 /**
  * An implementation of the CHIP-8 core.
  */
 class Core
 {
+    friend class StateCodec;
+
 public:
-    static constexpr char WIDTH = 64;
-    static constexpr char HEIGHT = 32;
-    static constexpr short RESOLUTION = WIDTH * HEIGHT;
+    static constexpr unsigned char WIDTH = 128;
+    static constexpr unsigned char HEIGHT = 64;
+    static constexpr unsigned short RESOLUTION = WIDTH * HEIGHT;
+    static constexpr unsigned short DISPLAY_WORDS = RESOLUTION / 64;
+    static constexpr unsigned char PLANES = 2;
+    static constexpr unsigned int MEMORY_SIZE = 0x10000;
+    static constexpr unsigned char STACK_DEPTH = 16;
+    static constexpr unsigned short PAGE_SIZE = 1024;
+    static constexpr unsigned short MEGA_WIDTH = 256;
+    static constexpr unsigned char MEGA_HEIGHT = 192;
+    static constexpr unsigned int MEGA_RESOLUTION = MEGA_WIDTH * MEGA_HEIGHT;
+    static constexpr unsigned short MEGA_PAGE_SIZE = 16 * MEGA_WIDTH;
+
+    /**
+     * The audio pattern that plays until a program loads its own: a 250 Hz square wave at the default pitch.
+     */
+    static constexpr unsigned char DEFAULT_PATTERN[16] =
+    {
+        0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF
+    };
+    static constexpr unsigned char DEFAULT_PITCH = 64;
+
 private:
+    static constexpr unsigned char LOW_RES_WIDTH = WIDTH / 2;
+    static constexpr unsigned char LOW_RES_HEIGHT = HEIGHT / 2;
     static constexpr unsigned short FONT_ADDRESS = 0x000;
+    static constexpr unsigned short BIG_FONT_ADDRESS = 0x050;
     static constexpr unsigned short PROGRAM_ADDRESS = 0x200;
-    static constexpr unsigned short STACK_ADDRESS = 0xEA0;
+
+    /**
+     * Where the VIP interpreter keeps its state, which machine code routines called with 0NNN expect.
+     */
+    static constexpr unsigned int MACHINE_CODE_MEMORY = 0x1000;
+    static constexpr unsigned short VIP_STACK_ADDRESS = 0x0ECF;
+    static constexpr unsigned short V_ADDRESS = 0x0EF0;
+    static constexpr unsigned short VIP_DISPLAY_ADDRESS = 0x0F00;
+    static constexpr unsigned short VIP_DISPLAY_SIZE = LOW_RES_WIDTH / 8 * LOW_RES_HEIGHT;
+    static constexpr unsigned long MAX_MACHINE_CODE_INSTRUCTIONS = 1 << 20;
 
     /**
      * The CHIP-8 font that is loaded into memory during initialization.
      * Contains sprites for the characters 0-9 and A-F.
      */
-    unsigned char font_data[80] =
+    static constexpr unsigned char FONT_DATA[80] =
     {
         0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
         0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -44,66 +88,322 @@ private:
     };
 
     /**
-     * Memory layout:
-     *  0x000-0x1FF = Reserved
-     *  0x200-0xE9F = Program
-     *  0xEA0-0xEFF = Call Stack
-     *  0xF00-0xFFF = Display Refresh
+     * The SUPER-CHIP font of 8x10 sprites for the digits 0-9, which FX30 points to.
+     */
+    static constexpr unsigned char BIG_FONT_DATA[100] =
+    {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF  // 9
+    };
+
+    /**
+     * Slots of the Zobrist hash of the machine state.
+     */
+    static constexpr std::uint64_t RAM_SLOT = 0x00000;
+    static constexpr std::uint64_t DISPLAY_SLOT = 0x10000;
+    static constexpr std::uint64_t V_SLOT = 0x20000;
+    static constexpr std::uint64_t PC_SLOT = 0x20010;
+    static constexpr std::uint64_t I_SLOT = 0x20011;
+    static constexpr std::uint64_t SP_SLOT = 0x20012;
+    static constexpr std::uint64_t DELAY_TIMER_SLOT = 0x20013;
+    static constexpr std::uint64_t SOUND_TIMER_SLOT = 0x20014;
+    static constexpr std::uint64_t RANDOM_SEED_SLOT = 0x20015;
+    static constexpr std::uint64_t RANDOM_COUNTER_SLOT = 0x20016;
+    static constexpr std::uint64_t HIGH_RES_SLOT = 0x20017;
+    static constexpr std::uint64_t PLANE_MASK_SLOT = 0x20018;
+    static constexpr std::uint64_t PITCH_SLOT = 0x20019;
+    static constexpr std::uint64_t FLAG_SLOT = 0x20020;
+    static constexpr std::uint64_t STACK_SLOT = 0x20030;
+    static constexpr std::uint64_t PATTERN_SLOT = 0x20040;
+    static constexpr std::uint64_t MEGA_MODE_SLOT = 0x20050;
+    static constexpr std::uint64_t SPRITE_WIDTH_SLOT = 0x20051;
+    static constexpr std::uint64_t SPRITE_HEIGHT_SLOT = 0x20052;
+    static constexpr std::uint64_t BLEND_MODE_SLOT = 0x20053;
+    static constexpr std::uint64_t COLLISION_COLOR_SLOT = 0x20054;
+    static constexpr std::uint64_t SCREEN_ALPHA_SLOT = 0x20055;
+    static constexpr std::uint64_t PALETTE_SLOT = 0x20100;
+    static constexpr std::uint64_t MEGA_INDEX_SLOT = 0x30000;
+    static constexpr std::uint64_t MEGA_COLOR_SLOT = 0x40000;
+
+    /*
+     * Everything from V up to and including random is touched by (almost) every instruction and fills exactly
+     * one cache line, so that interleaving many cores costs one line of hot state per core.
      */
-    unsigned char ram[4096];
 
     /**
      * Registers:
      * - 16 general purpose registers, V0 to VF
-     * - Stack pointer SP (24 levels)
      * - Address register I
      * - Program counter PC
+     * - Stack pointer SP (16 levels)
      */
-    unsigned char V[16];
-    unsigned char SP;
+    alignas(64) unsigned char V[16];
     unsigned short I;
     unsigned short PC;
+    unsigned char SP;
 
     /**
-     * Monochrome Display:
-     * - Resolution = 64 x 32
+     * Hold instruction data during execution:
      */
-    unsigned char display[RESOLUTION];
+    unsigned char in_reg_x;
+    unsigned char in_reg_y;
+    unsigned char in_constant_n;
+    unsigned short in_address;
 
     /**
      * 2 Timers:
      * - Delay timer
      * - Sound timer
      */
-    Timer& delay_timer;
-    Timer& sound_timer;
+    Timer delay_timer{};
+    Timer sound_timer{};
 
     /**
      * Input:
      * - 16 keys
      * - Set to 1 when pressed, 0 otherwise
      */
-    Keyboard& keyboard;
+    Keyboard keyboard{};
 
     /**
-     * Hold instruction data during execution:
+     * Zobrist hashes of ram and V, and of the display, updated in O(1) on every write.
      */
-    unsigned short in_address;
-    unsigned char in_constant_n;
-    unsigned char in_reg_x;
-    unsigned char in_reg_y;
+    std::uint64_t memory_hash = 0;
+    std::uint64_t display_hash = 0;
+
+    /**
+     * Random number generator used by CXNN, private to this core so that runs are reproducible.
+     */
+    Random random;
+
+    /**
+     * The interpreter of the selected quirk profile. It is read on every cycle and shares its cache line with the
+     * first pages of the ram page table.
+     */
+    void (Core::*cycle)() = &Core::emulate<DefaultQuirks>;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+
+    /**
+     * The coverage that executed addresses, and if it tracks them memory accesses, are marked in. It is checked
+     * on every cycle as well. A core forked into keeps the coverage it had, and a new fork starts without one, so
+     * that every core marks only its own.
+     */
+    Coverage* coverage = nullptr;
+
+    /**
+     * The heatmap that every fetch, memory access and call is counted in, checked on every cycle like coverage.
+     */
+    Heatmap* heatmap = nullptr;
+
+    /**
+     * The instruction trace that every cycle is recorded in. Tracing runs a wrapper of the interpreter, so that
+     * cores without a trace do not check for it. A copy shares the trace of the original, which only one thread may
+     * record in; forks keep the trace they had.
+     */
+    Trace* trace = nullptr;
 
 public:
-    Core(Keyboard& keyboard, Timer& delay_timer, Timer& sound_timer);
-    void initialize();
+    /**
+     * Counts of the ways in which a program misbehaved since the last initialization.
+     */
+    struct Faults
+    {
+        unsigned int invalid_opcodes = 0;
+        unsigned int stack_overflows = 0;
+        unsigned int stack_underflows = 0;
+    };
+
+private:
+    Faults faults;
+
+    /**
+     * Memory layout:
+     *  0x0000-0x004F = Font
+     *  0x0050-0x00B3 = Big font
+     *  0x0200-0x0FFF = Program (up to 0xFFFF for XO-CHIP)
+     *
+     * Programs address 4 KB, or 64 KB under XO-CHIP; memory beyond 4 KB stays on the shared zero page otherwise.
+     * Pages are shared copy-on-write with forked cores.
+     */
+    PagedMemory<unsigned char, PAGE_SIZE, MEMORY_SIZE / PAGE_SIZE> ram;
+
+    /**
+     * The call stack, holding the return addresses of up to 16 nested subroutines.
+     */
+    unsigned short stack[STACK_DEPTH] = {};
+
+    /**
+     * Display:
+     * - Resolution = 128 x 64, with two bitplanes of one bit per pixel, one page each
+     * - Every row is two 64-bit words; the most significant bit of the first word is the leftmost pixel
+     * - In low resolution mode (64 x 32) every pixel covers 2 x 2 pixels, so scrolling is the same in both modes
+     * - Drawing, clearing and scrolling affect the planes selected in plane_mask, each plane word by word
+     */
+    PagedMemory<std::uint64_t, DISPLAY_WORDS, PLANES> display;
+    bool high_res = false;
+    unsigned char plane_mask = 1;
+
+    /**
+     * The SUPER-CHIP flag registers, which FX75 and FX85 save V0 to Vx into and restore them from.
+     */
+    unsigned char flags[16] = {};
+
+    /**
+     * XO-CHIP audio: a 128-bit pattern that is played back while the sound timer runs, at a rate set by pitch.
+     */
+    unsigned char pattern[16] = {};
+    unsigned char pitch = DEFAULT_PITCH;
+
+    /**
+     * MEGA-CHIP display, shown instead of the bitplanes while mega_mode is on:
+     * - Resolution = 256 x 192, 16 rows per page; the pages below row 192 are never written
+     * - mega_indices holds the palette index last drawn at every pixel, which collisions are tested against
+     * - mega_colors holds the blended colour of every pixel as 0xAARRGGBB
+     * - Palette index 0 is transparent; 02NN loads entries 1 to NN
+     * - Sprites are sprite_width x sprite_height bytes of palette indices, 0 meaning 256
+     * - mega_hash covers both buffers: 8 indices or 2 colours per slot
+     */
+    bool mega_mode = false;
+    PagedMemory<unsigned char, MEGA_PAGE_SIZE, 16> mega_indices;
+    PagedMemory<std::uint32_t, MEGA_PAGE_SIZE, 16> mega_colors;
+    std::uint32_t palette[256] = {};
+    unsigned char sprite_width = 0;
+    unsigned char sprite_height = 0;
+    BlendMode blend_mode = BlendMode::NORMAL;
+    unsigned char collision_color = 0;
+    unsigned char screen_alpha = 0xFF;
+    std::uint64_t mega_hash = 0;
+
+    struct BootImage;
+    static const BootImage& bootImage();
+    static std::uint64_t zobrist(std::uint64_t slot, std::uint64_t value);
+    static std::uint64_t hashRamSpan(size_t address, const unsigned char* data, size_t size);
+    std::uint64_t hashDisplayWord(unsigned char plane, unsigned short word) const;
+    void rehash();
+    void rehashDisplay();
+    template<bool WRAP> bool drawRow(unsigned char plane, unsigned char y, unsigned char x, std::uint32_t bits,
+            unsigned char width);
+    template<class Quirks> void drawSprite(unsigned char width, unsigned char height);
+    void clearDisplay();
+    void scrollVertically(int rows);
+    void scrollHorizontally(int pixels);
+    template<class Quirks> unsigned short skip() const;
+    void setRegister(unsigned char x, unsigned char value);
+    void writeMemory(unsigned short address, unsigned char value);
+    template<class Quirks> void traceRead(unsigned int address, unsigned int size);
+    void reportFault(unsigned int& counter, const char* description);
+    template<class Quirks> bool emulateSuperChip();
+    template<class Quirks> bool emulateXoChip();
+    std::uint64_t hashMegaSpan(unsigned char y, unsigned short x, unsigned short width) const;
+    void rehashMega();
+    template<class Quirks> void drawMegaSprite();
+    void clearMegaDisplay();
+    void scrollMega(int pixels, int rows);
+    template<class Quirks> bool emulateMegaChip();
+    struct MachineCodeBus;
+    void callMachineCode();
+    template<class Quirks> void emulate();
+    template<class Quirks> void emulateTraced();
+    template<class Quirks> void selectInterpreter();
+
+public:
+    /**
+     * The colour display and palette of MEGA-CHIP. Snapshots hold them in a separate block, shared between copies
+     * and left out while they are blank, so that snapshots of every other program stay small.
+     */
+    struct MegaChipState
+    {
+        unsigned char indices[MEGA_RESOLUTION];
+        std::uint32_t colors[MEGA_RESOLUTION];
+        std::uint32_t palette[256];
+    };
+
+    /**
+     * A snapshot of the complete machine state, used for save states and recordings.
+     */
+    struct State
+    {
+        unsigned char ram[MEMORY_SIZE];
+        std::uint64_t display[PLANES][DISPLAY_WORDS];
+        bool high_res;
+        unsigned char plane_mask;
+        unsigned char flags[16];
+        unsigned short stack[STACK_DEPTH];
+        unsigned char pattern[16];
+        unsigned char pitch;
+        bool mega_mode;
+        std::shared_ptr<const MegaChipState> mega;
+        unsigned char sprite_width;
+        unsigned char sprite_height;
+        BlendMode blend_mode;
+        unsigned char collision_color;
+        unsigned char screen_alpha;
+        unsigned char V[16];
+        unsigned short I;
+        unsigned short PC;
+        unsigned char SP;
+        unsigned char delay_timer;
+        unsigned char sound_timer;
+        std::uint64_t random_seed;
+        std::uint64_t random_counter;
+    };
+
+    static std::vector<unsigned char> readProgram(const std::string& program_name);
+
+    void initialize(std::uint64_t seed = 0);
     void loadProgram(const std::string& program_name);
-    void emulateCycle();
-    unsigned char* getPixels();
+    void loadProgram(const unsigned char* program, size_t size);
+    void setQuirks(QuirkProfile profile);
+    QuirkProfile getQuirks() const;
+    void setCoverage(Coverage* coverage);
+    void setHeatmap(Heatmap* heatmap);
+    void setTrace(Trace* trace);
+    const Faults& getFaults() const;
+
+    /**
+     * Emulates one cycle with the interpreter of the selected quirk profile.
+     */
+    void emulateCycle()
+    {
+        (this->*cycle)();
+    }
+
+    void getPixels(unsigned char* pixels) const;
+    bool isMegaMode() const;
+    void getColorPixels(std::uint32_t* pixels) const;
+    unsigned char getMemory(unsigned short address) const;
+    unsigned char getRegister(unsigned char x) const;
+    unsigned short getPC() const;
+    unsigned char getCallStack(unsigned short* call_addresses) const;
+    Keyboard& getKeyboard();
+    Timer& getDelayTimer();
+    Timer& getSoundTimer();
+    const unsigned char* getAudioPattern() const;
+    unsigned char getPitch() const;
+    void tickTimers();
+    void saveState(State& state) const;
+    void loadState(const State& state);
+    std::uint64_t hashState() const;
+    void fork(Core& child) const;
+    Core fork() const;
 
     /**
      * Flag that indicates whether the screen needs to be redrawn.
      */
-    bool draw_display;
+    bool draw_display = false;
+
+    /**
+     * Flag that enables printing invalid opcodes and stack faults as they occur.
+     */
+    bool log_faults = false;
 };
 
 #endif //CHIP8_EMU_CORE_H
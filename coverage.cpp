@@ -0,0 +1,229 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include "coverage.h"
+#include "disassembler.h"
+
+namespace
+{
+    const unsigned char MAGIC[4] = {'C', '8', 'C', 'V'};
+
+    /**
+     * Writes a bitmap as little-endian words, so that files are portable between hosts.
+     */
+    void writeBitmap(std::FILE* file, const std::uint64_t* bitmap)
+    {
+        unsigned char bytes[Coverage::WORDS * 8];
+        for (size_t word = 0; word < Coverage::WORDS; ++word)
+        {
+            for (unsigned int byte = 0; byte < 8; ++byte)
+            {
+                bytes[word * 8 + byte] = static_cast<unsigned char>(bitmap[word] >> (byte * 8));
+            }
+        }
+        if (std::fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes))
+        {
+            errno = EIO;
+            throw(errno);
+        }
+    }
+
+    void readBitmap(std::FILE* file, std::uint64_t* bitmap)
+    {
+        unsigned char bytes[Coverage::WORDS * 8];
+        if (std::fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes))
+        {
+            errno = EINVAL;
+            throw(errno);
+        }
+        for (size_t word = 0; word < Coverage::WORDS; ++word)
+        {
+            bitmap[word] = 0;
+            for (unsigned int byte = 0; byte < 8; ++byte)
+            {
+                bitmap[word] |= std::uint64_t{bytes[word * 8 + byte]} << (byte * 8);
+            }
+        }
+    }
+}
+
+/**
+ * Returns the number of addresses marked in a bitmap.
+ */
+size_t Coverage::count(const std::uint64_t* bitmap)
+{
+    size_t marked = 0;
+    for (size_t word = 0; word < WORDS; ++word)
+    {
+        marked += static_cast<size_t>(__builtin_popcountll(bitmap[word]));
+    }
+    return marked;
+}
+
+/**
+ * Unmarks every address.
+ */
+void Coverage::clear()
+{
+    std::memset(executed, 0, sizeof(executed));
+    std::memset(read, 0, sizeof(read));
+    std::memset(written, 0, sizeof(written));
+}
+
+/**
+ * Adds the addresses marked in another coverage to this one.
+ * @param other - the coverage of another run
+ * @return the number of executed addresses that were new to this coverage
+ */
+size_t Coverage::merge(const Coverage& other)
+{
+    size_t new_addresses = 0;
+    for (size_t word = 0; word < WORDS; ++word)
+    {
+        new_addresses += static_cast<size_t>(__builtin_popcountll(other.executed[word] & ~executed[word]));
+        executed[word] |= other.executed[word];
+        read[word] |= other.read[word];
+        written[word] |= other.written[word];
+    }
+    return new_addresses;
+}
+
+/**
+ * Loads the bitmaps from the specified file, replacing the contents of this coverage.
+ * @param file_name - the name of a file written by save()
+ */
+void Coverage::load(const std::string& file_name)
+{
+    FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+        throw(errno);
+    }
+
+    try
+    {
+        unsigned char magic[sizeof(MAGIC)];
+        if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) || std::memcmp(magic, MAGIC, sizeof(MAGIC)))
+        {
+            errno = EINVAL;
+            throw(errno);
+        }
+        readBitmap(file, executed);
+        readBitmap(file, read);
+        readBitmap(file, written);
+    }
+    catch (int)
+    {
+        std::cerr << "ERROR: File " << file_name << " is not a coverage file." << std::endl;
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+}
+
+/**
+ * Saves the bitmaps to the specified file: a magic number followed by the executed, read and written bitmaps.
+ * @param file_name - the name of the file to write
+ */
+void Coverage::save(const std::string& file_name) const
+{
+    FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+
+    try
+    {
+        if (std::fwrite(MAGIC, 1, sizeof(MAGIC), file) != sizeof(MAGIC))
+        {
+            errno = EIO;
+            throw(errno);
+        }
+        writeBitmap(file, executed);
+        writeBitmap(file, read);
+        writeBitmap(file, written);
+    }
+    catch (int)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+}
+
+/**
+ * Writes a coverage report of an address range: a summary, then a line per instruction or unexecuted word with
+ * its disassembly. The first column marks executed instructions with X, and words read or written as data with
+ * r and w.
+ * @param file - the file to write the report to
+ * @param core - the core whose memory is disassembled, in the quirk profile it runs
+ * @param start - the first address of the range, usually where the program is loaded
+ * @param end - the address after the range
+ */
+void Coverage::writeReport(std::FILE* file, const Core& core, unsigned int start, unsigned int end) const
+{
+    size_t executed_in_range = 0;
+    size_t read_in_range = 0;
+    size_t written_in_range = 0;
+    for (unsigned int address = start; address < end; ++address)
+    {
+        executed_in_range += isMarked(executed, address);
+        read_in_range += isMarked(read, address);
+        written_in_range += isMarked(written, address);
+    }
+    std::fprintf(file, "Coverage of 0x%04X-0x%04X: %zu instructions executed", start, end - 1, executed_in_range);
+    if (track_accesses)
+    {
+        std::fprintf(file, ", %zu bytes read, %zu bytes written", read_in_range, written_in_range);
+    }
+    std::fprintf(file, "\n");
+
+    char text[32];
+    for (unsigned int address = start; address < end;)
+    {
+        auto opcode = static_cast<unsigned short>(core.getMemory(static_cast<unsigned short>(address)) << 8
+                | core.getMemory(static_cast<unsigned short>(address + 1)));
+        auto next = static_cast<unsigned short>(core.getMemory(static_cast<unsigned short>(address + 2)) << 8
+                | core.getMemory(static_cast<unsigned short>(address + 3)));
+        bool is_executed = isMarked(executed, address);
+        bool is_read = isMarked(read, address) || isMarked(read, address + 1);
+        bool is_written = isMarked(written, address) || isMarked(written, address + 1);
+
+        // Code that is only reached at an odd address, as after data of odd length, is shown from there
+        unsigned int length = 2;
+        if (is_executed)
+        {
+            length = disassemble(core.getQuirks(), opcode, next, text, sizeof(text));
+        }
+        else if (isMarked(executed, address + 1))
+        {
+            length = 1;
+            std::snprintf(text, sizeof(text), "DB 0x%02X", opcode >> 8);
+        }
+        else
+        {
+            std::snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+        }
+
+        char bytes[16];
+        if (length == 1)
+        {
+            std::snprintf(bytes, sizeof(bytes), "%02X", opcode >> 8);
+        }
+        else if (length == 2)
+        {
+            std::snprintf(bytes, sizeof(bytes), "%04X", opcode);
+        }
+        else
+        {
+            std::snprintf(bytes, sizeof(bytes), "%04X %04X", opcode, next);
+        }
+        std::fprintf(file, "%c%c%c 0x%04X  %-9s  %s\n", is_executed ? 'X' : ' ', is_read ? 'r' : ' ',
+                is_written ? 'w' : ' ', address, bytes, text);
+        address += length;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_EMU_COVERAGE_H
+#define CHIP8_EMU_COVERAGE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "core.h"
+
+/**
+ * Bitmaps of the addresses a program executed and, if track_accesses is set, read and wrote as data, with a bit
+ * per byte of the address space. A core attached with Core::setCoverage() ORs a bit into executed for every
+ * instruction it fetches, so coverage can stay on in every run. Bitmaps of many runs are merged to see whether a
+ * run reached code no earlier one did.
+ */
+class Coverage
+{
+public:
+    static constexpr size_t WORDS = Core::MEMORY_SIZE / 64;
+
+    std::uint64_t executed[WORDS] = {};
+    std::uint64_t read[WORDS] = {};
+    std::uint64_t written[WORDS] = {};
+    bool track_accesses = false;
+
+    static void mark(std::uint64_t* bitmap, unsigned int address)
+    {
+        bitmap[address / 64 % WORDS] |= std::uint64_t{1} << (address % 64);
+    }
+
+    static bool isMarked(const std::uint64_t* bitmap, unsigned int address)
+    {
+        return bitmap[address / 64 % WORDS] >> (address % 64) & 1;
+    }
+
+    static size_t count(const std::uint64_t* bitmap);
+
+    void clear();
+    size_t merge(const Coverage& other);
+    void load(const std::string& file_name);
+    void save(const std::string& file_name) const;
+    void writeReport(std::FILE* file, const Core& core, unsigned int start, unsigned int end) const;
+};
+
+#endif //CHIP8_EMU_COVERAGE_H
@@ -0,0 +1,221 @@
+#include <cstdio>
+#include "disassembler.h"
+
+/**
+ * Writes the mnemonic of an instruction, in the syntax of Cowgod's reference extended with the SUPER-CHIP,
+ * XO-CHIP and MEGA-CHIP instructions of the profile. Opcodes the profile does not implement are written as data.
+ * @param profile - the quirk profile that decides which extensions are instructions
+ * @param opcode - the first word of the instruction
+ * @param next - the word after it, which F000 NNNN and 01NN NNNN take as an operand
+ * @param text - receives the mnemonic
+ * @param size - the size of text
+ * @return the length of the instruction in bytes, 2 or 4
+ */
+unsigned int disassemble(QuirkProfile profile, unsigned short opcode, unsigned short next, char* text, size_t size)
+{
+    bool super_chip = profile == QuirkProfile::SUPER_CHIP || profile == QuirkProfile::XO_CHIP
+            || profile == QuirkProfile::MEGA_CHIP;
+    bool xo_chip = profile == QuirkProfile::XO_CHIP;
+    bool mega_chip = profile == QuirkProfile::MEGA_CHIP;
+    unsigned int x = opcode >> 8 & 0x0F;
+    unsigned int y = opcode >> 4 & 0x0F;
+    unsigned int n = opcode & 0x0F;
+    unsigned int nn = opcode & 0xFF;
+    unsigned int nnn = opcode & 0xFFF;
+
+    switch (opcode >> 12)
+    {
+        case 0x0:
+            if (opcode == 0x00E0)
+            {
+                std::snprintf(text, size, "CLS");
+            }
+            else if (opcode == 0x00EE)
+            {
+                std::snprintf(text, size, "RET");
+            }
+            else if (super_chip && (opcode & 0xFFF0) == 0x00C0)
+            {
+                std::snprintf(text, size, "SCD %u", n);
+            }
+            else if (xo_chip && (opcode & 0xFFF0) == 0x00D0)
+            {
+                std::snprintf(text, size, "SCU %u", n);
+            }
+            else if (mega_chip && (opcode & 0xFFF0) == 0x00B0)
+            {
+                std::snprintf(text, size, "SCU %u", n);
+            }
+            else if (super_chip && opcode >= 0x00FB && opcode <= 0x00FF)
+            {
+                const char* const MNEMONICS[] = {"SCR", "SCL", "EXIT", "LOW", "HIGH"};
+                std::snprintf(text, size, "%s", MNEMONICS[opcode - 0x00FB]);
+            }
+            else if (mega_chip && (opcode == 0x0010 || opcode == 0x0011))
+            {
+                std::snprintf(text, size, "%s", opcode == 0x0010 ? "MEGAOFF" : "MEGAON");
+            }
+            else if (mega_chip && x == 0x1)
+            {
+                std::snprintf(text, size, "LDHI I, 0x%02X%04X", nn, next);
+                return 4;
+            }
+            else if (mega_chip && x >= 0x2 && x <= 0x9)
+            {
+                const char* const MNEMONICS[] = {"LDPAL", "SPRW", "SPRH", "ALPHA", "DIGISND", "STOPSND", "BMODE",
+                        "CCOL"};
+                std::snprintf(text, size, "%s 0x%02X", MNEMONICS[x - 2], nn);
+            }
+            else
+            {
+                std::snprintf(text, size, "SYS 0x%03X", nnn);
+            }
+            return 2;
+        case 0x1:
+            std::snprintf(text, size, "JP 0x%03X", nnn);
+            return 2;
+        case 0x2:
+            std::snprintf(text, size, "CALL 0x%03X", nnn);
+            return 2;
+        case 0x3:
+            std::snprintf(text, size, "SE V%X, 0x%02X", x, nn);
+            return 2;
+        case 0x4:
+            std::snprintf(text, size, "SNE V%X, 0x%02X", x, nn);
+            return 2;
+        case 0x5:
+            if (n == 0)
+            {
+                std::snprintf(text, size, "SE V%X, V%X", x, y);
+                return 2;
+            }
+            if (xo_chip && (n == 2 || n == 3))
+            {
+                std::snprintf(text, size, n == 2 ? "SAVE V%X-V%X" : "LOAD V%X-V%X", x, y);
+                return 2;
+            }
+            break;
+        case 0x6:
+            std::snprintf(text, size, "LD V%X, 0x%02X", x, nn);
+            return 2;
+        case 0x7:
+            std::snprintf(text, size, "ADD V%X, 0x%02X", x, nn);
+            return 2;
+        case 0x8:
+            {
+                const char* const MNEMONICS[16] = {"LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr};
+                if (MNEMONICS[n])
+                {
+                    std::snprintf(text, size, "%s V%X, V%X", MNEMONICS[n], x, y);
+                    return 2;
+                }
+            }
+            break;
+        case 0x9:
+            if (n == 0)
+            {
+                std::snprintf(text, size, "SNE V%X, V%X", x, y);
+                return 2;
+            }
+            break;
+        case 0xA:
+            std::snprintf(text, size, "LD I, 0x%03X", nnn);
+            return 2;
+        case 0xB:
+            std::snprintf(text, size, "JP V0, 0x%03X", nnn);
+            return 2;
+        case 0xC:
+            std::snprintf(text, size, "RND V%X, 0x%02X", x, nn);
+            return 2;
+        case 0xD:
+            std::snprintf(text, size, "DRW V%X, V%X, %u", x, y, n);
+            return 2;
+        case 0xE:
+            if (nn == 0x9E || nn == 0xA1)
+            {
+                std::snprintf(text, size, nn == 0x9E ? "SKP V%X" : "SKNP V%X", x);
+                return 2;
+            }
+            break;
+        default:
+            switch (nn)
+            {
+                case 0x00:
+                    if (xo_chip && x == 0)
+                    {
+                        std::snprintf(text, size, "LD I, 0x%04X", next);
+                        return 4;
+                    }
+                    break;
+                case 0x01:
+                    if (xo_chip)
+                    {
+                        std::snprintf(text, size, "PLANE %u", x);
+                        return 2;
+                    }
+                    break;
+                case 0x02:
+                    if (xo_chip && x == 0)
+                    {
+                        std::snprintf(text, size, "AUDIO");
+                        return 2;
+                    }
+                    break;
+                case 0x07:
+                    std::snprintf(text, size, "LD V%X, DT", x);
+                    return 2;
+                case 0x0A:
+                    std::snprintf(text, size, "LD V%X, K", x);
+                    return 2;
+                case 0x15:
+                    std::snprintf(text, size, "LD DT, V%X", x);
+                    return 2;
+                case 0x18:
+                    std::snprintf(text, size, "LD ST, V%X", x);
+                    return 2;
+                case 0x1E:
+                    std::snprintf(text, size, "ADD I, V%X", x);
+                    return 2;
+                case 0x29:
+                    std::snprintf(text, size, "LD F, V%X", x);
+                    return 2;
+                case 0x30:
+                    if (super_chip)
+                    {
+                        std::snprintf(text, size, "LD HF, V%X", x);
+                        return 2;
+                    }
+                    break;
+                case 0x33:
+                    std::snprintf(text, size, "LD B, V%X", x);
+                    return 2;
+                case 0x3A:
+                    if (xo_chip)
+                    {
+                        std::snprintf(text, size, "PITCH V%X", x);
+                        return 2;
+                    }
+                    break;
+                case 0x55:
+                    std::snprintf(text, size, "LD [I], V%X", x);
+                    return 2;
+                case 0x65:
+                    std::snprintf(text, size, "LD V%X, [I]", x);
+                    return 2;
+                case 0x75:
+                case 0x85:
+                    if (super_chip)
+                    {
+                        std::snprintf(text, size, nn == 0x75 ? "LD R, V%X" : "LD V%X, R", x);
+                        return 2;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+    }
+    std::snprintf(text, size, "DW 0x%04X", opcode);
+    return 2;
+}
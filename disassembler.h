@@ -0,0 +1,9 @@
+#ifndef CHIP8_EMU_DISASSEMBLER_H
+#define CHIP8_EMU_DISASSEMBLER_H
+
+#include <cstddef>
+#include "quirks.h"
+
+unsigned int disassemble(QuirkProfile profile, unsigned short opcode, unsigned short next, char* text, size_t size);
+
+#endif //CHIP8_EMU_DISASSEMBLER_H
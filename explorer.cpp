@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <cerrno>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include "explorer.h"
+#include "state_codec.h"
+#include "state_set.h"
+#include "thread_pool.h"
+
+namespace
+{
+    constexpr std::uint64_t ROOT = ~std::uint64_t{0};
+    constexpr size_t BATCH_SIZE = 64;
+
+    FILE* openTemporary(const std::string& file_name)
+    {
+        FILE* file = std::fopen(file_name.c_str(), "w+b");
+        if (!file)
+        {
+            std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+            throw(errno);
+        }
+        return file;
+    }
+
+    /**
+     * An append-only log of every explored state's parent and input, kept on disk.
+     * Input paths are reconstructed by following parents back to the root.
+     */
+    class NodeLog
+    {
+        struct Node
+        {
+            std::uint64_t parent;
+            unsigned char input;
+        };
+
+        std::string file_name;
+        FILE* file;
+        std::vector<Node> buffer;
+        std::uint64_t size = 0;
+
+        void flush()
+        {
+            std::fseek(file, 0, SEEK_END);
+            if (std::fwrite(buffer.data(), sizeof(Node), buffer.size(), file) != buffer.size())
+            {
+                std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+                throw(errno);
+            }
+            buffer.clear();
+        }
+
+    public:
+        explicit NodeLog(const std::string& file_name) : file_name(file_name), file(openTemporary(file_name)) {}
+
+        ~NodeLog()
+        {
+            std::fclose(file);
+            std::remove(file_name.c_str());
+        }
+
+        std::uint64_t append(std::uint64_t parent, unsigned char input)
+        {
+            buffer.push_back({parent, input});
+            if (buffer.size() == 4096)
+            {
+                flush();
+            }
+            return size++;
+        }
+
+        std::vector<unsigned char> path(std::uint64_t node)
+        {
+            flush();
+            std::vector<unsigned char> inputs;
+            Node current{};
+            for (; node != ROOT; node = current.parent)
+            {
+                std::fseek(file, static_cast<long>(node * sizeof(Node)), SEEK_SET);
+                if (std::fread(&current, sizeof(Node), 1, file) != 1)
+                {
+                    errno = EIO;
+                    throw(errno);
+                }
+                if (current.parent != ROOT)
+                {
+                    inputs.push_back(current.input);
+                }
+            }
+            return std::vector<unsigned char>(inputs.rbegin(), inputs.rend());
+        }
+    };
+
+    /**
+     * A state waiting to be expanded, packed by a StateCodec against the root state.
+     */
+    struct Entry
+    {
+        std::uint64_t node;
+        std::vector<unsigned char> state;
+    };
+
+    /**
+     * A FIFO of packed states that keeps up to a fixed number of bytes in memory and spills the rest to disk, every
+     * entry as its node, the size of its state and the state.
+     */
+    class StateQueue
+    {
+        std::deque<Entry> entries;
+        size_t memory_limit;
+        size_t memory_used = 0;
+        std::string file_name;
+        FILE* file;
+        size_t spilled = 0;
+        size_t spilled_read = 0;
+        long read_offset = 0;
+
+        static size_t footprint(const Entry& entry)
+        {
+            return sizeof(Entry) + entry.state.size();
+        }
+
+    public:
+        StateQueue(size_t memory_limit, const std::string& file_name) : memory_limit(memory_limit),
+                file_name(file_name), file(openTemporary(file_name)) {}
+
+        ~StateQueue()
+        {
+            std::fclose(file);
+            std::remove(file_name.c_str());
+        }
+
+        size_t getSize() const
+        {
+            return entries.size() + spilled - spilled_read;
+        }
+
+        void push(const Entry& entry)
+        {
+            if (memory_used + footprint(entry) <= memory_limit)
+            {
+                entries.push_back(entry);
+                memory_used += footprint(entry);
+                return;
+            }
+            std::fseek(file, 0, SEEK_END);
+            auto size = static_cast<std::uint32_t>(entry.state.size());
+            if (std::fwrite(&entry.node, sizeof(entry.node), 1, file) != 1
+                    || std::fwrite(&size, sizeof(size), 1, file) != 1
+                    || std::fwrite(entry.state.data(), 1, size, file) != size)
+            {
+                std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+                throw(errno);
+            }
+            ++spilled;
+        }
+
+        size_t pop(Entry* output, size_t count)
+        {
+            size_t popped = 0;
+            for (; popped < count && !entries.empty(); ++popped)
+            {
+                memory_used -= footprint(entries.front());
+                output[popped] = std::move(entries.front());
+                entries.pop_front();
+            }
+            if (popped < count && spilled_read < spilled)
+            {
+                std::fseek(file, read_offset, SEEK_SET);
+            }
+            for (; popped < count && spilled_read < spilled; ++popped, ++spilled_read)
+            {
+                Entry& entry = output[popped];
+                std::uint32_t size = 0;
+                if (std::fread(&entry.node, sizeof(entry.node), 1, file) != 1
+                        || std::fread(&size, sizeof(size), 1, file) != 1)
+                {
+                    std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+                    errno = EIO;
+                    throw(errno);
+                }
+                entry.state.resize(size);
+                if (std::fread(entry.state.data(), 1, size, file) != size)
+                {
+                    std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+                    errno = EIO;
+                    throw(errno);
+                }
+                read_offset += static_cast<long>(sizeof(entry.node) + sizeof(size) + size);
+            }
+            if (getSize() == 0 && spilled)
+            {
+                std::fclose(file);
+                file = openTemporary(file_name);
+                spilled = spilled_read = 0;
+                read_offset = 0;
+            }
+            return popped;
+        }
+    };
+
+    struct Child
+    {
+        bool is_new;
+        std::uint64_t matched_targets;
+        Entry entry;
+    };
+}
+
+/**
+ * Determines whether the specified core satisfies this condition.
+ */
+bool ExploreTarget::matches(const Core& core) const
+{
+    switch (kind)
+    {
+        case MEMORY:
+            return core.getMemory(index) == value;
+        case REGISTER:
+            return core.getRegister(static_cast<unsigned char>(index)) == value;
+        case PROGRAM_COUNTER:
+            return core.getPC() == value;
+    }
+    return false;
+}
+
+/**
+ * Explores the states reachable from the specified root, level by level, until no new states are found or
+ * max_depth frames have been explored. Every target that is reached receives a shortest input path.
+ * @param root - the state to start from
+ * @param targets - up to 64 conditions to search for
+ * @return the number of new states found at every depth, starting with the root at depth 0
+ */
+std::vector<size_t> Explorer::explore(const Machine& root, std::vector<ExploreTarget>& targets)
+{
+    size_t queue_limit = memory_budget / 4;
+    StateSet visited(memory_budget / 2, spill_prefix);
+    NodeLog nodes(spill_prefix + "nodes.tmp");
+    auto current = std::make_unique<StateQueue>(queue_limit, spill_prefix + "frontier0.tmp");
+    auto next = std::make_unique<StateQueue>(queue_limit, spill_prefix + "frontier1.tmp");
+    ThreadPool pool(thread_count);
+    StateCodec codec(root.core);
+
+    std::vector<Entry> parents(BATCH_SIZE);
+    std::vector<Child> children(BATCH_SIZE * INPUT_COUNT);
+    size_t targets_left = targets.size();
+
+    auto expand = [this, &root, &codec, &parents, &children, &visited, &targets](size_t i)
+    {
+        Machine parent{};
+        parent.core.setQuirks(root.core.getQuirks());
+        codec.decode(parents[i].state.data(), parent.core);
+        for (unsigned char input = 0; input < INPUT_COUNT; ++input)
+        {
+            Machine machine{parent};
+            machine.runFrame(input == NO_KEY ? 0 : static_cast<unsigned short>(1 << input), cycles_per_frame);
+
+            Child& child = children[i * INPUT_COUNT + input];
+            child.is_new = visited.insert(machine.core.hashState());
+            if (!child.is_new)
+            {
+                continue;
+            }
+            child.matched_targets = 0;
+            for (size_t target = 0; target < targets.size(); ++target)
+            {
+                if (!targets[target].found && targets[target].matches(machine.core))
+                {
+                    child.matched_targets |= std::uint64_t{1} << target;
+                }
+            }
+            child.entry.state.clear();
+            codec.encode(machine.core, child.entry.state);
+        }
+    };
+
+    auto markFound = [&targets, &targets_left, &nodes](std::uint64_t node, std::uint64_t matched_targets)
+    {
+        for (size_t target = 0; target < targets.size(); ++target)
+        {
+            if (matched_targets >> target & 1 && !targets[target].found)
+            {
+                targets[target].found = true;
+                targets[target].path = nodes.path(node);
+                --targets_left;
+            }
+        }
+    };
+
+    Entry& first = parents[0];
+    first.node = nodes.append(ROOT, NO_KEY);
+    first.state.clear();
+    codec.encode(root.core, first.state);
+    visited.insert(root.core.hashState());
+    current->push(first);
+
+    std::uint64_t root_matches = 0;
+    for (size_t target = 0; target < targets.size(); ++target)
+    {
+        root_matches |= static_cast<std::uint64_t>(targets[target].matches(root.core)) << target;
+    }
+    markFound(first.node, root_matches);
+
+    std::vector<size_t> counts{1};
+    for (unsigned int depth = 1; depth <= max_depth && current->getSize(); ++depth)
+    {
+        if (stop_when_found && targets_left == 0)
+        {
+            break;
+        }
+
+        size_t count = 0;
+        for (size_t batch = current->pop(parents.data(), BATCH_SIZE); batch; batch = current->pop(parents.data(),
+                BATCH_SIZE))
+        {
+            if (!visited.hasRoomFor(batch * INPUT_COUNT))
+            {
+                visited.spill();
+            }
+            pool.forEach(batch, expand);
+
+            for (size_t i = 0; i < batch * INPUT_COUNT; ++i)
+            {
+                Child& child = children[i];
+                if (!child.is_new)
+                {
+                    continue;
+                }
+                child.entry.node = nodes.append(parents[i / INPUT_COUNT].node,
+                        static_cast<unsigned char>(i % INPUT_COUNT));
+                markFound(child.entry.node, child.matched_targets);
+                next->push(child.entry);
+                ++count;
+            }
+        }
+
+        counts.push_back(count);
+        std::swap(current, next);
+    }
+    return counts;
+}
@@ -0,0 +1,55 @@
+#ifndef CHIP8_EMU_EXPLORER_H
+#define CHIP8_EMU_EXPLORER_H
+
+#include "machine.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * A condition on the machine state that the explorer searches for, e.g. "ram[0x3F0] == 1".
+ */
+struct ExploreTarget
+{
+    enum Kind
+    {
+        MEMORY,
+        REGISTER,
+        PROGRAM_COUNTER
+    };
+
+    Kind kind;
+    unsigned short index;
+    unsigned short value;
+
+    /**
+     * Set by the explorer once a state satisfying the condition is reached: the input of every frame on a
+     * shortest path from the root to that state, as a key (0x0-0xF) or NO_KEY.
+     */
+    bool found = false;
+    std::vector<unsigned char> path;
+
+    bool matches(const Core& core) const;
+};
+
+/**
+ * Breadth-first exploration of the states reachable from a root state, where every frame either one of the 16
+ * keys or no key is held. States are deduplicated by their hash.
+ */
+class Explorer
+{
+public:
+    static constexpr unsigned char NO_KEY = 0x10;
+    static constexpr unsigned int INPUT_COUNT = 17;
+
+    unsigned int cycles_per_frame = 8;
+    unsigned int max_depth = 0xFFFFFFFF;
+    size_t memory_budget = size_t{1} << 30;
+    std::string spill_prefix = "chip8_explore_";
+    unsigned int thread_count = 0;
+    bool stop_when_found = false;
+
+    std::vector<size_t> explore(const Machine& root, std::vector<ExploreTarget>& targets);
+};
+
+#endif //CHIP8_EMU_EXPLORER_H
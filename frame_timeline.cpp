@@ -0,0 +1,67 @@
+#include <cerrno>
+#include <iostream>
+#include "frame_timeline.h"
+
+/**
+ * Starts a timeline at the current time.
+ * @param capacity - the number of events to keep; older events are overwritten
+ */
+FrameTimeline::FrameTimeline(size_t capacity) : origin(std::chrono::steady_clock::now()), capacity(capacity)
+{
+    events.reserve(capacity);
+}
+
+/**
+ * Adds an event, overwriting the oldest one if the timeline is full.
+ * @param name - the name of the phase, which must outlive the timeline
+ * @param start - when the phase started
+ * @param end - when the phase ended
+ */
+void FrameTimeline::add(const char* name, std::chrono::steady_clock::time_point start,
+        std::chrono::steady_clock::time_point end)
+{
+    if (events.size() < capacity)
+    {
+        events.push_back({name, start, end});
+        return;
+    }
+    if (capacity == 0)
+    {
+        return;
+    }
+    events[next] = {name, start, end};
+    next = (next + 1) % capacity;
+    wrapped = true;
+}
+
+/**
+ * Writes the events, oldest first, as complete ("X") events in microseconds since the start of the timeline.
+ * @param file_name - the name of the JSON file to write
+ */
+void FrameTimeline::write(const std::string& file_name) const
+{
+    std::FILE* file = std::fopen(file_name.c_str(), "w");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    std::fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, "
+            "\"args\": {\"name\": \"frontend loop\"}}");
+    for (size_t index = 0; index < events.size(); ++index)
+    {
+        const Event& event = events[wrapped ? (next + index) % events.size() : index];
+        std::chrono::duration<double, std::micro> start = event.start - origin;
+        std::chrono::duration<double, std::micro> duration = event.end - event.start;
+        std::fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+                event.name, start.count(), duration.count());
+    }
+    std::fprintf(file, "\n]}\n");
+    if (std::fclose(file) != 0)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef CHIP8_EMU_FRAME_TIMELINE_H
+#define CHIP8_EMU_FRAME_TIMELINE_H
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/**
+ * Timed events of the phases of the frontend loop, kept for the last capacity events and written in the Chrome
+ * trace event format, which chrome://tracing, Perfetto and speedscope open. Events are recorded by scopes on the
+ * thread that owns the timeline, so recording takes no locks. A scope can drop events shorter than a minimum
+ * duration, for phases such as polling that run on every pass of the loop and only matter when they stall.
+ */
+class FrameTimeline
+{
+    struct Event
+    {
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::vector<Event> events;
+    size_t capacity;
+    size_t next = 0;
+    bool wrapped = false;
+
+public:
+    /**
+     * Times the enclosing block as an event of the timeline, if there is one.
+     */
+    class Scope
+    {
+        FrameTimeline* timeline;
+        const char* name;
+        std::chrono::steady_clock::duration min_duration;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        Scope(FrameTimeline* timeline, const char* name,
+                std::chrono::steady_clock::duration min_duration = std::chrono::steady_clock::duration::zero())
+                : timeline(timeline), name(name), min_duration(min_duration)
+        {
+            if (timeline)
+            {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+
+        ~Scope()
+        {
+            if (timeline)
+            {
+                std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                if (end - start >= min_duration)
+                {
+                    timeline->add(name, start, end);
+                }
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    explicit FrameTimeline(size_t capacity);
+
+    void add(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+    void write(const std::string& file_name) const;
+};
+
+#endif //CHIP8_EMU_FRAME_TIMELINE_H
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include "guest_sampler.h"
+
+/**
+ * Creates a sampler that samples every interval cycles.
+ * @param interval - the number of cycles between two samples, at least 1
+ */
+GuestSampler::GuestSampler(unsigned int interval) : interval(std::max(interval, 1u)), countdown(this->interval)
+{
+}
+
+/**
+ * Records the current call chain of the core.
+ */
+void GuestSampler::sample(const Core& core)
+{
+    unsigned short calls[Core::STACK_DEPTH];
+    unsigned char depth = core.getCallStack(calls);
+
+    std::vector<unsigned short> chain(depth + 1u);
+    for (unsigned char level = 0; level < depth; ++level)
+    {
+        chain[level] = static_cast<unsigned short>((core.getMemory(calls[level]) << 8
+                | core.getMemory(static_cast<unsigned short>(calls[level] + 1))) & 0x0FFF);
+    }
+    chain[depth] = core.getPC();
+    ++chains[chain];
+    ++sample_count;
+}
+
+/**
+ * Returns the number of samples taken.
+ */
+unsigned long GuestSampler::getSampleCount() const
+{
+    return sample_count;
+}
+
+/**
+ * Writes every sampled call chain in the folded stack format, rooted at a frame named main.
+ */
+void GuestSampler::writeFolded(std::FILE* file) const
+{
+    for (const auto& chain : chains)
+    {
+        std::fprintf(file, "main");
+        for (size_t level = 0; level + 1 < chain.first.size(); ++level)
+        {
+            std::fprintf(file, ";sub_0x%03X", chain.first[level]);
+        }
+        std::fprintf(file, ";0x%03X %lu\n", chain.first.back(), chain.second);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_EMU_GUEST_SAMPLER_H
+#define CHIP8_EMU_GUEST_SAMPLER_H
+
+#include <cstdio>
+#include <map>
+#include <vector>
+#include "core.h"
+
+/**
+ * A sampling profiler of the CHIP-8 program running on a core. Every interval cycles it records the guest call
+ * chain: the entry point of every subroutine that has not returned yet, outermost first, followed by the PC. The
+ * samples are written as folded stacks, one line per distinct chain with the number of times it was sampled, as
+ * flamegraph.pl and speedscope read them:
+ *   main;sub_0x2F0;sub_0x340;0x346 12
+ * The entry point of a subroutine is read from the 2NNN that called it.
+ */
+class GuestSampler
+{
+    unsigned int interval;
+    unsigned int countdown;
+    unsigned long sample_count = 0;
+    std::map<std::vector<unsigned short>, unsigned long> chains;
+
+public:
+    explicit GuestSampler(unsigned int interval);
+
+    /**
+     * Counts one emulated cycle of the core, and samples it when the interval has passed.
+     */
+    void tick(const Core& core)
+    {
+        if (--countdown == 0)
+        {
+            sample(core);
+            countdown = interval;
+        }
+    }
+
+    void sample(const Core& core);
+    unsigned long getSampleCount() const;
+    void writeFolded(std::FILE* file) const;
+};
+
+#endif //CHIP8_EMU_GUEST_SAMPLER_H
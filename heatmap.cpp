@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "heatmap.h"
+
+namespace
+{
+    const unsigned int BYTES_PER_ROW = 64;
+
+    /**
+     * The regions of the summary, following the memory layout of Core and the VIP conventions that machine code
+     * routines rely on. The last one only exists where programs address 64 KB.
+     */
+    struct Region
+    {
+        const char* name;
+        unsigned int start;
+        unsigned int end;
+    };
+
+    const Region REGIONS[] =
+    {
+        {"font", 0x0000, 0x0050},
+        {"big font", 0x0050, 0x00B4},
+        {"interpreter", 0x00B4, 0x0200},
+        {"program", 0x0200, 0x0EA0},
+        {"stack", 0x0EA0, 0x0ED0},
+        {"work area", 0x0ED0, 0x0EF0},
+        {"registers", 0x0EF0, 0x0F00},
+        {"display refresh", 0x0F00, 0x1000},
+        {"extended", 0x1000, Core::MEMORY_SIZE}
+    };
+
+    /**
+     * Scales a count to a channel intensity, logarithmically so that rarely touched bytes are still visible.
+     */
+    unsigned char intensity(std::uint32_t count, double log_max)
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        return static_cast<unsigned char>(64 + 191 * std::log1p(count) / log_max);
+    }
+
+    double logMax(const std::uint32_t* counters, unsigned int memory_size)
+    {
+        std::uint32_t max = *std::max_element(counters, counters + memory_size);
+        return std::log1p(std::max<std::uint32_t>(max, 1));
+    }
+}
+
+/**
+ * Resets every counter.
+ */
+void Heatmap::clear()
+{
+    std::memset(fetches, 0, sizeof(fetches));
+    std::memset(reads, 0, sizeof(reads));
+    std::memset(writes, 0, sizeof(writes));
+    std::memset(calls, 0, sizeof(calls));
+    std::memset(returns, 0, sizeof(returns));
+    max_stack_depth = 0;
+}
+
+/**
+ * Writes the counters as a binary PPM image of 64 bytes per row, so that 4 KB is a square. Every byte is a block
+ * of scale x scale pixels whose blue, green and red channels show its fetches, data reads and writes.
+ * @param file_name - the name of the image to write
+ * @param memory_size - the number of bytes the program addresses
+ * @param scale - the size of the block of every byte in pixels
+ */
+void Heatmap::writeImage(const std::string& file_name, unsigned int memory_size, unsigned int scale) const
+{
+    std::FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+
+    scale = std::max(scale, 1u);
+    unsigned int width = BYTES_PER_ROW * scale;
+    unsigned int rows = memory_size / BYTES_PER_ROW;
+    std::fprintf(file, "P6\n%u %u\n255\n", width, rows * scale);
+
+    double log_fetches = logMax(fetches, memory_size);
+    double log_reads = logMax(reads, memory_size);
+    double log_writes = logMax(writes, memory_size);
+    std::vector<unsigned char> line(width * 3);
+    bool written = true;
+    for (unsigned int row = 0; row < rows && written; ++row)
+    {
+        for (unsigned int column = 0; column < BYTES_PER_ROW; ++column)
+        {
+            unsigned int address = row * BYTES_PER_ROW + column;
+            unsigned char pixel[3] =
+            {
+                intensity(writes[address], log_writes),
+                intensity(reads[address], log_reads),
+                intensity(fetches[address], log_fetches)
+            };
+            for (unsigned int x = 0; x < scale; ++x)
+            {
+                std::memcpy(&line[(column * scale + x) * 3], pixel, sizeof(pixel));
+            }
+        }
+        for (unsigned int y = 0; y < scale && written; ++y)
+        {
+            written = std::fwrite(line.data(), 1, line.size(), file) == line.size();
+        }
+    }
+    std::fclose(file);
+    if (!written)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        errno = EIO;
+        throw(errno);
+    }
+}
+
+/**
+ * Writes the totals of every memory region, the traffic at every stack level and the addresses read or written
+ * most often.
+ * @param file - the file to write to
+ * @param memory_size - the number of bytes the program addresses
+ * @param hottest - the number of addresses to list
+ */
+void Heatmap::writeSummary(std::FILE* file, unsigned int memory_size, unsigned int hottest) const
+{
+    std::fprintf(file, "%-16s %-13s %12s %12s %12s  %s\n", "region", "addresses", "fetches", "reads", "writes",
+            "hottest");
+    for (const Region& region : REGIONS)
+    {
+        if (region.start >= memory_size)
+        {
+            break;
+        }
+        unsigned int end = std::min(region.end, memory_size);
+        unsigned long long totals[3] = {};
+        unsigned int hot_address = region.start;
+        std::uint32_t hot_count = 0;
+        for (unsigned int address = region.start; address < end; ++address)
+        {
+            totals[0] += fetches[address];
+            totals[1] += reads[address];
+            totals[2] += writes[address];
+            std::uint32_t accesses = reads[address] + writes[address];
+            if (accesses > hot_count)
+            {
+                hot_address = address;
+                hot_count = accesses;
+            }
+        }
+        char range[24];
+        std::snprintf(range, sizeof(range), "0x%04X-0x%04X", region.start, end - 1);
+        std::fprintf(file, "%-16s %-13s %12llu %12llu %12llu", region.name, range, totals[0], totals[1], totals[2]);
+        if (hot_count)
+        {
+            std::fprintf(file, "  0x%04X (%u)", hot_address, hot_count);
+        }
+        std::fprintf(file, "\n");
+    }
+
+    std::fprintf(file, "\ncall stack: maximum depth %u of %u%s\n", max_stack_depth, Core::STACK_DEPTH,
+            max_stack_depth > Core::STACK_DEPTH ? ", overflowed" : "");
+    for (unsigned int level = 0; level < Core::STACK_DEPTH; ++level)
+    {
+        if (calls[level] || returns[level])
+        {
+            std::fprintf(file, "  level %2u: %10u calls %10u returns\n", level, calls[level], returns[level]);
+        }
+    }
+
+    std::vector<unsigned int> addresses;
+    for (unsigned int address = 0; address < memory_size; ++address)
+    {
+        if (reads[address] || writes[address])
+        {
+            addresses.push_back(address);
+        }
+    }
+    auto accesses = [this](unsigned int address)
+    {
+        return static_cast<unsigned long long>(reads[address]) + writes[address];
+    };
+    size_t listed = std::min<size_t>(hottest, addresses.size());
+    std::partial_sort(addresses.begin(), addresses.begin() + static_cast<std::ptrdiff_t>(listed), addresses.end(),
+            [&](unsigned int a, unsigned int b)
+            {
+                return accesses(a) > accesses(b) || (accesses(a) == accesses(b) && a < b);
+            });
+    std::fprintf(file, "\nhottest data:\n");
+    for (size_t index = 0; index < listed; ++index)
+    {
+        unsigned int address = addresses[index];
+        std::fprintf(file, "  0x%04X: %10u reads %10u writes\n", address, reads[address], writes[address]);
+    }
+}
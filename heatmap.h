@@ -0,0 +1,54 @@
+#ifndef CHIP8_EMU_HEATMAP_H
+#define CHIP8_EMU_HEATMAP_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "core.h"
+
+/**
+ * Counters of how often every byte of memory was fetched as an instruction, read as data and written, and of the
+ * calls and returns at every stack level. A core attached with Core::setHeatmap() counts every access, so that hot
+ * data structures of a program stand out in the image and the per-region summary.
+ *
+ * The call stack is not part of memory in this emulator, so stack traffic is counted per level instead; the stack
+ * that machine code routines use at 0xEA0-0xECF is in memory and shows up in the regions.
+ */
+class Heatmap
+{
+public:
+    std::uint32_t fetches[Core::MEMORY_SIZE] = {};
+    std::uint32_t reads[Core::MEMORY_SIZE] = {};
+    std::uint32_t writes[Core::MEMORY_SIZE] = {};
+    std::uint32_t calls[Core::STACK_DEPTH] = {};
+    std::uint32_t returns[Core::STACK_DEPTH] = {};
+    unsigned int max_stack_depth = 0;
+
+    static void count(std::uint32_t* counters, unsigned int address)
+    {
+        ++counters[address % Core::MEMORY_SIZE];
+    }
+
+    /**
+     * Counts a call that pushed a return address, leaving the specified number of levels on the stack.
+     */
+    void countCall(unsigned int depth)
+    {
+        ++calls[(depth - 1) % Core::STACK_DEPTH];
+        max_stack_depth = depth > max_stack_depth ? depth : max_stack_depth;
+    }
+
+    /**
+     * Counts a return that popped the return address at the specified stack level.
+     */
+    void countReturn(unsigned int level)
+    {
+        ++returns[level % Core::STACK_DEPTH];
+    }
+
+    void clear();
+    void writeImage(const std::string& file_name, unsigned int memory_size, unsigned int scale) const;
+    void writeSummary(std::FILE* file, unsigned int memory_size, unsigned int hottest) const;
+};
+
+#endif //CHIP8_EMU_HEATMAP_H
@@ -51,3 +51,21 @@ char Keyboard::getPressedKey() const
     }
     return -1;
 }
+
+/**
+ * Sets the state of all keys at once.
+ * @param keys - a mask in which bit n is set if key n is pressed
+ */
+void Keyboard::setKeys(unsigned short keys)
+{
+    this->keys = static_cast<short>(keys);
+}
+
+/**
+ * Returns the state of all keys at once.
+ * @return a mask in which bit n is set if key n is pressed
+ */
+unsigned short Keyboard::getKeys() const
+{
+    return static_cast<unsigned short>(keys);
+}
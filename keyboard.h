@@ -12,6 +12,8 @@ public:
     void setKey(char key, bool pressed);
     bool getKey(char key) const;
     char getPressedKey() const;
+    void setKeys(unsigned short keys);
+    unsigned short getKeys() const;
 };
 
 #endif //CHIP8_EMU_KEYBOARD_H
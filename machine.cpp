@@ -0,0 +1,25 @@
+#include "machine.h"
+
+/**
+ * Puts the specified machine in the same state as this one, sharing memory pages with it.
+ * @param child - the machine that becomes a fork of this machine
+ */
+void Machine::fork(Machine& child) const
+{
+    core.fork(child.core);
+}
+
+/**
+ * Emulates one frame with the specified keys held down.
+ * @param keys - a mask in which bit n is set if key n is pressed during this frame
+ * @param cycles_per_frame - the number of cycles to emulate before the timers tick
+ */
+void Machine::runFrame(unsigned short keys, unsigned int cycles_per_frame)
+{
+    core.getKeyboard().setKeys(keys);
+    for (unsigned int cycle = 0; cycle < cycles_per_frame; ++cycle)
+    {
+        core.emulateCycle();
+    }
+    core.tickTimers();
+}
@@ -0,0 +1,19 @@
+#ifndef CHIP8_EMU_MACHINE_H
+#define CHIP8_EMU_MACHINE_H
+
+#include "core.h"
+
+/**
+ * A CHIP-8 machine for headless use, in which time advances in frames: every frame runs a fixed number of
+ * cycles followed by one timer tick. Copying a machine forks it.
+ */
+class Machine
+{
+public:
+    Core core{};
+
+    void fork(Machine& child) const;
+    void runFrame(unsigned short keys, unsigned int cycles_per_frame);
+};
+
+#endif //CHIP8_EMU_MACHINE_H
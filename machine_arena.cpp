@@ -0,0 +1,154 @@
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include "machine_arena.h"
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/**
+ * Returns the regions to the operating system.
+ */
+MachineArena::~MachineArena()
+{
+    for (const Region& region : regions)
+    {
+#if defined(__linux__)
+        if (region.mapped)
+        {
+            munmap(region.data, REGION_SIZE);
+            continue;
+        }
+#endif
+#if defined(_WIN32)
+        _aligned_free(region.data);
+#else
+        std::free(region.data);
+#endif
+    }
+}
+
+/**
+ * Allocates a new region and makes it the one that slots are carved from.
+ * On Linux, explicit huge pages are tried first, then a transparent huge page hint on an aligned mapping.
+ */
+void MachineArena::addRegion()
+{
+    Region region{nullptr, false, false};
+#if defined(__linux__)
+    void* data = mmap(nullptr, REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+            0);
+    if (data != MAP_FAILED)
+    {
+        region = {static_cast<unsigned char*>(data), true, true};
+    }
+    else
+    {
+        // Over-allocate so that a 2 MB aligned range can be cut out of the mapping
+        data = mmap(nullptr, 2 * REGION_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data != MAP_FAILED)
+        {
+            auto start = reinterpret_cast<std::uintptr_t>(data);
+            std::uintptr_t aligned = (start + REGION_SIZE - 1) & ~(REGION_SIZE - 1);
+            if (aligned > start)
+            {
+                munmap(data, aligned - start);
+            }
+            munmap(reinterpret_cast<void*>(aligned + REGION_SIZE), start + REGION_SIZE - aligned);
+            region = {reinterpret_cast<unsigned char*>(aligned), madvise(reinterpret_cast<void*>(aligned),
+                    REGION_SIZE, MADV_HUGEPAGE) == 0, true};
+        }
+    }
+#elif defined(_WIN32)
+    region.data = static_cast<unsigned char*>(_aligned_malloc(REGION_SIZE, REGION_SIZE));
+#else
+    region.data = static_cast<unsigned char*>(std::aligned_alloc(REGION_SIZE, REGION_SIZE));
+#endif
+    if (!region.data)
+    {
+        throw std::bad_alloc();
+    }
+
+    regions.push_back(region);
+    next_slot = region.data;
+    region_end = region.data + REGION_SIZE / SLOT_SIZE * SLOT_SIZE;
+}
+
+/**
+ * Makes sure that the specified number of machines can be acquired without allocating.
+ */
+void MachineArena::reserve(size_t count)
+{
+    size_t available = static_cast<size_t>(region_end - next_slot) / SLOT_SIZE;
+    for (FreeSlot* slot = free_slots; slot && available < count; slot = slot->next)
+    {
+        ++available;
+    }
+    while (available < count)
+    {
+        // Slots left at the end of the current region are moved to the free list before switching regions
+        for (; next_slot != region_end; next_slot += SLOT_SIZE)
+        {
+            free_slots = new(next_slot) FreeSlot{free_slots};
+        }
+        addRegion();
+        available += REGION_SIZE / SLOT_SIZE;
+    }
+}
+
+/**
+ * Constructs a machine in a free slot.
+ * @return the new machine, which must be released to this arena
+ */
+Machine* MachineArena::acquire()
+{
+    void* slot;
+    if (free_slots)
+    {
+        slot = free_slots;
+        free_slots = free_slots->next;
+    }
+    else
+    {
+        if (next_slot == region_end)
+        {
+            addRegion();
+        }
+        slot = next_slot;
+        next_slot += SLOT_SIZE;
+    }
+    ++size;
+    return new(slot) Machine();
+}
+
+/**
+ * Destroys a machine and returns its slot to the arena.
+ */
+void MachineArena::release(Machine* machine)
+{
+    machine->~Machine();
+    free_slots = new(machine) FreeSlot{free_slots};
+    --size;
+}
+
+/**
+ * Returns the number of machines that are currently acquired.
+ */
+size_t MachineArena::getSize() const
+{
+    return size;
+}
+
+/**
+ * Returns the number of regions that are backed by huge pages.
+ */
+size_t MachineArena::getHugePageRegions() const
+{
+    size_t count = 0;
+    for (const Region& region : regions)
+    {
+        count += region.huge_pages;
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef CHIP8_EMU_MACHINE_ARENA_H
+#define CHIP8_EMU_MACHINE_ARENA_H
+
+#include "machine.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Allocates machines contiguously from 2 MB aligned regions, backed by
+ * huge pages where the operating system provides them, so that tens of thousands of instances need few TLB
+ * entries. Every machine starts on a cache line. Acquiring and releasing a machine take constant time.
+ * All machines must be released before the arena is destroyed.
+ */
+class MachineArena
+{
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t REGION_SIZE = size_t{2} << 20;
+    static constexpr size_t SLOT_SIZE = (sizeof(Machine) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    static_assert(alignof(Machine) <= CACHE_LINE, "Machines must fit the cache line alignment of the arena");
+
+    struct Region
+    {
+        unsigned char* data;
+        bool huge_pages;
+        bool mapped;
+    };
+
+    struct FreeSlot
+    {
+        FreeSlot* next;
+    };
+
+    std::vector<Region> regions;
+    FreeSlot* free_slots = nullptr;
+    unsigned char* next_slot = nullptr;
+    unsigned char* region_end = nullptr;
+    size_t size = 0;
+
+    void addRegion();
+
+public:
+    MachineArena() = default;
+    ~MachineArena();
+    MachineArena(const MachineArena&) = delete;
+    MachineArena& operator=(const MachineArena&) = delete;
+
+    void reserve(size_t count);
+    Machine* acquire();
+    void release(Machine* machine);
+    size_t getSize() const;
+    size_t getHugePageRegions() const;
+};
+
+#endif //CHIP8_EMU_MACHINE_ARENA_H
@@ -1,27 +1,122 @@
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <ctime>
+#include <future>
+#include <memory>
+#include "audio.h"
 #include "core.h"
+#include "frame_timeline.h"
+#include "quirk_detector.h"
+#include "runtime_metrics.h"
+#include "startup_timeline.h"
+#include "trace.h"
 #include "include/SDL2/SDL.h"
 
+namespace
+{
+    const size_t FRAME_TRACE_EVENTS = 1 << 19;
+    const std::chrono::microseconds POLL_STALL{100};
+    const std::chrono::milliseconds METRICS_INTERVAL{1000};
+}
+
+/**
+ * Usage: chip8_emu [--timeline] [--trace trace_file] [--frame-trace json_file] [--metrics metrics_file] [quirk_profile]
+ * With --timeline, the detected quirk profile is printed, and the time every phase of startup took once the first
+ * frame is on screen.
+ * With --trace, every executed instruction is written to the trace file, which chip8_trace_decode reads.
+ * With --frame-trace, the phases of the emulation loop are timed and the last FRAME_TRACE_EVENTS of them are written
+ * in the Chrome trace event format on exit. Polling runs on every pass of the loop and is only kept when it stalls.
+ * With --metrics, the counters of the running emulator are written to the metrics file every METRICS_INTERVAL in the
+ * Prometheus text format.
+ */
 int main(int argc, char *argv[])
 {
+    StartupTimeline timeline;
+    bool print_timeline = false;
+    const char* profile_name = nullptr;
+    const char* trace_name = nullptr;
+    const char* frame_trace_name = nullptr;
+    const char* metrics_name = nullptr;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (!std::strcmp(argv[arg], "--timeline"))
+        {
+            print_timeline = true;
+        }
+        else if (!std::strcmp(argv[arg], "--trace") && arg + 1 < argc)
+        {
+            trace_name = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "--frame-trace") && arg + 1 < argc)
+        {
+            frame_trace_name = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "--metrics") && arg + 1 < argc)
+        {
+            metrics_name = argv[++arg];
+        }
+        else
+        {
+            profile_name = argv[arg];
+        }
+    }
+
+    // Use the quirk profile given on the command line, or detect it
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    if (profile_name && !parseQuirkProfile(profile_name, quirks))
+    {
+        std::cerr << "ERROR: Unknown quirk profile " << profile_name << "." << std::endl;
+        return 5;
+    }
+
+    // The core is set up on another thread while SDL creates its resources, which it only allows on this one
+    Core core{};
+    Keyboard& keyboard = core.getKeyboard();
+    Timer& sound_timer = core.getSoundTimer();
+    core.log_faults = true;
+    std::future<void> core_ready = std::async(std::launch::async, [&]()
+    {
+        // Initialize core, memory, timers and input
+        core.initialize(static_cast<std::uint64_t>(time(nullptr)));
+        timeline.mark("Core::initialize");
+        std::vector<unsigned char> program = Core::readProgram("../programs/octo.ch8");
+        timeline.mark("Core::readProgram");
+        if (!profile_name)
+        {
+            QuirkDetector detector("quirks.cache");
+            quirks = detector.detect(program.data(), program.size()).profile;
+            if (print_timeline)
+            {
+                std::cout << "Quirk profile: " << getQuirkProfileName(quirks) << std::endl;
+            }
+            timeline.mark("QuirkDetector::detect");
+        }
+        core.setQuirks(quirks);
+        core.loadProgram(program.data(), program.size());
+        timeline.mark("Core::loadProgram");
+    });
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0){
         std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
         return 1;
     }
+    timeline.mark("SDL_Init");
     SDL_Window* window = SDL_CreateWindow("CHIP-8 Emulator", SDL_WINDOWPOS_CENTERED,
-            SDL_WINDOWPOS_CENTERED, Core::WIDTH << 4, Core::HEIGHT << 4, 0);
+            SDL_WINDOWPOS_CENTERED, Core::WIDTH << 3, Core::HEIGHT << 3, 0);
     if (window == nullptr)
     {
         std::cerr << "SDL_CreateWindow Failed: " << SDL_GetError() << std::endl;
         return 2;
     }
+    timeline.mark("SDL_CreateWindow");
     SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
     if (renderer == nullptr)
     {
         std::cerr << "SDL_CreateRenderer Failed: " << SDL_GetError() << std::endl;
         return 3;
     }
+    timeline.mark("SDL_CreateRenderer");
     SDL_Texture* screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB332,
             SDL_TEXTUREACCESS_STATIC, Core::WIDTH, Core::HEIGHT); // TODO: Stream instead of static access
     if (screen == nullptr)
@@ -29,23 +124,72 @@ int main(int argc, char *argv[])
         std::cerr << "SDL_CreateTexture Failed: " << SDL_GetError() << std::endl;
         return 4;
     }
+    SDL_Texture* mega_screen = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STATIC, Core::MEGA_WIDTH, Core::MEGA_HEIGHT);
+    if (mega_screen == nullptr)
+    {
+        std::cerr << "SDL_CreateTexture Failed: " << SDL_GetError() << std::endl;
+        return 4;
+    }
+    timeline.mark("SDL_CreateTexture");
 
+    // Audio is queued once per timer tick, so that it follows the sound timer. Without an audio device the emulator
+    // runs silently
+    SDL_AudioSpec audio_spec{};
+    audio_spec.freq = 44100;
+    audio_spec.format = AUDIO_S16SYS;
+    audio_spec.channels = 1;
+    audio_spec.samples = 1024;
+    SDL_AudioDeviceID audio = 0;
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) == 0)
+    {
+        audio = SDL_OpenAudioDevice(nullptr, 0, &audio_spec, &audio_spec, 0);
+    }
+    if (audio == 0)
+    {
+        std::cerr << "WARNING: No audio device could be opened, sound is off: " << SDL_GetError() << std::endl;
+    }
+    else
+    {
+        SDL_PauseAudioDevice(audio, 0);
+    }
+    AudioSynthesizer synthesizer(static_cast<unsigned int>(audio_spec.freq));
+    std::vector<std::int16_t> samples(static_cast<size_t>(audio_spec.freq) / 60);
+    timeline.mark("SDL_OpenAudioDevice");
 
-    Keyboard keyboard{};
-
-    Timer delay_timer{};
-    Timer sound_timer{};
+    core_ready.get();
+    timeline.mark("waiting for the core");
 
-    Core core{keyboard, delay_timer, sound_timer};
+    // The trace is written by its own thread while the core runs on this one
+    std::unique_ptr<Trace> trace;
+    if (trace_name)
+    {
+        try
+        {
+            trace = std::make_unique<Trace>(trace_name, core.getQuirks());
+        }
+        catch (int)
+        {
+            return 7;
+        }
+        core.setTrace(trace.get());
+    }
+    bool first_frame = true;
+    std::unique_ptr<FrameTimeline> frame_timeline;
+    if (frame_trace_name)
+    {
+        frame_timeline = std::make_unique<FrameTimeline>(FRAME_TRACE_EVENTS);
+    }
+    FrameTimeline* phases = frame_timeline.get();
 
-    // Initialize core, memory, timers and input
-    core.initialize();
-    core.loadProgram("../programs/octo.ch8");
+    unsigned char pixels[Core::RESOLUTION];
+    std::vector<std::uint32_t> mega_pixels(Core::MEGA_RESOLUTION);
 
     bool quit = false;
     SDL_Event e{};
 
-    double preferred_cycle_duration = 1.0D / 500.0D;
+    double instructions_per_second = 500.0D;
+    double preferred_cycle_duration = 1.0D / instructions_per_second;
     std::chrono::steady_clock::time_point end_prev_cycle{};
     std::chrono::duration<double> time_since_last_cycle{};
 
@@ -53,30 +197,97 @@ int main(int argc, char *argv[])
     std::chrono::steady_clock::time_point prev_tick{};
     std::chrono::duration<double> time_since_last_tick{};
 
+    // The loop counts into its own block of the metrics, which the publisher thread reads without locking
+    std::unique_ptr<RuntimeMetrics> metrics;
+    RuntimeMetrics::Counters* counters = nullptr;
+    if (metrics_name)
+    {
+        metrics = std::make_unique<RuntimeMetrics>(metrics_name, METRICS_INTERVAL, instructions_per_second);
+        counters = metrics->registerThread();
+    }
+    bool input_pending = false;
+    std::chrono::steady_clock::time_point input_time{};
+
     // Emulation loop
     while (!quit)
     {
         time_since_last_cycle = std::chrono::steady_clock::now() - end_prev_cycle;
         if (time_since_last_cycle.count() >= preferred_cycle_duration)
         {
-            core.emulateCycle();
+            // Instructions run in a batch until the display changes or a timer tick is due, which is timed as a whole
+            {
+                FrameTimeline::Scope scope(phases, "emulation batch");
+                std::uint64_t executed = 0;
+                do
+                {
+                    core.emulateCycle();
+                    ++executed;
+                }
+                while (!core.draw_display
+                        && std::chrono::duration<double>(std::chrono::steady_clock::now() - prev_tick).count()
+                        < tick_duration);
+                if (counters)
+                {
+                    RuntimeMetrics::Counters::add(counters->instructions, executed);
+                }
+            }
 
             // Update screen if necessary
             if (core.draw_display) {
+                SDL_Texture* texture = screen;
+                {
+                    FrameTimeline::Scope scope(phases, "SDL_UpdateTexture");
+                    if (core.isMegaMode())
+                    {
+                        core.getColorPixels(mega_pixels.data());
+                        SDL_UpdateTexture(mega_screen, nullptr, mega_pixels.data(),
+                                Core::MEGA_WIDTH * sizeof(std::uint32_t));
+                        texture = mega_screen;
+                    }
+                    else
+                    {
+                        core.getPixels(pixels);
+                        SDL_UpdateTexture(screen, nullptr, pixels, Core::WIDTH * sizeof(char));
+                    }
+                }
+
                 /*for (auto i = 0; i < Core::RESOLUTION; ++i)
                 {
-                    std::cout << (core.getPixels()[i] ? "\uff04"  : "\uff0e");
+                    std::cout << (pixels[i] ? "\uff04"  : "\uff0e");
                     if ((i + 1) % 64 == 0)
                         std::cout << "\n";
                 }
                 std::cout << "\n" << std::endl;*/
 
                 // Update screen
-                SDL_UpdateTexture(screen, nullptr, core.getPixels(), Core::WIDTH * sizeof(char));
                 // TODO: Optimize drawing by only redrawing modified sections
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, screen, nullptr, nullptr);
-                SDL_RenderPresent(renderer);
+                {
+                    FrameTimeline::Scope scope(phases, "SDL_RenderCopy");
+                    SDL_RenderClear(renderer);
+                    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+                }
+                {
+                    FrameTimeline::Scope scope(phases, "SDL_RenderPresent");
+                    SDL_RenderPresent(renderer);
+                }
+                if (counters)
+                {
+                    RuntimeMetrics::Counters::add(counters->frames_presented, 1);
+                    if (input_pending)
+                    {
+                        counters->addLatency(std::chrono::steady_clock::now() - input_time);
+                        input_pending = false;
+                    }
+                }
+                if (first_frame)
+                {
+                    timeline.mark("first frame");
+                    if (print_timeline)
+                    {
+                        timeline.print(stdout);
+                    }
+                    first_frame = false;
+                }
 
                 core.draw_display = false;
                 end_prev_cycle = std::chrono::steady_clock::now();
@@ -87,17 +298,30 @@ int main(int argc, char *argv[])
         time_since_last_tick = std::chrono::steady_clock::now() - prev_tick;
         if (time_since_last_tick.count() >= tick_duration)
         {
-            delay_timer.decrement();
-            sound_timer.decrement();
+            FrameTimeline::Scope scope(phases, "timer tick");
+            core.tickTimers();
             prev_tick = std::chrono::steady_clock::now();
-        }
+            if (counters)
+            {
+                // A stall of the loop skips the ticks that were due meanwhile; the first tick has no previous one
+                auto due = static_cast<std::uint64_t>(time_since_last_tick.count() / tick_duration);
+                bool first_tick = counters->timer_ticks.load(std::memory_order_relaxed) == 0;
+                RuntimeMetrics::Counters::add(counters->timer_ticks, 1);
+                RuntimeMetrics::Counters::add(counters->timer_ticks_missed, first_tick || due < 2 ? 0 : due - 1);
+                counters->invalid_opcodes.store(core.getFaults().invalid_opcodes, std::memory_order_relaxed);
+            }
 
-        if (sound_timer.getValue())
-        {
-            // TODO: beep();
+            // Keep at most a few ticks of audio queued, so that sound stays in sync after a stall
+            if (audio && SDL_GetQueuedAudioSize(audio) < 4 * samples.size() * sizeof(std::int16_t))
+            {
+                synthesizer.synthesize(core.getAudioPattern(), core.getPitch(), sound_timer.getValue() > 0,
+                        samples.data(), samples.size());
+                SDL_QueueAudio(audio, samples.data(), static_cast<Uint32>(samples.size() * sizeof(std::int16_t)));
+            }
         }
 
         // Update keyboard
+        FrameTimeline::Scope scope(phases, "SDL_PollEvent", POLL_STALL);
         char key = -1;
         while (SDL_PollEvent(&e))
         {
@@ -105,6 +329,11 @@ int main(int argc, char *argv[])
             {
                 case SDL_KEYDOWN:
                 case SDL_KEYUP:
+                    if (!input_pending)
+                    {
+                        input_pending = true;
+                        input_time = std::chrono::steady_clock::now();
+                    }
                     switch (e.key.keysym.scancode)
                     {
                         case SDL_SCANCODE_1:
@@ -164,6 +393,25 @@ int main(int argc, char *argv[])
     }
 
     // Clean up
+    metrics.reset();
+    core.setTrace(nullptr);
+    trace.reset();
+    if (frame_timeline)
+    {
+        try
+        {
+            frame_timeline->write(frame_trace_name);
+        }
+        catch (int)
+        {
+            // The error has been reported, and the emulator is shutting down anyway
+        }
+    }
+    if (audio)
+    {
+        SDL_CloseAudioDevice(audio);
+    }
+    SDL_DestroyTexture(mega_screen);
     SDL_DestroyTexture(screen);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
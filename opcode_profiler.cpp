@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include "opcode_profiler.h"
+
+namespace
+{
+    /**
+     * The counters of all threads that have ended, written to the profile file when the process exits. The time
+     * stamp counter is calibrated against the steady clock over the lifetime of the totals.
+     */
+    class ProfileTotals
+    {
+        std::mutex mutex;
+        std::vector<OpcodeProfiler::Counter> opcodes;
+        std::vector<OpcodeProfiler::Counter> pcs;
+        std::chrono::steady_clock::time_point start_time;
+        std::uint64_t start_ticks;
+
+        void write(std::FILE* file, bool csv, double nanoseconds_per_tick) const;
+
+    public:
+        ProfileTotals() : opcodes(OpcodeProfiler::OPCODE_KEYS), pcs(OpcodeProfiler::PC_COUNT),
+                start_time(std::chrono::steady_clock::now()), start_ticks(OpcodeProfiler::readTicks())
+        {
+        }
+
+        ~ProfileTotals();
+
+        void add(const OpcodeProfiler& profiler)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t key = 0; key < opcodes.size(); ++key)
+            {
+                opcodes[key].executions += profiler.opcodes[key].executions;
+                opcodes[key].ticks += profiler.opcodes[key].ticks;
+            }
+            for (size_t pc = 0; pc < pcs.size(); ++pc)
+            {
+                pcs[pc].executions += profiler.pcs[pc].executions;
+                pcs[pc].ticks += profiler.pcs[pc].ticks;
+            }
+        }
+    };
+
+    ProfileTotals& totals()
+    {
+        static ProfileTotals profile_totals;
+        return profile_totals;
+    }
+
+    /**
+     * Writes the profile file.
+     */
+    ProfileTotals::~ProfileTotals()
+    {
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start_time;
+        std::uint64_t elapsed_ticks = OpcodeProfiler::readTicks() - start_ticks;
+        double nanoseconds_per_tick = elapsed_ticks ? elapsed.count() / static_cast<double>(elapsed_ticks) : 1.0;
+
+        const char* variable = std::getenv("CHIP8_OPCODE_PROFILE");
+        std::string file_name = variable && *variable ? variable : "opcode_profile.json";
+        bool csv = file_name.size() >= 4 && file_name.compare(file_name.size() - 4, 4, ".csv") == 0;
+        std::FILE* file = std::fopen(file_name.c_str(), "w");
+        if (!file)
+        {
+            std::cerr << "ERROR: Opcode profile " << file_name << " could not be written." << std::endl;
+            return;
+        }
+        write(file, csv, nanoseconds_per_tick);
+        std::fclose(file);
+    }
+
+    /**
+     * Writes the opcodes in order of their total time, followed by every guest PC that was executed.
+     */
+    void ProfileTotals::write(std::FILE* file, bool csv, double nanoseconds_per_tick) const
+    {
+        std::vector<size_t> keys;
+        for (size_t key = 0; key < opcodes.size(); ++key)
+        {
+            if (opcodes[key].executions)
+            {
+                keys.push_back(key);
+            }
+        }
+        std::sort(keys.begin(), keys.end(), [this](size_t a, size_t b)
+        {
+            return opcodes[a].ticks > opcodes[b].ticks;
+        });
+
+        char name[8];
+        if (csv)
+        {
+            std::fprintf(file, "kind,name,executions,ns\n");
+            for (size_t key : keys)
+            {
+                std::fprintf(file, "opcode,%s,%" PRIu64 ",%.0f\n", OpcodeProfiler::getOpcodeName(key, name),
+                        opcodes[key].executions, static_cast<double>(opcodes[key].ticks) * nanoseconds_per_tick);
+            }
+            for (size_t pc = 0; pc < pcs.size(); ++pc)
+            {
+                if (pcs[pc].executions)
+                {
+                    std::fprintf(file, "pc,0x%04zX,%" PRIu64 ",%.0f\n", pc, pcs[pc].executions,
+                            static_cast<double>(pcs[pc].ticks) * nanoseconds_per_tick);
+                }
+            }
+            return;
+        }
+
+        std::fprintf(file, "{\"nanoseconds_per_tick\": %.6f,\n\"opcodes\": [", nanoseconds_per_tick);
+        const char* separator = "\n";
+        for (size_t key : keys)
+        {
+            double nanoseconds = static_cast<double>(opcodes[key].ticks) * nanoseconds_per_tick;
+            std::fprintf(file, "%s    {\"opcode\": \"%s\", \"executions\": %" PRIu64 ", \"ns\": %.0f, "
+                    "\"ns_per_execution\": %.3f}", separator, OpcodeProfiler::getOpcodeName(key, name),
+                    opcodes[key].executions, nanoseconds, nanoseconds / static_cast<double>(opcodes[key].executions));
+            separator = ",\n";
+        }
+        std::fprintf(file, "\n],\n\"pcs\": [");
+        separator = "\n";
+        for (size_t pc = 0; pc < pcs.size(); ++pc)
+        {
+            if (pcs[pc].executions)
+            {
+                std::fprintf(file, "%s    {\"pc\": \"0x%04zX\", \"executions\": %" PRIu64 ", \"ns\": %.0f}", separator,
+                        pc, pcs[pc].executions, static_cast<double>(pcs[pc].ticks) * nanoseconds_per_tick);
+                separator = ",\n";
+            }
+        }
+        std::fprintf(file, "\n]}\n");
+    }
+}
+
+/**
+ * Creates an empty profiler. The process totals are created first, so that they outlive every profiler.
+ */
+OpcodeProfiler::OpcodeProfiler() : opcodes(OPCODE_KEYS), pcs(PC_COUNT)
+{
+    totals();
+}
+
+/**
+ * Adds the counts of this profiler to the totals of the process.
+ */
+OpcodeProfiler::~OpcodeProfiler()
+{
+    totals().add(*this);
+}
+
+/**
+ * Returns the profiler of the calling thread.
+ */
+OpcodeProfiler& OpcodeProfiler::local()
+{
+    static thread_local OpcodeProfiler profiler;
+    return profiler;
+}
+
+/**
+ * Writes the name of the opcodes counted under a key, such as 8XY4, FX1E or 00CN.
+ * @param key - the counter index, as returned by getOpcodeKey
+ * @param name - a buffer of at least 8 characters that receives the name
+ * @return name
+ */
+const char* OpcodeProfiler::getOpcodeName(size_t key, char* name)
+{
+    static const char* const FAMILIES[16] =
+    {
+        "00", "1NNN", "2NNN", "3XNN", "4XNN", "5XY", "6XNN", "7XNN",
+        "8XY", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX", "FX"
+    };
+    size_t family = key / 256;
+    unsigned int sub = key % 256;
+    if (family == 16)
+    {
+        std::snprintf(name, 8, "0%XNN", sub);
+    }
+    else if (family == 0)
+    {
+        bool has_operand = sub == 0xB0 || sub == 0xC0 || sub == 0xD0;
+        std::snprintf(name, 8, has_operand ? "00%XN" : "00%02X", has_operand ? sub >> 4 : sub);
+    }
+    else if (family == 0x5 || family == 0x8)
+    {
+        std::snprintf(name, 8, "%s%X", FAMILIES[family], sub);
+    }
+    else if (family == 0xE || family == 0xF)
+    {
+        std::snprintf(name, 8, "%s%02X", FAMILIES[family], sub);
+    }
+    else
+    {
+        std::snprintf(name, 8, "%s", FAMILIES[family]);
+    }
+    return name;
+}
@@ -0,0 +1,118 @@
+#ifndef CHIP8_EMU_OPCODE_PROFILER_H
+#define CHIP8_EMU_OPCODE_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * Counts the executions and host time of every opcode and every guest PC. It is only compiled into builds with
+ * CHIP8_OPCODE_PROFILER defined (the CMake option of the same name), where the interpreter times every
+ * instruction with a Scope.
+ *
+ * Opcodes are counted by family and, where the family has a subtable, by sub-opcode: 00NN (with 00BN, 00CN and
+ * 00DN counted together), 0XNN by X, 5XYN and 8XYN by N, and EXNN and FXNN by NN. Every thread counts into its own
+ * profiler, which is added to the totals of the process when the thread ends. At exit, the totals are written to
+ * the file named by the environment variable CHIP8_OPCODE_PROFILE, or opcode_profile.json: as CSV if the name ends
+ * in .csv, as JSON otherwise.
+ */
+class OpcodeProfiler
+{
+public:
+    struct Counter
+    {
+        std::uint64_t executions = 0;
+        std::uint64_t ticks = 0;
+    };
+
+    static constexpr size_t OPCODE_KEYS = 17 * 256;
+    static constexpr size_t PC_COUNT = 0x10000;
+
+    /**
+     * Times the execution of one instruction, from its construction to its destruction.
+     */
+    class Scope
+    {
+        OpcodeProfiler& profiler;
+        unsigned short opcode;
+        unsigned short pc;
+        std::uint64_t start;
+
+    public:
+        Scope(unsigned short opcode, unsigned short pc) : profiler(local()), opcode(opcode), pc(pc),
+                start(readTicks())
+        {
+        }
+
+        ~Scope()
+        {
+            profiler.record(opcode, pc, readTicks() - start);
+        }
+    };
+
+    std::vector<Counter> opcodes;
+    std::vector<Counter> pcs;
+
+    OpcodeProfiler();
+    ~OpcodeProfiler();
+    OpcodeProfiler(const OpcodeProfiler&) = delete;
+    OpcodeProfiler& operator=(const OpcodeProfiler&) = delete;
+
+    static OpcodeProfiler& local();
+    static const char* getOpcodeName(size_t key, char* name);
+
+    /**
+     * Returns the time stamp counter where there is one, and nanoseconds of the steady clock otherwise.
+     */
+    static std::uint64_t readTicks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    /**
+     * Returns the counter index of an opcode: its family in the upper bits and its sub-opcode in the lower 8.
+     */
+    static size_t getOpcodeKey(unsigned short opcode)
+    {
+        unsigned char family = static_cast<unsigned char>(opcode >> 12);
+        unsigned char low = static_cast<unsigned char>(opcode);
+        switch (family)
+        {
+            case 0x0:
+                if (opcode & 0x0F00)
+                {
+                    return 16 * 256 + (opcode >> 8 & 0x0F);
+                }
+                return (low & 0xF0) == 0xB0 || (low & 0xF0) == 0xC0 || (low & 0xF0) == 0xD0 ? low & 0xF0 : low;
+            case 0x5:
+            case 0x8:
+                return family * 256u + (low & 0x0F);
+            case 0xE:
+            case 0xF:
+                return family * 256u + low;
+            default:
+                return family * 256u;
+        }
+    }
+
+    void record(unsigned short opcode, unsigned short pc, std::uint64_t ticks)
+    {
+        Counter& opcode_counter = opcodes[getOpcodeKey(opcode)];
+        ++opcode_counter.executions;
+        opcode_counter.ticks += ticks;
+        Counter& pc_counter = pcs[pc];
+        ++pc_counter.executions;
+        pc_counter.ticks += ticks;
+    }
+};
+
+#endif //CHIP8_EMU_OPCODE_PROFILER_H
@@ -0,0 +1,250 @@
+#ifndef CHIP8_EMU_PAGED_MEMORY_H
+#define CHIP8_EMU_PAGED_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+
+/**
+ * A fixed-size memory of PAGE_COUNT pages of PAGE_SIZE elements, whose pages are shared copy-on-write.
+ * Copying a PagedMemory only copies its page table; a page is duplicated the first time one of its sharers
+ * writes to it. Pages that have never been written refer to a single zero page shared by all memories, which is not
+ * reference counted, so that large, mostly empty memories are cheap to copy from any number of threads.
+ * Indices wrap around at the end of the memory.
+ */
+template<class T, size_t PAGE_SIZE, size_t PAGE_COUNT>
+class PagedMemory
+{
+public:
+    static constexpr size_t SIZE = PAGE_SIZE * PAGE_COUNT;
+    static_assert((SIZE & (SIZE - 1)) == 0, "The size of a paged memory must be a power of two");
+
+private:
+    struct Page
+    {
+        std::atomic<unsigned int> references;
+        T data[PAGE_SIZE];
+        Page* next_free;
+    };
+
+    /**
+     * Pages released by a thread are kept for reuse by that thread, so that copying pages in a steady state
+     * does not touch the heap.
+     */
+    struct FreeList
+    {
+        static constexpr size_t CAPACITY = 4096;
+        Page* head = nullptr;
+        size_t size = 0;
+
+        ~FreeList()
+        {
+            while (head)
+            {
+                Page* page = head;
+                head = page->next_free;
+                delete page;
+            }
+        }
+    };
+
+    Page* pages[PAGE_COUNT];
+
+    static FreeList& freeList()
+    {
+        static thread_local FreeList free_list;
+        return free_list;
+    }
+
+    static Page* allocate()
+    {
+        FreeList& free_list = freeList();
+        if (!free_list.head)
+        {
+            return new Page{{1}, {}, nullptr};
+        }
+        Page* page = free_list.head;
+        free_list.head = page->next_free;
+        --free_list.size;
+        page->references.store(1, std::memory_order_relaxed);
+        return page;
+    }
+
+    /**
+     * Returns the zero page. It holds a reference to itself that is never released, so it is never freed, and it
+     * is never written.
+     */
+    static Page* zeroPage()
+    {
+        static Page zero_page{{1}, {}, nullptr};
+        return &zero_page;
+    }
+
+    static Page* acquire(Page* page)
+    {
+        if (page != zeroPage())
+        {
+            page->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return page;
+    }
+
+    static void release(Page* page)
+    {
+        if (page != zeroPage() && page->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            FreeList& free_list = freeList();
+            if (free_list.size == FreeList::CAPACITY)
+            {
+                delete page;
+                return;
+            }
+            page->next_free = free_list.head;
+            free_list.head = page;
+            ++free_list.size;
+        }
+    }
+
+public:
+    PagedMemory()
+    {
+        for (Page*& page : pages)
+        {
+            page = zeroPage();
+        }
+    }
+
+    PagedMemory(const PagedMemory& other)
+    {
+        for (size_t page = 0; page < PAGE_COUNT; ++page)
+        {
+            pages[page] = acquire(other.pages[page]);
+        }
+    }
+
+    PagedMemory& operator=(const PagedMemory& other)
+    {
+        for (size_t page = 0; page < PAGE_COUNT; ++page)
+        {
+            Page* previous = pages[page];
+            pages[page] = acquire(other.pages[page]);
+            release(previous);
+        }
+        return *this;
+    }
+
+    ~PagedMemory()
+    {
+        for (Page* page : pages)
+        {
+            release(page);
+        }
+    }
+
+    /**
+     * Reads the element at the specified index.
+     */
+    T operator[](size_t index) const
+    {
+        index &= SIZE - 1;
+        return pages[index / PAGE_SIZE]->data[index % PAGE_SIZE];
+    }
+
+    /**
+     * Writes the element at the specified index, duplicating its page first if it is shared.
+     */
+    void write(size_t index, T value)
+    {
+        index &= SIZE - 1;
+        writablePage(index / PAGE_SIZE)[index % PAGE_SIZE] = value;
+    }
+
+    /**
+     * Returns the elements of the specified page for reading.
+     */
+    const T* readPage(size_t page) const
+    {
+        return pages[page]->data;
+    }
+
+    /**
+     * Returns the elements of the specified page for writing, duplicating the page first if it is shared.
+     */
+    T* writablePage(size_t page)
+    {
+        Page* current = pages[page];
+        if (current == zeroPage() || current->references.load(std::memory_order_acquire) != 1)
+        {
+            Page* copy = allocate();
+            std::memcpy(copy->data, current->data, sizeof(copy->data));
+            pages[page] = copy;
+            release(current);
+        }
+        return pages[page]->data;
+    }
+
+    /**
+     * Determines whether the specified page is shared with another memory.
+     */
+    bool isShared(size_t page) const
+    {
+        return pages[page] == zeroPage() || pages[page]->references.load(std::memory_order_relaxed) != 1;
+    }
+
+    /**
+     * Determines whether the specified page has never been written since it was last cleared, in which case all
+     * of its elements are zero.
+     */
+    bool isZero(size_t page) const
+    {
+        return pages[page] == zeroPage();
+    }
+
+    /**
+     * Sets all elements to zero by pointing every page at the zero page.
+     */
+    void clear()
+    {
+        for (Page*& page : pages)
+        {
+            release(page);
+            page = zeroPage();
+        }
+    }
+
+    /**
+     * Replaces the first size elements of this memory with those of the specified array; size is a multiple of
+     * PAGE_SIZE. Pages whose contents do not change are left alone, so they stay shared.
+     */
+    void assign(const T* data, size_t size = SIZE)
+    {
+        static const T zeros[PAGE_SIZE] = {};
+        for (size_t page = 0; page < size / PAGE_SIZE; ++page, data += PAGE_SIZE)
+        {
+            if (std::memcmp(pages[page]->data, data, sizeof(zeros)) == 0)
+            {
+                continue;
+            }
+            if (std::memcmp(zeros, data, sizeof(zeros)) == 0)
+            {
+                release(pages[page]);
+                pages[page] = zeroPage();
+                continue;
+            }
+            std::memcpy(writablePage(page), data, sizeof(zeros));
+        }
+    }
+
+    /**
+     * Copies the first size elements of this memory into the specified array; size is a multiple of PAGE_SIZE.
+     */
+    void copyTo(T* data, size_t size = SIZE) const
+    {
+        for (size_t page = 0; page < size / PAGE_SIZE; ++page, data += PAGE_SIZE)
+        {
+            std::memcpy(data, pages[page]->data, PAGE_SIZE * sizeof(T));
+        }
+    }
+};
+
+#endif //CHIP8_EMU_PAGED_MEMORY_H
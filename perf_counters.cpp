@@ -0,0 +1,157 @@
+#include "perf_counters.h"
+
+#if defined(__linux__)
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+    struct EventConfig
+    {
+        std::uint32_t type;
+        std::uint64_t config;
+    };
+
+    constexpr std::uint64_t cacheMiss(std::uint64_t cache)
+    {
+        return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    }
+
+    const EventConfig EVENTS[PerfCounters::EVENT_COUNT] =
+    {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+        {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_DTLB)}
+    };
+}
+
+/**
+ * Opens every counter that the host supports for the calling thread, disabled.
+ */
+PerfCounters::PerfCounters()
+{
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = EVENTS[event].type;
+        attributes.config = EVENTS[event].config;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        descriptors[event] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            close(descriptor);
+        }
+    }
+}
+
+/**
+ * Returns whether any counter could be opened.
+ */
+bool PerfCounters::isAvailable() const
+{
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Resets the counters and starts counting.
+ */
+void PerfCounters::start()
+{
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+/**
+ * Stops counting and returns the counts since start(), scaled up to the whole time for counters that the kernel
+ * only ran part of it.
+ */
+PerfCounters::Sample PerfCounters::stop()
+{
+    for (int descriptor : descriptors)
+    {
+        if (descriptor >= 0)
+        {
+            ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    Sample sample{};
+    for (int event = 0; event < EVENT_COUNT; ++event)
+    {
+        // The value, the time enabled and the time running
+        std::uint64_t values[3];
+        sample.counts[event] = -1;
+        if (descriptors[event] < 0 || read(descriptors[event], values, sizeof(values)) != sizeof(values)
+                || values[2] == 0)
+        {
+            continue;
+        }
+        sample.counts[event] = static_cast<double>(values[0]) * static_cast<double>(values[1])
+                / static_cast<double>(values[2]);
+    }
+    return sample;
+}
+
+#else
+
+PerfCounters::PerfCounters()
+{
+    for (int& descriptor : descriptors)
+    {
+        descriptor = -1;
+    }
+}
+
+PerfCounters::~PerfCounters() = default;
+
+bool PerfCounters::isAvailable() const
+{
+    return false;
+}
+
+void PerfCounters::start()
+{
+}
+
+PerfCounters::Sample PerfCounters::stop()
+{
+    Sample sample{};
+    for (double& count : sample.counts)
+    {
+        count = -1;
+    }
+    return sample;
+}
+
+#endif
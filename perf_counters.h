@@ -0,0 +1,53 @@
+#ifndef CHIP8_EMU_PERF_COUNTERS_H
+#define CHIP8_EMU_PERF_COUNTERS_H
+
+#include <cstddef>
+
+/**
+ * Hardware performance counters of the calling thread, read through the Linux perf_event_open interface: cycles,
+ * instructions, branch misses, L1 data cache read misses, last level cache misses and data TLB read misses. Every
+ * counter is opened on its own, so that a host without one of them (virtual machines often lack the cache events)
+ * still counts the others; counts are scaled when the kernel multiplexes counters. Only user space is counted, which
+ * perf_event_paranoid allows up to level 2. On other systems no counter is available.
+ */
+class PerfCounters
+{
+public:
+    enum Event
+    {
+        CYCLES,
+        INSTRUCTIONS,
+        BRANCH_MISSES,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        EVENT_COUNT
+    };
+
+    static constexpr const char* NAMES[EVENT_COUNT] =
+    {
+        "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "dtlb_misses"
+    };
+
+    /**
+     * The counts of one measurement; counts of counters that are not available are negative.
+     */
+    struct Sample
+    {
+        double counts[EVENT_COUNT];
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool isAvailable() const;
+    void start();
+    Sample stop();
+
+private:
+    int descriptors[EVENT_COUNT];
+};
+
+#endif //CHIP8_EMU_PERF_COUNTERS_H
@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "machine.h"
+#include "quirk_detector.h"
+
+namespace
+{
+    constexpr unsigned short PROGRAM_ADDRESS = 0x200;
+    constexpr size_t MAX_PROGRAM_SIZE = Core::MEMORY_SIZE - PROGRAM_ADDRESS;
+    constexpr size_t PROFILE_COUNT = static_cast<size_t>(QuirkProfile::COUNT);
+
+    /**
+     * Counts the opcodes that only SUPER-CHIP and later interpreters implement: 00CN, 00FB-00FF, DXY0, FX30,
+     * FX75 and FX85. Only even addresses are considered, which is where almost all code lives.
+     */
+    unsigned int countSuperChipOpcodes(const unsigned char* program, size_t size)
+    {
+        unsigned int count = 0;
+        for (size_t i = 0; i + 1 < size; i += 2)
+        {
+            unsigned short opcode = program[i] << 8 | program[i + 1];
+            unsigned char low = program[i + 1];
+            bool is_super_chip = (opcode & 0xFFF0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF)
+                    || (opcode & 0xF00F) == 0xD000
+                    || ((opcode & 0xF000) == 0xF000 && (low == 0x30 || low == 0x75 || low == 0x85));
+            count += is_super_chip;
+        }
+        return count;
+    }
+
+    /**
+     * Counts the opcodes that only XO-CHIP implements: 00DN, 5XY2, 5XY3, F000 NNNN, FN01, F002 and FX3A.
+     */
+    unsigned int countXoChipOpcodes(const unsigned char* program, size_t size)
+    {
+        unsigned int count = 0;
+        for (size_t i = 0; i + 1 < size; i += 2)
+        {
+            unsigned short opcode = program[i] << 8 | program[i + 1];
+            unsigned char low = program[i + 1];
+            bool is_xo_chip = (opcode & 0xFFF0) == 0x00D0 || (opcode & 0xF00E) == 0x5002
+                    || opcode == 0xF000 || opcode == 0xF002
+                    || ((opcode & 0xF000) == 0xF000 && (low == 0x01 || low == 0x3A));
+            count += is_xo_chip;
+        }
+        return count;
+    }
+
+    /**
+     * Counts the opcodes that only MEGA-CHIP implements: 0010, 0011, 00BN and 01NN-09NN. Since 01NN-09NN are
+     * also calls of machine code routines on the VIP, nothing is counted unless the program switches to the colour
+     * display (0011) somewhere.
+     */
+    unsigned int countMegaChipOpcodes(const unsigned char* program, size_t size)
+    {
+        unsigned int count = 0;
+        bool switches_mode = false;
+        for (size_t i = 0; i + 1 < size; i += 2)
+        {
+            unsigned short opcode = program[i] << 8 | program[i + 1];
+            switches_mode |= opcode == 0x0011;
+            bool is_mega_chip = opcode == 0x0010 || opcode == 0x0011 || (opcode & 0xFFF0) == 0x00B0
+                    || (opcode >= 0x0100 && opcode < 0x0A00);
+            count += is_mega_chip;
+        }
+        return switches_mode ? count : 0;
+    }
+
+    /**
+     * Returns the keys held in the specified frame of an input script:
+     * 0 holds no keys, 1 holds every key in turn for ten frames, 2 holds a pseudo-random key each frame.
+     */
+    unsigned short scriptKeys(unsigned int script, unsigned int frame)
+    {
+        switch (script)
+        {
+            case 1:
+                return static_cast<unsigned short>(1 << (frame / 10 % 16));
+            case 2:
+                return static_cast<unsigned short>(1 << (Random::at(script, frame) >> 60));
+            default:
+                return 0;
+        }
+    }
+}
+
+/**
+ * Creates a detector.
+ * @param cache_file_name - the file that keeps detected profiles between runs, or empty to cache in memory only
+ * @param thread_count - the number of threads for trial runs, or 0 to use one per hardware thread
+ */
+QuirkDetector::QuirkDetector(const std::string& cache_file_name, unsigned int thread_count) :
+        cache_file_name(cache_file_name), thread_count(thread_count)
+{
+    loadCache();
+}
+
+/**
+ * Returns a 64-bit hash of the specified program, the key of the cache.
+ */
+std::uint64_t QuirkDetector::hashProgram(const unsigned char* program, size_t size)
+{
+    std::uint64_t hash = Random::at(size, 0);
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash = Random::at(hash, program[i]);
+    }
+    return hash;
+}
+
+void QuirkDetector::loadCache()
+{
+    if (cache_file_name.empty())
+    {
+        return;
+    }
+    FILE* file = std::fopen(cache_file_name.c_str(), "r");
+    if (!file)
+    {
+        return;
+    }
+    std::uint64_t program_hash;
+    char name[16];
+    QuirkProfile profile;
+    while (std::fscanf(file, "%" SCNx64 " %15s", &program_hash, name) == 2)
+    {
+        if (parseQuirkProfile(name, profile))
+        {
+            cache[program_hash] = profile;
+        }
+    }
+    std::fclose(file);
+}
+
+void QuirkDetector::storeCache(std::uint64_t program_hash, QuirkProfile profile)
+{
+    cache[program_hash] = profile;
+    if (cache_file_name.empty())
+    {
+        return;
+    }
+    FILE* file = std::fopen(cache_file_name.c_str(), "a");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << cache_file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+    std::fprintf(file, "%016" PRIx64 " %s\n", program_hash, getQuirkProfileName(profile));
+    std::fclose(file);
+}
+
+/**
+ * Detects the quirk profile of the specified program, or looks it up in the cache.
+ * @param program - the program code
+ * @param size - the size of the program in bytes
+ * @return the chosen profile and the evidence for it
+ */
+QuirkReport QuirkDetector::detect(const unsigned char* program, size_t size)
+{
+    if (size > MAX_PROGRAM_SIZE)
+    {
+        std::cerr << "ERROR: Program is too large." << std::endl;
+        errno = ENOMEM;
+        throw(errno);
+    }
+
+    QuirkReport report{};
+    report.super_chip_opcodes = countSuperChipOpcodes(program, size);
+    report.xo_chip_opcodes = countXoChipOpcodes(program, size);
+    report.mega_chip_opcodes = countMegaChipOpcodes(program, size);
+
+    std::uint64_t program_hash = hashProgram(program, size);
+    auto cached = cache.find(program_hash);
+    if (cached != cache.end())
+    {
+        report.profile = cached->second;
+        report.cached = true;
+        return report;
+    }
+
+    struct Run
+    {
+        Core::Faults faults;
+        bool escaped;
+        bool blank;
+        std::uint64_t trace_hash;
+    };
+    Run runs[PROFILE_COUNT * SCRIPT_COUNT];
+
+    auto trial = [this, program, size, &runs](size_t i)
+    {
+        auto profile = static_cast<QuirkProfile>(i / SCRIPT_COUNT);
+        auto script = static_cast<unsigned int>(i % SCRIPT_COUNT);
+        Run& run = runs[i];
+        run = Run{};
+
+        // A program that does not fit the memory of a profile cannot have been written for it
+        if (size > getMemorySize(profile) - PROGRAM_ADDRESS)
+        {
+            run.escaped = true;
+            return;
+        }
+
+        auto machine = std::make_unique<Machine>();
+        Core& core = machine->core;
+        core.initialize();
+        core.setQuirks(profile);
+        core.loadProgram(program, size);
+
+        for (unsigned int frame = 0; frame < frames && !run.escaped; ++frame)
+        {
+            core.getKeyboard().setKeys(scriptKeys(script, frame));
+            for (unsigned int cycle = 0; cycle < cycles_per_frame; ++cycle)
+            {
+                core.emulateCycle();
+                if (core.getPC() < PROGRAM_ADDRESS || core.getPC() >= PROGRAM_ADDRESS + size)
+                {
+                    run.escaped = true;
+                    break;
+                }
+            }
+            core.tickTimers();
+            run.trace_hash = Random::at(run.trace_hash, core.hashState());
+        }
+
+        run.blank = true;
+        if (core.isMegaMode())
+        {
+            std::vector<std::uint32_t> colors(Core::MEGA_RESOLUTION);
+            core.getColorPixels(colors.data());
+            for (std::uint32_t color : colors)
+            {
+                run.blank &= (color & 0xFFFFFF) == 0;
+            }
+        }
+        else
+        {
+            unsigned char pixels[Core::RESOLUTION];
+            core.getPixels(pixels);
+            for (unsigned char pixel : pixels)
+            {
+                run.blank &= pixel == 0;
+            }
+        }
+        run.faults = core.getFaults();
+    };
+    if (!pool)
+    {
+        pool = std::make_unique<ThreadPool>(thread_count);
+    }
+    pool->forEach(PROFILE_COUNT * SCRIPT_COUNT, trial);
+
+    int best_penalty = 0;
+    for (size_t profile = 0; profile < PROFILE_COUNT; ++profile)
+    {
+        QuirkEvidence& evidence = report.evidence[profile];
+        for (unsigned int script = 0; script < SCRIPT_COUNT; ++script)
+        {
+            const Run& run = runs[profile * SCRIPT_COUNT + script];
+            evidence.faults.invalid_opcodes += run.faults.invalid_opcodes;
+            evidence.faults.stack_overflows += run.faults.stack_overflows;
+            evidence.faults.stack_underflows += run.faults.stack_underflows;
+            evidence.pc_escapes += run.escaped;
+            evidence.blank_runs += run.blank;
+            evidence.trace_hash = Random::at(evidence.trace_hash, run.trace_hash);
+        }
+        report.divergent |= evidence.trace_hash != report.evidence[0].trace_hash;
+
+        // A crash outweighs any number of misbehaving instructions, which outweigh a blank display
+        unsigned int stack_faults = evidence.faults.stack_overflows + evidence.faults.stack_underflows;
+        evidence.penalty = 1000 * static_cast<int>(evidence.pc_escapes)
+                + 100 * static_cast<int>(std::min(stack_faults, 9u))
+                + 10 * static_cast<int>(std::min(evidence.faults.invalid_opcodes, 9u))
+                + static_cast<int>(evidence.blank_runs);
+        auto candidate = static_cast<QuirkProfile>(profile);
+        if (report.super_chip_opcodes && candidate != QuirkProfile::SUPER_CHIP && candidate != QuirkProfile::XO_CHIP
+                && candidate != QuirkProfile::MEGA_CHIP)
+        {
+            evidence.penalty += 50;
+        }
+        if (report.xo_chip_opcodes && candidate != QuirkProfile::XO_CHIP)
+        {
+            evidence.penalty += 50;
+        }
+        if (report.mega_chip_opcodes && candidate != QuirkProfile::MEGA_CHIP)
+        {
+            evidence.penalty += 50;
+        }
+
+        if (profile == 0 || evidence.penalty < best_penalty)
+        {
+            best_penalty = evidence.penalty;
+            report.profile = static_cast<QuirkProfile>(profile);
+        }
+    }
+
+    // When every profile runs identically the quirks do not matter; only the static evidence is left
+    if (!report.divergent)
+    {
+        report.profile = report.mega_chip_opcodes ? QuirkProfile::MEGA_CHIP
+                : report.xo_chip_opcodes ? QuirkProfile::XO_CHIP
+                : report.super_chip_opcodes ? QuirkProfile::SUPER_CHIP : QuirkProfile::DEFAULT;
+    }
+
+    storeCache(program_hash, report.profile);
+    return report;
+}
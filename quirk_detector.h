@@ -0,0 +1,66 @@
+#ifndef CHIP8_EMU_QUIRK_DETECTOR_H
+#define CHIP8_EMU_QUIRK_DETECTOR_H
+
+#include "core.h"
+#include "quirks.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/**
+ * What the trial runs of one quirk profile revealed about a program.
+ */
+struct QuirkEvidence
+{
+    Core::Faults faults;
+    unsigned int pc_escapes;      // Runs in which PC left the program, after which the run was stopped
+    unsigned int blank_runs;      // Runs that ended with an empty display
+    std::uint64_t trace_hash;     // Hash of the state at the end of every frame of every run
+    int penalty;
+};
+
+/**
+ * The outcome of detecting the quirk profile of a program.
+ */
+struct QuirkReport
+{
+    QuirkProfile profile;
+    bool cached;      // The profile was taken from the cache and no trial runs were made
+    bool divergent;   // The profiles ran differently, so the choice matters
+    unsigned int super_chip_opcodes;
+    unsigned int xo_chip_opcodes;
+    unsigned int mega_chip_opcodes;
+    QuirkEvidence evidence[static_cast<size_t>(QuirkProfile::COUNT)];
+};
+
+/**
+ * Guesses which interpreter a program was written for. The program runs briefly under every quirk profile in
+ * parallel, with a few scripted inputs; profiles under which it faults, escapes its code or draws nothing are
+ * penalized, and opcodes that only exist on some interpreters tip the balance. Results are cached by the hash of
+ * the program, in memory and optionally in a file shared between runs.
+ */
+class QuirkDetector
+{
+    static constexpr unsigned int SCRIPT_COUNT = 3;
+
+    std::unordered_map<std::uint64_t, QuirkProfile> cache;
+    std::string cache_file_name;
+    unsigned int thread_count;
+    std::unique_ptr<ThreadPool> pool; // Created on the first cache miss, so that cache hits start no threads
+
+    void loadCache();
+    void storeCache(std::uint64_t program_hash, QuirkProfile profile);
+
+public:
+    unsigned int frames = 300;
+    unsigned int cycles_per_frame = 8;
+
+    explicit QuirkDetector(const std::string& cache_file_name = "", unsigned int thread_count = 0);
+
+    static std::uint64_t hashProgram(const unsigned char* program, size_t size);
+    QuirkReport detect(const unsigned char* program, size_t size);
+};
+
+#endif //CHIP8_EMU_QUIRK_DETECTOR_H
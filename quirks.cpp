@@ -0,0 +1,42 @@
+#include <cstring>
+#include "quirks.h"
+
+namespace
+{
+    const char* const PROFILE_NAMES[] = {"default", "vip", "schip", "xochip", "megachip"};
+}
+
+/**
+ * Returns the short name of the specified quirk profile, as accepted by parseQuirkProfile().
+ */
+const char* getQuirkProfileName(QuirkProfile profile)
+{
+    return profile < QuirkProfile::COUNT ? PROFILE_NAMES[static_cast<unsigned char>(profile)] : "unknown";
+}
+
+/**
+ * Looks up a quirk profile by its short name.
+ * @param name - the name of the profile, such as "vip"
+ * @param profile - receives the profile if the name is known
+ * @return whether the name is known
+ */
+bool parseQuirkProfile(const char* name, QuirkProfile& profile)
+{
+    for (unsigned char i = 0; i < static_cast<unsigned char>(QuirkProfile::COUNT); ++i)
+    {
+        if (!std::strcmp(name, PROFILE_NAMES[i]))
+        {
+            profile = static_cast<QuirkProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the size of the address space of programs written for the specified profile.
+ */
+unsigned int getMemorySize(QuirkProfile profile)
+{
+    return profile == QuirkProfile::XO_CHIP || profile == QuirkProfile::MEGA_CHIP ? 0x10000 : 0x1000;
+}
@@ -0,0 +1,112 @@
+#ifndef CHIP8_EMU_QUIRKS_H
+#define CHIP8_EMU_QUIRKS_H
+
+/**
+ * The interpreters that CHIP-8 programs are written for, which differ in the behaviour of a few instructions.
+ */
+enum class QuirkProfile : unsigned char
+{
+    DEFAULT,    // The original behaviour of this emulator
+    VIP,        // The COSMAC VIP interpreter
+    SUPER_CHIP, // SUPER-CHIP 1.1 on the HP 48
+    XO_CHIP,    // XO-CHIP, as implemented by Octo
+    MEGA_CHIP,  // MEGA-CHIP, SUPER-CHIP with a 256x192 colour display
+    COUNT
+};
+
+const char* getQuirkProfileName(QuirkProfile profile);
+bool parseQuirkProfile(const char* name, QuirkProfile& profile);
+unsigned int getMemorySize(QuirkProfile profile);
+
+/*
+ * Every profile is a set of compile-time flags, so that each gets its own interpreter without runtime checks:
+ * - SHIFT_READS_VY: 8XY6/8XYE shift Vy into Vx, rather than shifting Vx in place
+ * - LOAD_STORE_INCREMENTS_I: FX55/FX65 leave I pointing after the last register
+ * - JUMP_USES_VX: BXNN jumps to XNN + Vx, rather than BNNN jumping to NNN + V0
+ * - SPRITES_WRAP: sprites wrap around the edges of the display, rather than being clipped
+ * - LOGIC_RESETS_VF: 8XY1/8XY2/8XY3 set VF to 0
+ * - SUPER_CHIP_OPCODES: high resolution, scrolling, 16x16 sprites (DXY0), the big font and the flag registers
+ * - XO_CHIP_OPCODES: long loads (F000 NNNN), two bitplanes (FN01), register ranges (5XY2/5XY3), scrolling up
+ *   (00DN) and audio patterns (F002, FX3A)
+ * - MEGA_CHIP_OPCODES: the colour mode (0010/0011), long loads (01NN NNNN), palettes (02NN), sprite sizes
+ *   (03NN/04NN), screen alpha (05NN), blend modes (080N), the collision colour (09NN) and scrolling up (00BN)
+ * - MACHINE_CODE_ROUTINES: 0NNN runs the CDP1802 machine code at NNN, with the register conventions of the VIP
+ * - MEMORY_SIZE: the size of the address space; addresses wrap around at its end
+ */
+
+struct DefaultQuirks
+{
+    static constexpr QuirkProfile PROFILE = QuirkProfile::DEFAULT;
+    static constexpr bool SHIFT_READS_VY = true;
+    static constexpr bool LOAD_STORE_INCREMENTS_I = true;
+    static constexpr bool JUMP_USES_VX = false;
+    static constexpr bool SPRITES_WRAP = true;
+    static constexpr bool LOGIC_RESETS_VF = false;
+    static constexpr bool SUPER_CHIP_OPCODES = false;
+    static constexpr bool XO_CHIP_OPCODES = false;
+    static constexpr bool MEGA_CHIP_OPCODES = false;
+    static constexpr bool MACHINE_CODE_ROUTINES = false;
+    static constexpr unsigned int MEMORY_SIZE = 0x1000;
+};
+
+struct VipQuirks
+{
+    static constexpr QuirkProfile PROFILE = QuirkProfile::VIP;
+    static constexpr bool SHIFT_READS_VY = true;
+    static constexpr bool LOAD_STORE_INCREMENTS_I = true;
+    static constexpr bool JUMP_USES_VX = false;
+    static constexpr bool SPRITES_WRAP = false;
+    static constexpr bool LOGIC_RESETS_VF = true;
+    static constexpr bool SUPER_CHIP_OPCODES = false;
+    static constexpr bool XO_CHIP_OPCODES = false;
+    static constexpr bool MEGA_CHIP_OPCODES = false;
+    static constexpr bool MACHINE_CODE_ROUTINES = true;
+    static constexpr unsigned int MEMORY_SIZE = 0x1000;
+};
+
+struct SuperChipQuirks
+{
+    static constexpr QuirkProfile PROFILE = QuirkProfile::SUPER_CHIP;
+    static constexpr bool SHIFT_READS_VY = false;
+    static constexpr bool LOAD_STORE_INCREMENTS_I = false;
+    static constexpr bool JUMP_USES_VX = true;
+    static constexpr bool SPRITES_WRAP = false;
+    static constexpr bool LOGIC_RESETS_VF = false;
+    static constexpr bool SUPER_CHIP_OPCODES = true;
+    static constexpr bool XO_CHIP_OPCODES = false;
+    static constexpr bool MEGA_CHIP_OPCODES = false;
+    static constexpr bool MACHINE_CODE_ROUTINES = false;
+    static constexpr unsigned int MEMORY_SIZE = 0x1000;
+};
+
+struct XoChipQuirks
+{
+    static constexpr QuirkProfile PROFILE = QuirkProfile::XO_CHIP;
+    static constexpr bool SHIFT_READS_VY = true;
+    static constexpr bool LOAD_STORE_INCREMENTS_I = true;
+    static constexpr bool JUMP_USES_VX = false;
+    static constexpr bool SPRITES_WRAP = true;
+    static constexpr bool LOGIC_RESETS_VF = false;
+    static constexpr bool SUPER_CHIP_OPCODES = true;
+    static constexpr bool XO_CHIP_OPCODES = true;
+    static constexpr bool MEGA_CHIP_OPCODES = false;
+    static constexpr bool MACHINE_CODE_ROUTINES = false;
+    static constexpr unsigned int MEMORY_SIZE = 0x10000;
+};
+
+struct MegaChipQuirks
+{
+    static constexpr QuirkProfile PROFILE = QuirkProfile::MEGA_CHIP;
+    static constexpr bool SHIFT_READS_VY = false;
+    static constexpr bool LOAD_STORE_INCREMENTS_I = false;
+    static constexpr bool JUMP_USES_VX = true;
+    static constexpr bool SPRITES_WRAP = false;
+    static constexpr bool LOGIC_RESETS_VF = false;
+    static constexpr bool SUPER_CHIP_OPCODES = true;
+    static constexpr bool XO_CHIP_OPCODES = false;
+    static constexpr bool MEGA_CHIP_OPCODES = true;
+    static constexpr bool MACHINE_CODE_ROUTINES = false;
+    static constexpr unsigned int MEMORY_SIZE = 0x10000;
+};
+
+#endif //CHIP8_EMU_QUIRKS_H
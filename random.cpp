@@ -0,0 +1,49 @@
+#include "random.h"
+
+/**
+ * Restarts the generator from the beginning of the sequence for the specified seed.
+ */
+void Random::setSeed(std::uint64_t seed)
+{
+    setState(seed, 0);
+}
+
+/**
+ * Restores the generator to a previously saved position.
+ * @param seed - the seed of the sequence
+ * @param counter - the number of outputs that have already been drawn from the sequence
+ */
+void Random::setState(std::uint64_t seed, std::uint64_t counter)
+{
+    this->seed = seed;
+    this->counter = counter;
+}
+
+/**
+ * Returns the seed of the sequence.
+ */
+std::uint64_t Random::getSeed() const
+{
+    return seed;
+}
+
+/**
+ * Returns the number of outputs that have been drawn from the sequence.
+ */
+std::uint64_t Random::getCounter() const
+{
+    return counter;
+}
+
+/**
+ * Fills the output with the next count outputs and advances the generator past them.
+ * The outputs do not depend on each other, so the compiler is free to compute them in SIMD lanes.
+ */
+void Random::generate(std::uint64_t* output, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        output[i] = at(seed, counter + i);
+    }
+    counter += count;
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_EMU_RANDOM_H
+#define CHIP8_EMU_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A seedable counter-based random number generator (SplitMix64 over a counter).
+ * The n-th output depends only on the seed and n, so the complete state is two integers that can be stored in
+ * save states, and any number of outputs can be computed independently of each other.
+ */
+class Random
+{
+    std::uint64_t seed = 0;
+    std::uint64_t counter = 0;
+
+public:
+    /**
+     * Computes the output of a generator with the specified seed at the specified position.
+     */
+    static std::uint64_t at(std::uint64_t seed, std::uint64_t counter)
+    {
+        std::uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * Returns the next output and advances the generator.
+     */
+    std::uint64_t next()
+    {
+        return at(seed, counter++);
+    }
+
+    void setSeed(std::uint64_t seed);
+    void setState(std::uint64_t seed, std::uint64_t counter);
+    std::uint64_t getSeed() const;
+    std::uint64_t getCounter() const;
+    void generate(std::uint64_t* output, size_t count);
+};
+
+#endif //CHIP8_EMU_RANDOM_H
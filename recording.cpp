@@ -0,0 +1,416 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include "recording.h"
+
+namespace
+{
+    const unsigned char MAGIC[4] = {'C', '8', 'R', 'C'};
+    constexpr unsigned int LEGACY_MEMORY_SIZE = 0x1000;
+    constexpr unsigned short LEGACY_STACK_ADDRESS = 0xEA0;
+    constexpr unsigned short LEGACY_STACK_SIZE = 0x60;
+    constexpr unsigned char LEGACY_FLAG_COUNT = 8;
+
+    void writeBytes(FILE* file, const void* data, size_t size)
+    {
+        if (std::fwrite(data, 1, size, file) != size)
+        {
+            throw(errno);
+        }
+    }
+
+    void readBytes(FILE* file, void* data, size_t size)
+    {
+        if (std::fread(data, 1, size, file) != size)
+        {
+            errno = EIO;
+            throw(errno);
+        }
+    }
+
+    void writeInt(FILE* file, unsigned int value, size_t size)
+    {
+        unsigned char bytes[4];
+        for (size_t i = 0; i < size; ++i)
+        {
+            bytes[i] = static_cast<unsigned char>(value >> (8 * i));
+        }
+        writeBytes(file, bytes, size);
+    }
+
+    unsigned int readInt(FILE* file, size_t size)
+    {
+        unsigned char bytes[4];
+        readBytes(file, bytes, size);
+        unsigned int value = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            value |= static_cast<unsigned int>(bytes[i]) << (8 * i);
+        }
+        return value;
+    }
+
+    void writeInt64(FILE* file, std::uint64_t value)
+    {
+        writeInt(file, static_cast<unsigned int>(value), 4);
+        writeInt(file, static_cast<unsigned int>(value >> 32), 4);
+    }
+
+    std::uint64_t readInt64(FILE* file)
+    {
+        std::uint64_t low = readInt(file, 4);
+        return low | static_cast<std::uint64_t>(readInt(file, 4)) << 32;
+    }
+
+    /**
+     * Determines whether any MEGA-CHIP register or pixel differs from its initial value.
+     */
+    bool hasMegaChipState(const Core::State& state)
+    {
+        if (state.mega_mode || state.sprite_width || state.sprite_height || state.blend_mode != BlendMode::NORMAL
+                || state.collision_color || state.screen_alpha != 0xFF)
+        {
+            return true;
+        }
+        return state.mega != nullptr;
+    }
+
+    /**
+     * Writes a state, with only the first 4 KB of memory when the rest is all zero, as it is for every program
+     * but XO-CHIP ones.
+     */
+    void writeState(FILE* file, const Core::State& state)
+    {
+        unsigned int memory_size = LEGACY_MEMORY_SIZE;
+        for (unsigned int address = LEGACY_MEMORY_SIZE; address < Core::MEMORY_SIZE; ++address)
+        {
+            if (state.ram[address])
+            {
+                memory_size = Core::MEMORY_SIZE;
+                break;
+            }
+        }
+        writeInt(file, memory_size - 1, 2);
+        writeBytes(file, state.ram, memory_size);
+        for (const std::uint64_t* plane : state.display)
+        {
+            for (size_t word = 0; word < Core::DISPLAY_WORDS; ++word)
+            {
+                writeInt64(file, plane[word]);
+            }
+        }
+        writeInt(file, state.high_res, 1);
+        writeInt(file, state.plane_mask, 1);
+        writeBytes(file, state.flags, sizeof(state.flags));
+        for (unsigned short entry : state.stack)
+        {
+            writeInt(file, entry, 2);
+        }
+        writeBytes(file, state.pattern, sizeof(state.pattern));
+        writeInt(file, state.pitch, 1);
+        writeBytes(file, state.V, sizeof(state.V));
+        writeInt(file, state.I, 2);
+        writeInt(file, state.PC, 2);
+        writeInt(file, state.SP, 1);
+        writeInt(file, state.delay_timer, 1);
+        writeInt(file, state.sound_timer, 1);
+        writeInt64(file, state.random_seed);
+        writeInt64(file, state.random_counter);
+
+        bool has_mega_chip_state = hasMegaChipState(state);
+        writeInt(file, has_mega_chip_state, 1);
+        if (has_mega_chip_state)
+        {
+            writeInt(file, state.mega_mode, 1);
+            writeInt(file, state.sprite_width, 1);
+            writeInt(file, state.sprite_height, 1);
+            writeInt(file, static_cast<unsigned int>(state.blend_mode), 1);
+            writeInt(file, state.collision_color, 1);
+            writeInt(file, state.screen_alpha, 1);
+            static const Core::MegaChipState blank{};
+            const Core::MegaChipState& mega = state.mega ? *state.mega : blank;
+            for (std::uint32_t color : mega.palette)
+            {
+                writeInt(file, color, 4);
+            }
+            writeBytes(file, mega.indices, sizeof(mega.indices));
+            for (std::uint32_t color : mega.colors)
+            {
+                writeInt(file, color, 4);
+            }
+        }
+    }
+
+    /**
+     * Reads a 64 x 32 display of one byte per pixel, as stored before version 4, into a display in which every
+     * pixel covers 2 x 2 pixels.
+     */
+    void readLowResDisplay(FILE* file, std::uint64_t* display)
+    {
+        unsigned char pixels[Core::RESOLUTION / 4];
+        readBytes(file, pixels, sizeof(pixels));
+        std::memset(display, 0, Core::DISPLAY_WORDS * sizeof(*display));
+        for (size_t y = 0; y < Core::HEIGHT / 2; ++y)
+        {
+            for (size_t x = 0; x < Core::WIDTH / 2; ++x)
+            {
+                if (pixels[y * Core::WIDTH / 2 + x])
+                {
+                    std::uint64_t bits = std::uint64_t{3} << (62 - x * 2 % 64);
+                    display[y * 4 + x / 32] |= bits;
+                    display[y * 4 + 2 + x / 32] |= bits;
+                }
+            }
+        }
+    }
+
+    /**
+     * Reads a state. Before version 5 memory was 4 KB with the call stack at 0xEA0, SP counted bytes rather than
+     * levels, there was one display plane and eight flag registers, and there was no audio pattern. The stack is
+     * moved out of memory, where the current interpreter would no longer update it. Before version 6 there was no
+     * MEGA-CHIP state; since then it is only stored when it differs from its initial value.
+     */
+    void readState(FILE* file, Core::State& state, unsigned int version)
+    {
+        std::memset(state.ram, 0, sizeof(state.ram));
+        std::memset(state.display, 0, sizeof(state.display));
+        std::memset(state.flags, 0, sizeof(state.flags));
+        std::memset(state.stack, 0, sizeof(state.stack));
+        state.high_res = false;
+        state.plane_mask = 1;
+        std::memcpy(state.pattern, Core::DEFAULT_PATTERN, sizeof(state.pattern));
+        state.pitch = Core::DEFAULT_PITCH;
+
+        unsigned int memory_size = version < 5 ? LEGACY_MEMORY_SIZE : readInt(file, 2) + 1;
+        readBytes(file, state.ram, memory_size);
+        if (version < 4)
+        {
+            readLowResDisplay(file, state.display[0]);
+        }
+        else
+        {
+            for (size_t plane = 0; plane < (version < 5 ? 1 : Core::PLANES); ++plane)
+            {
+                for (size_t word = 0; word < Core::DISPLAY_WORDS; ++word)
+                {
+                    state.display[plane][word] = readInt64(file);
+                }
+            }
+            state.high_res = readInt(file, 1) != 0;
+            if (version < 5)
+            {
+                readBytes(file, state.flags, LEGACY_FLAG_COUNT);
+            }
+            else
+            {
+                state.plane_mask = static_cast<unsigned char>(readInt(file, 1));
+                readBytes(file, state.flags, sizeof(state.flags));
+                for (unsigned short& entry : state.stack)
+                {
+                    entry = static_cast<unsigned short>(readInt(file, 2));
+                }
+                readBytes(file, state.pattern, sizeof(state.pattern));
+                state.pitch = static_cast<unsigned char>(readInt(file, 1));
+            }
+        }
+        readBytes(file, state.V, sizeof(state.V));
+        state.I = static_cast<unsigned short>(readInt(file, 2));
+        state.PC = static_cast<unsigned short>(readInt(file, 2));
+        state.SP = static_cast<unsigned char>(readInt(file, 1));
+        if (version < 5)
+        {
+            state.SP /= 2;
+            for (unsigned char level = 0; level < Core::STACK_DEPTH; ++level)
+            {
+                const unsigned char* entry = state.ram + LEGACY_STACK_ADDRESS + 2 * level;
+                state.stack[level] = static_cast<unsigned short>(entry[0] << 8 | entry[1]);
+            }
+            std::memset(state.ram + LEGACY_STACK_ADDRESS, 0, LEGACY_STACK_SIZE);
+        }
+        state.delay_timer = static_cast<unsigned char>(readInt(file, 1));
+        state.sound_timer = static_cast<unsigned char>(readInt(file, 1));
+        state.random_seed = readInt64(file);
+        state.random_counter = readInt64(file);
+
+        state.mega_mode = false;
+        state.sprite_width = 0;
+        state.sprite_height = 0;
+        state.blend_mode = BlendMode::NORMAL;
+        state.collision_color = 0;
+        state.screen_alpha = 0xFF;
+        state.mega.reset();
+        if (version < 6 || !readInt(file, 1))
+        {
+            return;
+        }
+        state.mega_mode = readInt(file, 1) != 0;
+        state.sprite_width = static_cast<unsigned char>(readInt(file, 1));
+        state.sprite_height = static_cast<unsigned char>(readInt(file, 1));
+        state.blend_mode = static_cast<BlendMode>(readInt(file, 1));
+        state.collision_color = static_cast<unsigned char>(readInt(file, 1));
+        state.screen_alpha = static_cast<unsigned char>(readInt(file, 1));
+        if (state.blend_mode >= BlendMode::COUNT)
+        {
+            errno = EINVAL;
+            throw(errno);
+        }
+        auto mega = std::make_shared<Core::MegaChipState>();
+        for (std::uint32_t& color : mega->palette)
+        {
+            color = readInt(file, 4);
+        }
+        readBytes(file, mega->indices, sizeof(mega->indices));
+        for (std::uint32_t& color : mega->colors)
+        {
+            color = readInt(file, 4);
+        }
+        state.mega = std::move(mega);
+    }
+}
+
+/**
+ * Loads a recording from the specified file, replacing the contents of this recording.
+ * @param file_name - the name of the file to read
+ */
+void Recording::load(const std::string& file_name)
+{
+    FILE* file = std::fopen(file_name.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+        throw(errno);
+    }
+
+    try
+    {
+        unsigned char magic[sizeof(MAGIC)];
+        readBytes(file, magic, sizeof(magic));
+        unsigned int version = readInt(file, 2);
+        if (std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || version < 2 || version > VERSION)
+        {
+            std::cerr << "ERROR: File " << file_name << " is not a supported recording." << std::endl;
+            errno = EINVAL;
+            throw(errno);
+        }
+
+        cycles_per_frame = readInt(file, 4);
+        quirks = version < 3 ? QuirkProfile::DEFAULT : static_cast<QuirkProfile>(readInt(file, 1));
+        if (quirks >= QuirkProfile::COUNT)
+        {
+            errno = EINVAL;
+            throw(errno);
+        }
+        inputs.resize(readInt(file, 4));
+        keyframes.resize(readInt(file, 4));
+        for (unsigned short& keys : inputs)
+        {
+            keys = static_cast<unsigned short>(readInt(file, 2));
+        }
+        for (size_t index = 0; index < keyframes.size(); ++index)
+        {
+            Keyframe& keyframe = keyframes[index];
+            keyframe.frame = readInt(file, 4);
+            if (keyframe.frame > inputs.size() || (index > 0 && keyframe.frame <= keyframes[index - 1].frame))
+            {
+                errno = EINVAL;
+                throw(errno);
+            }
+            readState(file, keyframe.state, version);
+        }
+    }
+    catch (int)
+    {
+        std::cerr << "ERROR: File " << file_name << " is truncated or corrupt." << std::endl;
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+}
+
+/**
+ * Saves this recording to the specified file.
+ * @param file_name - the name of the file to write
+ */
+void Recording::save(const std::string& file_name) const
+{
+    FILE* file = std::fopen(file_name.c_str(), "wb");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+
+    try
+    {
+        writeBytes(file, MAGIC, sizeof(MAGIC));
+        writeInt(file, VERSION, 2);
+        writeInt(file, cycles_per_frame, 4);
+        writeInt(file, static_cast<unsigned int>(quirks), 1);
+        writeInt(file, static_cast<unsigned int>(inputs.size()), 4);
+        writeInt(file, static_cast<unsigned int>(keyframes.size()), 4);
+        for (unsigned short keys : inputs)
+        {
+            writeInt(file, keys, 2);
+        }
+        for (const Keyframe& keyframe : keyframes)
+        {
+            writeInt(file, keyframe.frame, 4);
+            writeState(file, keyframe.state);
+        }
+    }
+    catch (int)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        std::fclose(file);
+        throw;
+    }
+    std::fclose(file);
+}
+
+/**
+ * Starts recording the specified machine, taking the first keyframe from its current state.
+ * @param machine - the machine to record
+ * @param recording - the recording that receives the inputs and keyframes
+ * @param keyframe_interval - the number of frames between two keyframes
+ */
+Recorder::Recorder(Machine& machine, Recording& recording, unsigned int keyframe_interval) : machine(machine),
+        recording(recording), keyframe_interval(keyframe_interval)
+{
+    recording.quirks = machine.core.getQuirks();
+    recording.inputs.clear();
+    recording.keyframes.clear();
+    addKeyframe();
+}
+
+void Recorder::addKeyframe()
+{
+    recording.keyframes.emplace_back();
+    recording.keyframes.back().frame = static_cast<unsigned int>(recording.inputs.size());
+    machine.core.saveState(recording.keyframes.back().state);
+}
+
+/**
+ * Emulates and records one frame with the specified keys held down.
+ * @param keys - a mask in which bit n is set if key n is pressed during this frame
+ */
+void Recorder::recordFrame(unsigned short keys)
+{
+    if (!recording.inputs.empty() && recording.inputs.size() % keyframe_interval == 0)
+    {
+        addKeyframe();
+    }
+    recording.inputs.push_back(keys);
+    machine.runFrame(keys, recording.cycles_per_frame);
+}
+
+/**
+ * Takes a final keyframe so that the last segment of the recording can be verified as well.
+ */
+void Recorder::finish()
+{
+    if (recording.keyframes.back().frame != recording.inputs.size())
+    {
+        addKeyframe();
+    }
+}
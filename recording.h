@@ -0,0 +1,50 @@
+#ifndef CHIP8_EMU_RECORDING_H
+#define CHIP8_EMU_RECORDING_H
+
+#include "core.h"
+#include "machine.h"
+#include <string>
+#include <vector>
+
+/**
+ * A recorded session: the key mask of every frame, plus periodic keyframes holding the full machine state.
+ * A segment runs from one keyframe to the next, so segments can be re-simulated independently.
+ */
+class Recording
+{
+public:
+    static constexpr unsigned short VERSION = 6;
+
+    struct Keyframe
+    {
+        unsigned int frame;
+        Core::State state;
+    };
+
+    unsigned int cycles_per_frame = 8;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    std::vector<unsigned short> inputs;
+    std::vector<Keyframe> keyframes;
+
+    void load(const std::string& file_name);
+    void save(const std::string& file_name) const;
+};
+
+/**
+ * Records a session on a machine, taking a keyframe every keyframe_interval frames.
+ */
+class Recorder
+{
+    Machine& machine;
+    Recording& recording;
+    unsigned int keyframe_interval;
+
+    void addKeyframe();
+
+public:
+    Recorder(Machine& machine, Recording& recording, unsigned int keyframe_interval);
+    void recordFrame(unsigned short keys);
+    void finish();
+};
+
+#endif //CHIP8_EMU_RECORDING_H
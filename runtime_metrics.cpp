@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include "runtime_metrics.h"
+
+/**
+ * Counts the time from an input to the first frame presented after it.
+ */
+void RuntimeMetrics::Counters::addLatency(std::chrono::steady_clock::duration latency)
+{
+    unsigned int bucket = 0;
+    std::chrono::steady_clock::duration bound = FIRST_LATENCY_BOUND;
+    while (bucket < LATENCY_BUCKETS - 1 && latency > bound)
+    {
+        ++bucket;
+        bound *= 2;
+    }
+    add(latency_buckets[bucket], 1);
+    add(latency_count, 1);
+    add(latency_nanoseconds,
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+}
+
+/**
+ * Starts publishing the metrics.
+ * @param file_name - the name of the file to rewrite; it is replaced by renaming, so scrapers never read half a file
+ * @param interval - the time between rewrites
+ * @param target_instructions_per_second - the instruction rate the emulator aims for, published for comparison
+ */
+RuntimeMetrics::RuntimeMetrics(const std::string& file_name, std::chrono::milliseconds interval,
+        double target_instructions_per_second) : file_name(file_name), interval(interval),
+        target_instructions_per_second(target_instructions_per_second), threads(new Counters[MAX_THREADS])
+{
+    publisher = std::thread(&RuntimeMetrics::publish, this);
+}
+
+/**
+ * Stops publishing after a last rewrite of the file.
+ */
+RuntimeMetrics::~RuntimeMetrics()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    stop_requested.notify_one();
+    publisher.join();
+}
+
+/**
+ * Gives the calling thread its own counters.
+ * @return the counters, or nullptr if MAX_THREADS threads have registered already
+ */
+RuntimeMetrics::Counters* RuntimeMetrics::registerThread()
+{
+    unsigned int index = thread_count.fetch_add(1, std::memory_order_relaxed);
+    return index < MAX_THREADS ? &threads[index] : nullptr;
+}
+
+/**
+ * Sums up the counters of every thread.
+ */
+RuntimeMetrics::Totals RuntimeMetrics::merge() const
+{
+    Totals totals{};
+    unsigned int count = std::min(thread_count.load(std::memory_order_relaxed), MAX_THREADS);
+    for (unsigned int index = 0; index < count; ++index)
+    {
+        const Counters& counters = threads[index];
+        totals.instructions += counters.instructions.load(std::memory_order_relaxed);
+        totals.frames_presented += counters.frames_presented.load(std::memory_order_relaxed);
+        totals.timer_ticks += counters.timer_ticks.load(std::memory_order_relaxed);
+        totals.timer_ticks_missed += counters.timer_ticks_missed.load(std::memory_order_relaxed);
+        totals.invalid_opcodes += counters.invalid_opcodes.load(std::memory_order_relaxed);
+        for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS; ++bucket)
+        {
+            totals.latency_buckets[bucket] += counters.latency_buckets[bucket].load(std::memory_order_relaxed);
+        }
+        totals.latency_count += counters.latency_count.load(std::memory_order_relaxed);
+        totals.latency_nanoseconds += counters.latency_nanoseconds.load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+/**
+ * Rewrites the metrics file.
+ * @param totals - the counters now
+ * @param previous - the counters at the last rewrite
+ * @param seconds - the time since the last rewrite
+ */
+void RuntimeMetrics::write(const Totals& totals, const Totals& previous, double seconds) const
+{
+    std::string temporary_name = file_name + ".tmp";
+    std::FILE* file = std::fopen(temporary_name.c_str(), "w");
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << temporary_name << " could not be written." << std::endl;
+        return;
+    }
+
+    auto metric = [file](const char* name, const char* type, const char* help, double value)
+    {
+        std::fprintf(file, "# HELP %s %s\n# TYPE %s %s\n%s %.9g\n", name, help, name, type, name, value);
+    };
+    double instructions_per_second = seconds > 0 ? (totals.instructions - previous.instructions) / seconds : 0;
+    std::uint64_t ticks = totals.timer_ticks - previous.timer_ticks;
+    std::uint64_t presented = totals.frames_presented - previous.frames_presented;
+
+    metric("chip8_instructions_total", "counter", "Instructions executed.", static_cast<double>(totals.instructions));
+    metric("chip8_instructions_per_second", "gauge", "Instructions executed per second over the last interval.",
+            instructions_per_second);
+    metric("chip8_target_instructions_per_second", "gauge", "Instructions per second the emulator aims for.",
+            target_instructions_per_second);
+    metric("chip8_instruction_rate_ratio", "gauge", "Instructions per second over the last interval divided by the "
+            "target.", instructions_per_second / target_instructions_per_second);
+    metric("chip8_frames_presented_total", "counter", "Frames presented.",
+            static_cast<double>(totals.frames_presented));
+    metric("chip8_draws_per_frame", "gauge", "Frames presented per 60 Hz timer tick over the last interval.",
+            ticks ? static_cast<double>(presented) / ticks : 0);
+    metric("chip8_timer_ticks_total", "counter", "60 Hz timer ticks.", static_cast<double>(totals.timer_ticks));
+    metric("chip8_timer_ticks_missed_total", "counter", "60 Hz timer ticks that were due but skipped because the "
+            "loop stalled.", static_cast<double>(totals.timer_ticks_missed));
+    metric("chip8_invalid_opcodes_total", "counter", "Invalid opcodes the program executed.",
+            static_cast<double>(totals.invalid_opcodes));
+
+    std::fprintf(file, "# HELP chip8_input_latency_seconds Time from an input event to the next frame presented.\n"
+            "# TYPE chip8_input_latency_seconds summary\n");
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    for (double quantile : quantiles)
+    {
+        std::uint64_t rank = static_cast<std::uint64_t>(quantile * static_cast<double>(totals.latency_count));
+        std::uint64_t cumulative = 0;
+        double bound = std::chrono::duration<double>(FIRST_LATENCY_BOUND).count();
+        for (unsigned int bucket = 0; bucket < LATENCY_BUCKETS - 1; ++bucket)
+        {
+            cumulative += totals.latency_buckets[bucket];
+            if (cumulative > rank)
+            {
+                break;
+            }
+            bound *= 2;
+        }
+        std::fprintf(file, "chip8_input_latency_seconds{quantile=\"%g\"} ", quantile);
+        if (totals.latency_count)
+        {
+            std::fprintf(file, "%.9g\n", bound);
+        }
+        else
+        {
+            std::fprintf(file, "NaN\n");
+        }
+    }
+    std::fprintf(file, "chip8_input_latency_seconds_sum %.9g\nchip8_input_latency_seconds_count %llu\n",
+            static_cast<double>(totals.latency_nanoseconds) / 1e9,
+            static_cast<unsigned long long>(totals.latency_count));
+
+    if (std::fclose(file) != 0 || std::rename(temporary_name.c_str(), file_name.c_str()) != 0)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+    }
+}
+
+/**
+ * The publisher thread: rewrites the file every interval until the metrics are destroyed, and once more then.
+ */
+void RuntimeMetrics::publish()
+{
+    Totals previous{};
+    auto previous_time = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    bool stop = false;
+    while (!stop)
+    {
+        stop = stop_requested.wait_for(lock, interval, [this]()
+        {
+            return stopping;
+        });
+        auto now = std::chrono::steady_clock::now();
+        Totals totals = merge();
+        write(totals, previous, std::chrono::duration<double>(now - previous_time).count());
+        previous = totals;
+        previous_time = now;
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef CHIP8_EMU_RUNTIME_METRICS_H
+#define CHIP8_EMU_RUNTIME_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * Counters of a running emulator, published by rewriting a file in the Prometheus text format every interval, so
+ * that a node exporter textfile collector or any scraper can pick them up. Every thread that counts registers its
+ * own block of counters, which only it writes, with relaxed stores and no read-modify-write; the publisher sums the
+ * blocks of all threads without locks. Rates and draws per frame are computed over the last interval.
+ */
+class RuntimeMetrics
+{
+public:
+    static constexpr unsigned int MAX_THREADS = 16;
+
+    /**
+     * Input-to-present latencies are counted in buckets of powers of two times 100 microseconds, and the quantiles
+     * reported are the upper bounds of the buckets they fall in.
+     */
+    static constexpr unsigned int LATENCY_BUCKETS = 18;
+    static constexpr std::chrono::microseconds FIRST_LATENCY_BOUND{100};
+
+    /**
+     * The counters of one thread.
+     */
+    struct alignas(64) Counters
+    {
+        std::atomic<std::uint64_t> instructions{0};
+        std::atomic<std::uint64_t> frames_presented{0};
+        std::atomic<std::uint64_t> timer_ticks{0};
+        std::atomic<std::uint64_t> timer_ticks_missed{0};
+        std::atomic<std::uint64_t> invalid_opcodes{0};
+        std::atomic<std::uint64_t> latency_buckets[LATENCY_BUCKETS] = {};
+        std::atomic<std::uint64_t> latency_count{0};
+        std::atomic<std::uint64_t> latency_nanoseconds{0};
+
+        /**
+         * Adds to a counter of this block, which only the thread that owns it may do.
+         */
+        static void add(std::atomic<std::uint64_t>& counter, std::uint64_t amount)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        void addLatency(std::chrono::steady_clock::duration latency);
+    };
+
+    RuntimeMetrics(const std::string& file_name, std::chrono::milliseconds interval,
+            double target_instructions_per_second);
+    ~RuntimeMetrics();
+    RuntimeMetrics(const RuntimeMetrics&) = delete;
+    RuntimeMetrics& operator=(const RuntimeMetrics&) = delete;
+
+    Counters* registerThread();
+
+private:
+    struct Totals
+    {
+        std::uint64_t instructions;
+        std::uint64_t frames_presented;
+        std::uint64_t timer_ticks;
+        std::uint64_t timer_ticks_missed;
+        std::uint64_t invalid_opcodes;
+        std::uint64_t latency_buckets[LATENCY_BUCKETS];
+        std::uint64_t latency_count;
+        std::uint64_t latency_nanoseconds;
+    };
+
+    std::string file_name;
+    std::chrono::milliseconds interval;
+    double target_instructions_per_second;
+    std::unique_ptr<Counters[]> threads;
+    std::atomic<unsigned int> thread_count{0};
+
+    std::mutex mutex;
+    std::condition_variable stop_requested;
+    bool stopping = false;
+    std::thread publisher;
+
+    Totals merge() const;
+    void write(const Totals& totals, const Totals& previous, double seconds) const;
+    void publish();
+};
+
+#endif //CHIP8_EMU_RUNTIME_METRICS_H
@@ -0,0 +1,144 @@
+#include "search.h"
+
+/**
+ * Creates an engine with a pool of states.
+ * @param capacity - the maximum number of states that can be alive at the same time
+ * @param cycles_per_frame - the number of cycles emulated per frame
+ * @param thread_count - the number of threads that expand nodes, or 0 for one per hardware thread
+ */
+SearchEngine::SearchEngine(size_t capacity, unsigned int cycles_per_frame, unsigned int thread_count) :
+        cycles_per_frame(cycles_per_frame), pool(thread_count)
+{
+    arena.reserve(capacity);
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        machines.push_back(arena.acquire());
+    }
+    free_machines.assign(machines.rbegin(), machines.rend());
+}
+
+/**
+ * Returns all states to the arena.
+ */
+SearchEngine::~SearchEngine()
+{
+    for (Machine* machine : machines)
+    {
+        arena.release(machine);
+    }
+}
+
+Machine* SearchEngine::acquire()
+{
+    std::lock_guard<std::mutex> lock(free_mutex);
+    if (free_machines.empty())
+    {
+        return nullptr;
+    }
+    Machine* machine = free_machines.back();
+    free_machines.pop_back();
+    return machine;
+}
+
+/**
+ * Creates a root state with the specified program loaded.
+ * @param program_name - the name of the program to load
+ * @param seed - the seed of the core's random number generator
+ * @return the root state, or nullptr if the pool is exhausted
+ */
+Machine* SearchEngine::load(const std::string& program_name, std::uint64_t seed)
+{
+    Machine* machine = acquire();
+    if (machine)
+    {
+        machine->core.initialize(seed);
+        machine->core.loadProgram(program_name);
+    }
+    return machine;
+}
+
+/**
+ * Creates a copy-on-write fork of the specified state.
+ * @return the new state, or nullptr if the pool is exhausted
+ */
+Machine* SearchEngine::clone(const Machine& state)
+{
+    Machine* machine = acquire();
+    if (machine)
+    {
+        state.fork(*machine);
+    }
+    return machine;
+}
+
+/**
+ * Advances a state in place by holding the specified keys for a number of frames.
+ */
+void SearchEngine::step(Machine& state, unsigned short keys, unsigned int frames) const
+{
+    for (unsigned int frame = 0; frame < frames; ++frame)
+    {
+        state.runFrame(keys, cycles_per_frame);
+    }
+}
+
+/**
+ * Performs a batch of expansions in parallel and waits until all of them are done.
+ * The parents must not be modified or discarded while the batch runs.
+ */
+void SearchEngine::expand(Expansion* expansions, size_t count)
+{
+    {
+        std::lock_guard<std::mutex> lock(free_mutex);
+        for (size_t i = 0; i < count; ++i)
+        {
+            expansions[i].child = nullptr;
+            if (!free_machines.empty())
+            {
+                expansions[i].child = free_machines.back();
+                free_machines.pop_back();
+            }
+        }
+    }
+
+    auto expandOne = [this, expansions](size_t i)
+    {
+        Expansion& expansion = expansions[i];
+        if (!expansion.child)
+        {
+            return;
+        }
+        expansion.parent->fork(*expansion.child);
+        step(*expansion.child, expansion.keys, expansion.frames);
+
+        const Core& core = expansion.child->core;
+        for (size_t address = 0; address < expansion.address_count; ++address)
+        {
+            expansion.values[address] = core.getMemory(expansion.addresses[address]);
+        }
+        if (expansion.pixels)
+        {
+            core.getPixels(expansion.pixels);
+        }
+    };
+    pool.forEach(count, expandOne);
+}
+
+/**
+ * Returns a state to the pool. It keeps its pages until an expansion forks into it, so that they are released on
+ * the pool thread that reuses it, whose free list the pages that thread allocates come from.
+ */
+void SearchEngine::discard(Machine* state)
+{
+    std::lock_guard<std::mutex> lock(free_mutex);
+    free_machines.push_back(state);
+}
+
+/**
+ * Returns the number of states that can still be created.
+ */
+size_t SearchEngine::getAvailable()
+{
+    std::lock_guard<std::mutex> lock(free_mutex);
+    return free_machines.size();
+}
@@ -0,0 +1,65 @@
+#ifndef CHIP8_EMU_SEARCH_H
+#define CHIP8_EMU_SEARCH_H
+
+#include "machine.h"
+#include "machine_arena.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * One node expansion of a tree search: fork a parent state, hold a key mask for a number of frames, and read
+ * back the parts of the resulting state that the search evaluates.
+ */
+struct Expansion
+{
+    const Machine* parent;
+    unsigned short keys;
+    unsigned int frames;
+
+    /**
+     * Optional outputs: the bytes of memory at addresses[0..address_count) are copied to values, and the
+     * display to pixels (Core::RESOLUTION bytes).
+     */
+    const unsigned short* addresses = nullptr;
+    size_t address_count = 0;
+    unsigned char* values = nullptr;
+    unsigned char* pixels = nullptr;
+
+    /**
+     * The resulting state, or nullptr if the pool was exhausted. Owned by the engine until discarded.
+     */
+    Machine* child = nullptr;
+};
+
+/**
+ * A library interface for tree search (MCTS, beam search) over emulator states.
+ * States are taken from a fixed pool in a machine arena and forked copy-on-write, so expanding a node does not
+ * allocate, and batches of expansions run in parallel on a thread pool.
+ */
+class SearchEngine
+{
+    unsigned int cycles_per_frame;
+    MachineArena arena;
+    std::vector<Machine*> machines;
+    std::vector<Machine*> free_machines;
+    std::mutex free_mutex;
+    ThreadPool pool;
+
+    Machine* acquire();
+
+public:
+    SearchEngine(size_t capacity, unsigned int cycles_per_frame = 8, unsigned int thread_count = 0);
+    ~SearchEngine();
+
+    Machine* load(const std::string& program_name, std::uint64_t seed = 0);
+    Machine* clone(const Machine& state);
+    void step(Machine& state, unsigned short keys, unsigned int frames) const;
+    void expand(Expansion* expansions, size_t count);
+    void discard(Machine* state);
+    size_t getAvailable();
+};
+
+#endif //CHIP8_EMU_SEARCH_H
@@ -0,0 +1,62 @@
+#include <algorithm>
+#include "startup_timeline.h"
+
+/**
+ * Starts a timeline at the current time.
+ */
+StartupTimeline::StartupTimeline() : origin(std::chrono::steady_clock::now())
+{
+}
+
+/**
+ * Marks the end of a phase on the calling thread.
+ * @param phase - the name of the phase, which must outlive the timeline
+ */
+void StartupTimeline::mark(const char* phase)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+
+    std::thread::id id = std::this_thread::get_id();
+    auto thread = std::find(threads.begin(), threads.end(), id);
+    if (thread == threads.end())
+    {
+        thread = threads.insert(threads.end(), id);
+    }
+    unsigned int index = static_cast<unsigned int>(thread - threads.begin());
+
+    std::chrono::steady_clock::time_point start = origin;
+    for (const Mark& previous : marks)
+    {
+        if (previous.thread == index)
+        {
+            start = previous.end;
+        }
+    }
+    marks.push_back({phase, start, now, index});
+}
+
+/**
+ * Returns the time since the timeline started, in milliseconds.
+ */
+double StartupTimeline::getElapsedMilliseconds() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin).count();
+}
+
+/**
+ * Prints every phase with the thread it ran on, its start and end relative to the start of the timeline and its
+ * duration, in milliseconds.
+ */
+void StartupTimeline::print(std::FILE* file) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::fprintf(file, "Startup timeline (ms):\n");
+    for (const Mark& mark : marks)
+    {
+        std::chrono::duration<double, std::milli> start = mark.start - origin;
+        std::chrono::duration<double, std::milli> end = mark.end - origin;
+        std::fprintf(file, "  thread %u %8.3f - %8.3f %8.3f  %s\n", mark.thread, start.count(), end.count(),
+                end.count() - start.count(), mark.phase);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef CHIP8_EMU_STARTUP_TIMELINE_H
+#define CHIP8_EMU_STARTUP_TIMELINE_H
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Timestamps of the phases of startup, taken from any thread, relative to the creation of the timeline. Every
+ * phase ends at its mark and starts at the previous mark of the same thread, so that phases that run in parallel
+ * on different threads are reported with their own durations.
+ */
+class StartupTimeline
+{
+    struct Mark
+    {
+        const char* phase;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        unsigned int thread;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    mutable std::mutex mutex;
+    std::vector<Mark> marks;
+    std::vector<std::thread::id> threads;
+
+public:
+    StartupTimeline();
+
+    void mark(const char* phase);
+    double getElapsedMilliseconds() const;
+    void print(std::FILE* file) const;
+};
+
+#endif //CHIP8_EMU_STARTUP_TIMELINE_H
@@ -0,0 +1,528 @@
+#include <cstring>
+#include "state_codec.h"
+
+namespace
+{
+    constexpr unsigned char FLAG_SEED = 0x01;
+    constexpr unsigned char FLAG_HIGH_RES = 0x02;
+    constexpr unsigned char FLAG_FLAG_REGISTERS = 0x04;
+    constexpr unsigned char FLAG_DOUBLED = 0x08;
+    constexpr unsigned char FLAG_XO_CHIP = 0x10;
+    constexpr unsigned char FLAG_SECOND_PLANE = 0x20;
+    constexpr unsigned char FLAG_MEGA_CHIP = 0x40;
+    constexpr size_t MEGA_PAGES = Core::MEGA_RESOLUTION / Core::MEGA_PAGE_SIZE;
+    constexpr std::uint64_t EVEN_BITS = 0x5555555555555555;
+    constexpr size_t RAM_PAGES = Core::MEMORY_SIZE / Core::PAGE_SIZE;
+    constexpr size_t BLOCK_SIZE = 256;
+    constexpr size_t PAGE_BLOCKS = Core::PAGE_SIZE / BLOCK_SIZE;
+    constexpr size_t ROW_WORDS = Core::DISPLAY_WORDS / Core::HEIGHT;
+    static_assert(Core::HEIGHT <= 64, "Every display row needs a bit in the row mask");
+    static_assert(RAM_PAGES <= 64, "Every memory page needs a bit in the page mask");
+    static_assert(PAGE_BLOCKS <= 8, "Every block of a page needs a bit in the block mask");
+    static_assert(Core::PLANES == 2, "The flags byte marks the second plane only");
+
+    void putBytes(std::vector<unsigned char>& output, std::uint64_t value, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            output.push_back(static_cast<unsigned char>(value >> (8 * i)));
+        }
+    }
+
+    /**
+     * Determines whether the display consists of 2 x 2 pixels only, as drawn in low resolution mode.
+     */
+    bool isDoubled(const std::uint64_t* words)
+    {
+        for (size_t row = 0; row < Core::HEIGHT; row += 2)
+        {
+            for (size_t i = 0; i < ROW_WORDS; ++i)
+            {
+                std::uint64_t word = words[row * ROW_WORDS + i];
+                if (word != words[(row + 1) * ROW_WORDS + i] || (word & EVEN_BITS) != (word >> 1 & EVEN_BITS))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Keeps one bit of every pair of bits.
+     */
+    std::uint32_t halveBits(std::uint64_t word)
+    {
+        std::uint32_t bits = 0;
+        for (unsigned int bit = 0; bit < 32; ++bit)
+        {
+            bits |= static_cast<std::uint32_t>(word >> (2 * bit) & 1) << bit;
+        }
+        return bits;
+    }
+
+    /**
+     * Turns every bit into a pair of bits.
+     */
+    std::uint64_t doubleBits(std::uint32_t bits)
+    {
+        std::uint64_t word = 0;
+        for (unsigned int bit = 0; bit < 32; ++bit)
+        {
+            word |= static_cast<std::uint64_t>(bits >> bit & 1) * (std::uint64_t{3} << (2 * bit));
+        }
+        return word;
+    }
+
+    /**
+     * Appends a 16-bit mask of the pages of a colour display buffer that have been written, and those pages.
+     */
+    template<class Memory>
+    void putMegaPages(std::vector<unsigned char>& output, const Memory& memory)
+    {
+        unsigned short page_mask = 0;
+        for (size_t page = 0; page < MEGA_PAGES; ++page)
+        {
+            page_mask |= !memory.isZero(page) << page;
+        }
+        putBytes(output, page_mask, 2);
+        for (size_t page = 0; page < MEGA_PAGES; ++page)
+        {
+            if (page_mask >> page & 1)
+            {
+                auto data = reinterpret_cast<const unsigned char*>(memory.readPage(page));
+                output.insert(output.end(), data, data + Core::MEGA_PAGE_SIZE * sizeof(*memory.readPage(page)));
+            }
+        }
+    }
+
+    std::uint64_t getBytes(const unsigned char*& data, size_t size)
+    {
+        std::uint64_t value = 0;
+        for (size_t i = 0; i < size; ++i)
+        {
+            value |= static_cast<std::uint64_t>(*data++) << (8 * i);
+        }
+        return value;
+    }
+}
+
+/**
+ * Determines whether any MEGA-CHIP register, palette entry or pixel differs from its initial value.
+ */
+bool StateCodec::hasMegaChipState(const Core& core)
+{
+    if (core.mega_mode || core.sprite_width || core.sprite_height || core.blend_mode != BlendMode::NORMAL
+            || core.collision_color || core.screen_alpha != 0xFF)
+    {
+        return true;
+    }
+    for (std::uint32_t color : core.palette)
+    {
+        if (color)
+        {
+            return true;
+        }
+    }
+    for (size_t page = 0; page < MEGA_PAGES; ++page)
+    {
+        if (!core.mega_indices.isZero(page) || !core.mega_colors.isZero(page))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Creates a codec that encodes states relative to the specified base state, usually a core right after its
+ * program was loaded. The base must outlive the codec and must not change while the codec is in use.
+ */
+StateCodec::StateCodec(const Core& base) : base(base) {}
+
+/**
+ * Appends the packed state of the specified core to the output.
+ */
+void StateCodec::encode(const Core& core, std::vector<unsigned char>& output) const
+{
+    bool seed_differs = core.random.getSeed() != base.random.getSeed();
+    bool has_flag_registers = false;
+    for (unsigned char flag : core.flags)
+    {
+        has_flag_registers |= flag != 0;
+    }
+    bool has_xo_chip_state = core.plane_mask != 1 || core.pitch != Core::DEFAULT_PITCH
+            || std::memcmp(core.pattern, Core::DEFAULT_PATTERN, sizeof(core.pattern)) != 0;
+    bool has_second_plane = !core.display.isZero(1);
+    bool has_mega_chip_state = hasMegaChipState(core);
+    bool doubled = isDoubled(core.display.readPage(0)) && (!has_second_plane || isDoubled(core.display.readPage(1)));
+    output.push_back(static_cast<unsigned char>((seed_differs ? FLAG_SEED : 0) | (core.high_res ? FLAG_HIGH_RES : 0)
+            | (has_flag_registers ? FLAG_FLAG_REGISTERS : 0) | (doubled ? FLAG_DOUBLED : 0)
+            | (has_xo_chip_state ? FLAG_XO_CHIP : 0) | (has_second_plane ? FLAG_SECOND_PLANE : 0)
+            | (has_mega_chip_state ? FLAG_MEGA_CHIP : 0)));
+    putBytes(output, core.PC, 2);
+    putBytes(output, core.I, 2);
+    output.push_back(core.SP);
+    output.push_back(core.delay_timer.getValue());
+    output.push_back(core.sound_timer.getValue());
+
+    unsigned short wide = 0;
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        wide |= (core.V[x] > 0xF) << x;
+    }
+    putBytes(output, wide, 2);
+    unsigned char nibbles[8] = {};
+    size_t narrow = 0;
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        if (wide >> x & 1)
+        {
+            output.push_back(core.V[x]);
+        }
+        else
+        {
+            nibbles[narrow / 2] |= core.V[x] << (4 * (narrow % 2));
+            ++narrow;
+        }
+    }
+    output.insert(output.end(), nibbles, nibbles + (narrow + 1) / 2);
+
+    unsigned short stack_mask = 0;
+    for (unsigned char level = 0; level < Core::STACK_DEPTH; ++level)
+    {
+        stack_mask |= (core.stack[level] != 0) << level;
+    }
+    putBytes(output, stack_mask, 2);
+    for (unsigned short entry : core.stack)
+    {
+        if (entry)
+        {
+            putBytes(output, entry, 2);
+        }
+    }
+
+    if (has_flag_registers)
+    {
+        output.insert(output.end(), core.flags, core.flags + sizeof(core.flags));
+    }
+    if (has_xo_chip_state)
+    {
+        output.push_back(core.plane_mask);
+        output.push_back(core.pitch);
+        output.insert(output.end(), core.pattern, core.pattern + sizeof(core.pattern));
+    }
+    if (seed_differs)
+    {
+        putBytes(output, core.random.getSeed(), 8);
+    }
+    for (std::uint64_t counter = core.random.getCounter(); ; counter >>= 7)
+    {
+        output.push_back(static_cast<unsigned char>((counter & 0x7F) | (counter > 0x7F ? 0x80 : 0)));
+        if (counter <= 0x7F)
+        {
+            break;
+        }
+    }
+
+    for (unsigned char plane = 0; plane < (has_second_plane ? 2 : 1); ++plane)
+    {
+        const std::uint64_t* words = core.display.readPage(plane);
+        size_t row_mask_offset = output.size();
+        std::uint64_t row_mask = 0;
+        putBytes(output, 0, 8);
+        for (size_t row = 0; row < Core::HEIGHT; row += doubled ? 2 : 1)
+        {
+            const std::uint64_t* pixels = words + row * ROW_WORDS;
+            if (!(pixels[0] | pixels[1]))
+            {
+                continue;
+            }
+            row_mask |= std::uint64_t{1} << row;
+            if (doubled)
+            {
+                putBytes(output, static_cast<std::uint64_t>(halveBits(pixels[0])) << 32 | halveBits(pixels[1]), 8);
+            }
+            else
+            {
+                putBytes(output, pixels[0], 8);
+                putBytes(output, pixels[1], 8);
+            }
+        }
+        for (size_t i = 0; i < 8; ++i)
+        {
+            output[row_mask_offset + i] = static_cast<unsigned char>(row_mask >> (8 * i));
+        }
+    }
+
+    size_t page_mask_offset = output.size();
+    std::uint64_t page_mask = 0;
+    putBytes(output, 0, 8);
+    for (size_t page = 0; page < RAM_PAGES; ++page)
+    {
+        const unsigned char* data = core.ram.readPage(page);
+        const unsigned char* base_data = base.ram.readPage(page);
+        if (data == base_data)
+        {
+            continue;
+        }
+        unsigned char block_mask = 0;
+        for (size_t block = 0; block < PAGE_BLOCKS; ++block)
+        {
+            block_mask |= (std::memcmp(data + block * BLOCK_SIZE, base_data + block * BLOCK_SIZE, BLOCK_SIZE) != 0)
+                    << block;
+        }
+        if (!block_mask)
+        {
+            continue;
+        }
+        page_mask |= std::uint64_t{1} << page;
+        output.push_back(block_mask);
+        for (size_t block = 0; block < PAGE_BLOCKS; ++block)
+        {
+            if (block_mask >> block & 1)
+            {
+                output.insert(output.end(), data + block * BLOCK_SIZE, data + (block + 1) * BLOCK_SIZE);
+            }
+        }
+    }
+    for (size_t i = 0; i < 8; ++i)
+    {
+        output[page_mask_offset + i] = static_cast<unsigned char>(page_mask >> (8 * i));
+    }
+
+    if (has_mega_chip_state)
+    {
+        output.push_back(core.mega_mode);
+        output.push_back(core.sprite_width);
+        output.push_back(core.sprite_height);
+        output.push_back(static_cast<unsigned char>(core.blend_mode));
+        output.push_back(core.collision_color);
+        output.push_back(core.screen_alpha);
+        unsigned char palette_mask[sizeof(core.palette) / sizeof(*core.palette) / 8] = {};
+        for (size_t index = 0; index < sizeof(core.palette) / sizeof(*core.palette); ++index)
+        {
+            palette_mask[index / 8] |= (core.palette[index] != 0) << (index % 8);
+        }
+        output.insert(output.end(), palette_mask, palette_mask + sizeof(palette_mask));
+        for (std::uint32_t color : core.palette)
+        {
+            if (color)
+            {
+                putBytes(output, color, 4);
+            }
+        }
+        putMegaPages(output, core.mega_indices);
+        putMegaPages(output, core.mega_colors);
+    }
+}
+
+/**
+ * Restores a core from a packed state.
+ * @param data - the packed state
+ * @param core - the core to restore
+ * @return the number of bytes of the packed state
+ */
+size_t StateCodec::decode(const unsigned char* data, Core& core) const
+{
+    const unsigned char* start = data;
+    unsigned char flags = *data++;
+    core.PC = static_cast<unsigned short>(getBytes(data, 2));
+    core.I = static_cast<unsigned short>(getBytes(data, 2));
+    core.SP = *data++;
+    core.delay_timer.setValue(*data++);
+    core.sound_timer.setValue(*data++);
+
+    auto wide = static_cast<unsigned short>(getBytes(data, 2));
+    size_t wide_count = 0;
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        wide_count += wide >> x & 1;
+    }
+    const unsigned char* nibbles = data + wide_count;
+    size_t narrow = 0;
+    for (unsigned char x = 0; x < 16; ++x)
+    {
+        if (wide >> x & 1)
+        {
+            core.V[x] = *data++;
+        }
+        else
+        {
+            core.V[x] = nibbles[narrow / 2] >> (4 * (narrow % 2)) & 0xF;
+            ++narrow;
+        }
+    }
+    data = nibbles + (narrow + 1) / 2;
+
+    auto stack_mask = static_cast<unsigned short>(getBytes(data, 2));
+    for (unsigned char level = 0; level < Core::STACK_DEPTH; ++level)
+    {
+        core.stack[level] = stack_mask >> level & 1 ? static_cast<unsigned short>(getBytes(data, 2)) : 0;
+    }
+
+    core.high_res = flags & FLAG_HIGH_RES;
+    std::memset(core.flags, 0, sizeof(core.flags));
+    if (flags & FLAG_FLAG_REGISTERS)
+    {
+        std::memcpy(core.flags, data, sizeof(core.flags));
+        data += sizeof(core.flags);
+    }
+    core.plane_mask = 1;
+    core.pitch = Core::DEFAULT_PITCH;
+    std::memcpy(core.pattern, Core::DEFAULT_PATTERN, sizeof(core.pattern));
+    if (flags & FLAG_XO_CHIP)
+    {
+        core.plane_mask = *data++;
+        core.pitch = *data++;
+        std::memcpy(core.pattern, data, sizeof(core.pattern));
+        data += sizeof(core.pattern);
+    }
+
+    std::uint64_t seed = flags & FLAG_SEED ? getBytes(data, 8) : base.random.getSeed();
+    std::uint64_t counter = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        counter |= static_cast<std::uint64_t>(*data & 0x7F) << shift;
+        if (!(*data++ & 0x80))
+        {
+            break;
+        }
+    }
+    core.random.setState(seed, counter);
+
+    core.display.clear();
+    for (unsigned char plane = 0; plane < (flags & FLAG_SECOND_PLANE ? 2 : 1); ++plane)
+    {
+        std::uint64_t row_mask = getBytes(data, 8);
+        if (!row_mask)
+        {
+            continue;
+        }
+        std::uint64_t* words = core.display.writablePage(plane);
+        for (size_t row = 0; row < Core::HEIGHT; ++row)
+        {
+            if (!(row_mask >> row & 1))
+            {
+                continue;
+            }
+            if (flags & FLAG_DOUBLED)
+            {
+                std::uint64_t bits = getBytes(data, 8);
+                std::uint64_t left = doubleBits(static_cast<std::uint32_t>(bits >> 32));
+                std::uint64_t right = doubleBits(static_cast<std::uint32_t>(bits));
+                words[row * ROW_WORDS] = words[(row + 1) * ROW_WORDS] = left;
+                words[row * ROW_WORDS + 1] = words[(row + 1) * ROW_WORDS + 1] = right;
+            }
+            else
+            {
+                words[row * ROW_WORDS] = getBytes(data, 8);
+                words[row * ROW_WORDS + 1] = getBytes(data, 8);
+            }
+        }
+    }
+
+    std::uint64_t page_mask = getBytes(data, 8);
+    core.ram = base.ram;
+    for (size_t page = 0; page < RAM_PAGES; ++page)
+    {
+        if (!(page_mask >> page & 1))
+        {
+            continue;
+        }
+        unsigned char block_mask = *data++;
+        unsigned char* page_data = core.ram.writablePage(page);
+        for (size_t block = 0; block < PAGE_BLOCKS; ++block)
+        {
+            if (block_mask >> block & 1)
+            {
+                std::memcpy(page_data + block * BLOCK_SIZE, data, BLOCK_SIZE);
+                data += BLOCK_SIZE;
+            }
+        }
+    }
+
+    core.mega_mode = false;
+    core.sprite_width = 0;
+    core.sprite_height = 0;
+    core.blend_mode = BlendMode::NORMAL;
+    core.collision_color = 0;
+    core.screen_alpha = 0xFF;
+    std::memset(core.palette, 0, sizeof(core.palette));
+    core.mega_indices.clear();
+    core.mega_colors.clear();
+    if (flags & FLAG_MEGA_CHIP)
+    {
+        core.mega_mode = *data++ != 0;
+        core.sprite_width = *data++;
+        core.sprite_height = *data++;
+        core.blend_mode = static_cast<BlendMode>(*data++);
+        core.collision_color = *data++;
+        core.screen_alpha = *data++;
+        const unsigned char* palette_mask = data;
+        data += sizeof(core.palette) / sizeof(*core.palette) / 8;
+        for (size_t index = 0; index < sizeof(core.palette) / sizeof(*core.palette); ++index)
+        {
+            if (palette_mask[index / 8] >> (index % 8) & 1)
+            {
+                core.palette[index] = static_cast<std::uint32_t>(getBytes(data, 4));
+            }
+        }
+        auto index_pages = static_cast<unsigned short>(getBytes(data, 2));
+        for (size_t page = 0; page < MEGA_PAGES; ++page)
+        {
+            if (index_pages >> page & 1)
+            {
+                std::memcpy(core.mega_indices.writablePage(page), data, Core::MEGA_PAGE_SIZE);
+                data += Core::MEGA_PAGE_SIZE;
+            }
+        }
+        auto color_pages = static_cast<unsigned short>(getBytes(data, 2));
+        for (size_t page = 0; page < MEGA_PAGES; ++page)
+        {
+            if (color_pages >> page & 1)
+            {
+                std::memcpy(core.mega_colors.writablePage(page), data, Core::MEGA_PAGE_SIZE * sizeof(std::uint32_t));
+                data += Core::MEGA_PAGE_SIZE * sizeof(std::uint32_t);
+            }
+        }
+    }
+
+    core.rehash();
+    core.draw_display = true;
+    return static_cast<size_t>(data - start);
+}
+
+/**
+ * Appends the packed states of several cores to the output.
+ * @param cores - the cores to encode
+ * @param count - the number of cores
+ * @param output - the buffer that receives the packed states back to back
+ * @param offsets - receives the offset of every packed state in the output
+ */
+void StateCodec::encodeBatch(const Core* const* cores, size_t count, std::vector<unsigned char>& output,
+        std::vector<size_t>& offsets) const
+{
+    output.reserve(output.size() + count * 64);
+    for (size_t i = 0; i < count; ++i)
+    {
+        offsets.push_back(output.size());
+        encode(*cores[i], output);
+    }
+}
+
+/**
+ * Restores several cores from packed states.
+ * @param data - the buffer holding the packed states
+ * @param offsets - the offset of every packed state in the buffer
+ * @param cores - the cores to restore
+ * @param count - the number of cores
+ */
+void StateCodec::decodeBatch(const unsigned char* data, const size_t* offsets, Core* const* cores,
+        size_t count) const
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        decode(data + offsets[i], *cores[i]);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef CHIP8_EMU_STATE_CODEC_H
+#define CHIP8_EMU_STATE_CODEC_H
+
+#include "core.h"
+#include <cstddef>
+#include <vector>
+
+/**
+ * Encodes machine states compactly, for keeping millions of them in memory during search and rewind.
+ * A packed state stores, in order:
+ *  - a flags byte (bit 0: the random seed differs from the base state's, bit 1: high resolution mode,
+ *    bit 2: a flag register is set, bit 3: every plane consists of 2 x 2 pixels only, bit 4: the plane mask,
+ *    pitch or audio pattern differ from their defaults, bit 5: the second display plane has any pixel set,
+ *    bit 6: a MEGA-CHIP register, palette entry or pixel differs from its initial value)
+ *  - PC and I as 16 bits each, then SP, the delay timer and the sound timer
+ *  - a 16-bit mask of the registers above 0xF, those registers as bytes, then the others as packed nibbles
+ *  - a 16-bit mask of the non-zero stack entries, and those entries
+ *  - the 16 flag registers, the plane mask, pitch and audio pattern and the random seed (only if flagged), and the
+ *    random counter as a variable-length integer
+ *  - for every stored plane, a 64-bit mask of the display rows with any pixel set, and those rows at one bit per
+ *    pixel (16 bytes), or if the display is doubled, only the even rows at one bit per 2 x 2 pixels (8 bytes)
+ *  - a 64-bit mask of the memory pages that differ from the base state, and for each of those a byte masking the
+ *    256-byte blocks that differ, and those blocks
+ *  - if flagged, the MEGA-CHIP registers, a 256-bit mask of the non-zero palette entries and those entries, then
+ *    for the indices and the colours of the colour display a 16-bit mask of the non-zero pages, and those pages
+ * Decoded cores share unchanged pages with the base state.
+ */
+class StateCodec
+{
+    const Core& base;
+
+    static bool hasMegaChipState(const Core& core);
+
+public:
+    explicit StateCodec(const Core& base);
+
+    void encode(const Core& core, std::vector<unsigned char>& output) const;
+    size_t decode(const unsigned char* data, Core& core) const;
+    void encodeBatch(const Core* const* cores, size_t count, std::vector<unsigned char>& output,
+            std::vector<size_t>& offsets) const;
+    void decodeBatch(const unsigned char* data, const size_t* offsets, Core* const* cores, size_t count) const;
+};
+
+#endif //CHIP8_EMU_STATE_CODEC_H
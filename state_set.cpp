@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include "state_set.h"
+
+namespace
+{
+    /**
+     * The value of an empty slot. The key 0 is stored as 1 instead.
+     */
+    constexpr std::uint64_t EMPTY = 0;
+
+    std::uint64_t bloomBit(std::uint64_t key, size_t i, size_t bit_count)
+    {
+        return (key + i * ((key >> 32) | 1)) % bit_count;
+    }
+}
+
+/**
+ * Creates an empty set.
+ * @param memory_budget - the number of bytes the set may use in memory; half goes to the hash table
+ * @param spill_prefix - the path prefix of the run files written when the table fills up
+ */
+StateSet::StateSet(size_t memory_budget, const std::string& spill_prefix) : spill_prefix(spill_prefix)
+{
+    capacity = 1024;
+    while (capacity * 2 * sizeof(std::uint64_t) <= memory_budget / 2)
+    {
+        capacity *= 2;
+    }
+    slots.reset(new std::atomic<std::uint64_t>[capacity]);
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        slots[i].store(EMPTY, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Removes the run files.
+ */
+StateSet::~StateSet()
+{
+    for (Run& run : runs)
+    {
+        std::fclose(run.file);
+        std::remove(run.file_name.c_str());
+    }
+}
+
+/**
+ * Inserts a key. Safe to call from several threads at once, but not concurrently with spill().
+ * @return true if the key was not in the set yet
+ */
+bool StateSet::insert(std::uint64_t key)
+{
+    key = key == EMPTY ? 1 : key;
+
+    size_t mask = capacity - 1;
+    size_t slot = (key ^ key >> 29) & mask;
+    while (true)
+    {
+        std::uint64_t current = slots[slot].load(std::memory_order_acquire);
+        if (current == key)
+        {
+            return false;
+        }
+        if (current == EMPTY)
+        {
+            if (containsSpilled(key))
+            {
+                return false;
+            }
+            if (slots[slot].compare_exchange_strong(current, key, std::memory_order_acq_rel))
+            {
+                table_size.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            if (current == key)
+            {
+                return false;
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * Determines whether the specified number of keys can be inserted without filling the table.
+ * If not, spill() must be called first.
+ */
+bool StateSet::hasRoomFor(size_t count) const
+{
+    return (table_size.load(std::memory_order_relaxed) + count) * 10 <= capacity * 7;
+}
+
+/**
+ * Writes the contents of the table to disk as a sorted run and empties the table.
+ * Must not be called concurrently with insert().
+ */
+void StateSet::spill()
+{
+    std::vector<std::uint64_t> keys;
+    keys.reserve(table_size);
+    for (size_t i = 0; i < capacity; ++i)
+    {
+        std::uint64_t key = slots[i].load(std::memory_order_relaxed);
+        if (key != EMPTY)
+        {
+            keys.push_back(key);
+            slots[i].store(EMPTY, std::memory_order_relaxed);
+        }
+    }
+    table_size = 0;
+    if (keys.empty())
+    {
+        return;
+    }
+    std::sort(keys.begin(), keys.end());
+
+    Run run{};
+    run.file_name = spill_prefix + std::to_string(runs.size()) + ".run";
+    run.file = std::fopen(run.file_name.c_str(), "w+b");
+    if (!run.file || std::fwrite(keys.data(), sizeof(std::uint64_t), keys.size(), run.file) != keys.size()
+            || std::fflush(run.file) != 0)
+    {
+        std::cerr << "ERROR: File " << run.file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+    run.size = keys.size();
+    run.mutex.reset(new std::mutex);
+
+    for (size_t i = 0; i < keys.size(); i += INDEX_STRIDE)
+    {
+        run.index.push_back(keys[i]);
+    }
+    size_t bit_count = keys.size() * BLOOM_BITS_PER_KEY;
+    run.bloom.assign((bit_count + 63) / 64, 0);
+    for (std::uint64_t key : keys)
+    {
+        for (size_t i = 0; i < BLOOM_HASHES; ++i)
+        {
+            std::uint64_t bit = bloomBit(key, i, bit_count);
+            run.bloom[bit / 64] |= std::uint64_t{1} << (bit % 64);
+        }
+    }
+
+    spilled_size += run.size;
+    runs.push_back(std::move(run));
+}
+
+bool StateSet::containsSpilled(std::uint64_t key) const
+{
+    for (const Run& run : runs)
+    {
+        size_t bit_count = run.size * BLOOM_BITS_PER_KEY;
+        bool maybe = true;
+        for (size_t i = 0; i < BLOOM_HASHES && maybe; ++i)
+        {
+            std::uint64_t bit = bloomBit(key, i, bit_count);
+            maybe = run.bloom[bit / 64] >> (bit % 64) & 1;
+        }
+        if (!maybe)
+        {
+            continue;
+        }
+
+        auto block = std::upper_bound(run.index.begin(), run.index.end(), key);
+        if (block == run.index.begin())
+        {
+            continue;
+        }
+        size_t first = static_cast<size_t>(block - run.index.begin() - 1) * INDEX_STRIDE;
+        size_t count = std::min(INDEX_STRIDE, run.size - first);
+
+        std::uint64_t keys[INDEX_STRIDE];
+        {
+            std::lock_guard<std::mutex> lock(*run.mutex);
+            std::fseek(run.file, static_cast<long>(first * sizeof(std::uint64_t)), SEEK_SET);
+            count = std::fread(keys, sizeof(std::uint64_t), count, run.file);
+        }
+        if (std::binary_search(keys, keys + count, key))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Returns the number of keys in the set, in memory and on disk.
+ */
+size_t StateSet::getSize() const
+{
+    return table_size.load(std::memory_order_relaxed) + spilled_size;
+}
+
+/**
+ * Returns the number of runs that have been spilled to disk.
+ */
+size_t StateSet::getRunCount() const
+{
+    return runs.size();
+}
@@ -0,0 +1,56 @@
+#ifndef CHIP8_EMU_STATE_SET_H
+#define CHIP8_EMU_STATE_SET_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * A concurrent set of 64-bit state hashes with a memory budget.
+ * Hashes are inserted lock-free into an open-addressing table. When the table fills up, its contents are
+ * spilled to disk as a sorted run; each run keeps a Bloom filter and a sparse index in memory, so that
+ * looking up a hash that was never inserted rarely touches the disk.
+ */
+class StateSet
+{
+    static constexpr size_t INDEX_STRIDE = 512;
+    static constexpr size_t BLOOM_BITS_PER_KEY = 10;
+    static constexpr size_t BLOOM_HASHES = 4;
+
+    struct Run
+    {
+        FILE* file;
+        std::string file_name;
+        size_t size;
+        std::vector<std::uint64_t> index;
+        std::vector<std::uint64_t> bloom;
+        std::unique_ptr<std::mutex> mutex;
+    };
+
+    std::unique_ptr<std::atomic<std::uint64_t>[]> slots;
+    size_t capacity;
+    std::atomic<size_t> table_size{0};
+    size_t spilled_size = 0;
+    std::vector<Run> runs;
+    std::string spill_prefix;
+
+    bool containsSpilled(std::uint64_t key) const;
+
+public:
+    StateSet(size_t memory_budget, const std::string& spill_prefix);
+    ~StateSet();
+    StateSet(const StateSet&) = delete;
+    StateSet& operator=(const StateSet&) = delete;
+
+    bool insert(std::uint64_t key);
+    bool hasRoomFor(size_t count) const;
+    void spill();
+    size_t getSize() const;
+    size_t getRunCount() const;
+};
+
+#endif //CHIP8_EMU_STATE_SET_H
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include "thread_pool.h"
+
+/**
+ * Starts the worker threads.
+ * @param thread_count - the total number of threads including the caller, or 0 for one per hardware thread
+ */
+ThreadPool::ThreadPool(unsigned int thread_count)
+{
+    if (thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    for (unsigned int i = 1; i < thread_count; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+/**
+ * Stops and joins the worker threads.
+ */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+/**
+ * Returns the number of threads that run a loop, including the caller.
+ */
+unsigned int ThreadPool::getThreadCount() const
+{
+    return static_cast<unsigned int>(workers.size() + 1);
+}
+
+/**
+ * Calls task(context, i) for every i in [0, count) on the pool and waits until all calls have returned.
+ */
+void ThreadPool::run(size_t count, void (*task)(void*, size_t), void* context)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = task;
+        this->context = context;
+        task_count = count;
+        next_task = 0;
+        busy_workers = workers.size();
+        ++generation;
+    }
+    work_available.notify_all();
+
+    runTasks();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return busy_workers == 0; });
+}
+
+void ThreadPool::runTasks()
+{
+    for (size_t i = next_task++; i < task_count; i = next_task++)
+    {
+        task(context, i);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned long seen_generation = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+        if (stopping)
+        {
+            return;
+        }
+        seen_generation = generation;
+
+        lock.unlock();
+        runTasks();
+        lock.lock();
+
+        if (--busy_workers == 0)
+        {
+            work_done.notify_one();
+        }
+    }
+}
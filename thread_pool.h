@@ -0,0 +1,52 @@
+#ifndef CHIP8_EMU_THREAD_POOL_H
+#define CHIP8_EMU_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed set of worker threads that run parallel loops. The calling thread takes part in every loop.
+ * Running a loop does not allocate.
+ */
+class ThreadPool
+{
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+
+    void (*task)(void*, size_t) = nullptr;
+    void* context = nullptr;
+    size_t task_count = 0;
+    std::atomic<size_t> next_task{0};
+    size_t busy_workers = 0;
+    unsigned long generation = 0;
+    bool stopping = false;
+
+    void runTasks();
+    void workerLoop();
+
+public:
+    explicit ThreadPool(unsigned int thread_count = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned int getThreadCount() const;
+    void run(size_t count, void (*task)(void*, size_t), void* context);
+
+    /**
+     * Calls function(i) for every i in [0, count) on the pool and waits until all calls have returned.
+     */
+    template<class Function>
+    void forEach(size_t count, Function& function)
+    {
+        run(count, [](void* context, size_t i) { (*static_cast<Function*>(context))(i); }, &function);
+    }
+};
+
+#endif //CHIP8_EMU_THREAD_POOL_H
@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "coverage.h"
+#include "machine.h"
+#include "recording.h"
+
+namespace
+{
+    const unsigned int PROGRAM_ADDRESS = 0x200;
+
+    /**
+     * Runs a program without input, or replays a recording (.c8r) from its first keyframe, with a coverage
+     * attached to the core.
+     */
+    void run(const std::string& name, Machine& machine, Coverage& coverage, QuirkProfile quirks, unsigned int frames,
+            unsigned int cycles_per_frame)
+    {
+        machine.core.initialize();
+        std::vector<unsigned short> inputs;
+        bool is_recording = name.size() > 4 && name.compare(name.size() - 4, 4, ".c8r") == 0;
+        if (is_recording)
+        {
+            auto recording = std::make_unique<Recording>();
+            recording->load(name);
+            machine.core.setQuirks(recording->quirks);
+            machine.core.loadState(recording->keyframes.front().state);
+            inputs = recording->inputs;
+            cycles_per_frame = recording->cycles_per_frame;
+        }
+        else
+        {
+            machine.core.setQuirks(quirks);
+            machine.core.loadProgram(name);
+            inputs.assign(frames, 0);
+        }
+
+        machine.core.setCoverage(&coverage);
+        for (unsigned short keys : inputs)
+        {
+            machine.runFrame(keys, cycles_per_frame);
+        }
+        machine.core.setCoverage(nullptr);
+    }
+}
+
+/**
+ * Measures the code coverage of programs and recordings. Every input is run with its own coverage, which is merged
+ * into the total; the number of executed addresses each input added to the total is printed, so that inputs that
+ * reach new code stand out. The total can be kept in a file across runs, and written as a report with the
+ * disassembly of the last input.
+ * Usage: chip8_coverage [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-a] [-b bitmap_file] [-o report]
+ *                       program_or_recording...
+ * -a also tracks the bytes read and written as data; -b loads the total from the file if it exists, and saves it.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int frames = 3600;
+    unsigned int cycles_per_frame = 8;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    bool track_accesses = false;
+    std::string bitmap_name;
+    std::string report_name;
+    std::vector<std::string> names;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-a"))
+        {
+            track_accesses = true;
+        }
+        else if (!std::strcmp(argv[arg], "-b") && has_value)
+        {
+            bitmap_name = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            report_name = argv[++arg];
+        }
+        else
+        {
+            names.emplace_back(argv[arg]);
+        }
+    }
+    if (names.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_coverage [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-a] "
+                "[-b bitmap_file] [-o report] program_or_recording...\n");
+        return 2;
+    }
+
+    auto total = std::make_unique<Coverage>();
+    auto coverage = std::make_unique<Coverage>();
+    total->track_accesses = track_accesses;
+    coverage->track_accesses = track_accesses;
+    try
+    {
+        if (!bitmap_name.empty())
+        {
+            std::FILE* existing = std::fopen(bitmap_name.c_str(), "rb");
+            if (existing)
+            {
+                std::fclose(existing);
+                total->load(bitmap_name);
+            }
+        }
+
+        auto machine = std::make_unique<Machine>();
+        for (const std::string& name : names)
+        {
+            coverage->clear();
+            run(name, *machine, *coverage, quirks, frames, cycles_per_frame);
+            size_t new_addresses = total->merge(*coverage);
+            std::printf("%s: %zu addresses executed, %zu new\n", name.c_str(), Coverage::count(coverage->executed),
+                    new_addresses);
+        }
+        std::printf("total: %zu addresses executed\n", Coverage::count(total->executed));
+
+        if (!bitmap_name.empty())
+        {
+            total->save(bitmap_name);
+        }
+        if (!report_name.empty())
+        {
+            // Report from where programs are loaded up to the last address the program touched
+            unsigned int end = PROGRAM_ADDRESS;
+            for (unsigned int address = PROGRAM_ADDRESS; address < getMemorySize(machine->core.getQuirks()); ++address)
+            {
+                if (Coverage::isMarked(total->executed, address) || Coverage::isMarked(total->read, address)
+                        || Coverage::isMarked(total->written, address))
+                {
+                    end = address + 2;
+                }
+            }
+            std::FILE* report = std::fopen(report_name.c_str(), "w");
+            if (!report)
+            {
+                std::cerr << "ERROR: File " << report_name << " could not be written." << std::endl;
+                return 1;
+            }
+            total->writeReport(report, machine->core, PROGRAM_ADDRESS, end);
+            std::fclose(report);
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "explorer.h"
+
+namespace
+{
+    bool parseTarget(const char* text, ExploreTarget& target)
+    {
+        target.kind = ExploreTarget::MEMORY;
+        if (std::sscanf(text, "ram[%hi]=%hi", &target.index, &target.value) == 2)
+        {
+            return true;
+        }
+        target.kind = ExploreTarget::REGISTER;
+        if (std::sscanf(text, "V%hx=%hi", &target.index, &target.value) == 2 && target.index < 16)
+        {
+            return true;
+        }
+        target.kind = ExploreTarget::PROGRAM_COUNTER;
+        target.index = 0;
+        return std::sscanf(text, "PC=%hi", &target.value) == 1;
+    }
+}
+
+/**
+ * Explores the states that a program can reach when a single key, or no key, is held every frame, and prints
+ * the shortest input path to each target condition.
+ * Usage: chip8_explore [-d max_depth] [-m budget_mb] [-j threads] [-c cycles_per_frame] [-s spill_prefix]
+ *                      [-q quirk_profile] [-t target]... [-x] program
+ * Targets are written as ram[0x3F0]=1, V3=7 or PC=0x24A; -x stops as soon as all targets have been reached.
+ */
+int main(int argc, char *argv[])
+{
+    Explorer explorer{};
+    std::vector<ExploreTarget> targets;
+    std::vector<std::string> descriptions;
+    std::string program_name;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-d") && has_value)
+        {
+            explorer.max_depth = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-m") && has_value)
+        {
+            explorer.memory_budget = std::strtoull(argv[++arg], nullptr, 10) << 20;
+        }
+        else if (!std::strcmp(argv[arg], "-j") && has_value)
+        {
+            explorer.thread_count = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            explorer.cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-s") && has_value)
+        {
+            explorer.spill_prefix = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-t") && has_value)
+        {
+            ExploreTarget target{};
+            if (!parseTarget(argv[++arg], target))
+            {
+                std::cerr << "ERROR: Invalid target " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+            targets.push_back(target);
+            descriptions.emplace_back(argv[arg]);
+        }
+        else if (!std::strcmp(argv[arg], "-x"))
+        {
+            explorer.stop_when_found = true;
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty() || targets.size() > 64)
+    {
+        std::cerr << "Usage: chip8_explore [-d max_depth] [-m budget_mb] [-j threads] [-c cycles_per_frame] "
+                "[-s spill_prefix] [-q quirk_profile] [-t target]... [-x] program" << std::endl;
+        return 2;
+    }
+
+    Machine root{};
+    root.core.initialize();
+    root.core.setQuirks(quirks);
+    try
+    {
+        root.core.loadProgram(program_name);
+    }
+    catch (int)
+    {
+        return 1;
+    }
+
+    std::vector<size_t> counts = explorer.explore(root, targets);
+    size_t total = 0;
+    for (size_t depth = 0; depth < counts.size(); ++depth)
+    {
+        total += counts[depth];
+        std::printf("depth %zu: %zu new states, %zu reachable\n", depth, counts[depth], total);
+    }
+
+    for (size_t target = 0; target < targets.size(); ++target)
+    {
+        if (!targets[target].found)
+        {
+            std::printf("%s: not reached\n", descriptions[target].c_str());
+            continue;
+        }
+        std::printf("%s: reached after %zu frames:", descriptions[target].c_str(), targets[target].path.size());
+        for (unsigned char input : targets[target].path)
+        {
+            if (input == Explorer::NO_KEY)
+            {
+                std::printf(" -");
+            }
+            else
+            {
+                std::printf(" %X", input);
+            }
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
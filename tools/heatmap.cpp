@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "heatmap.h"
+#include "machine.h"
+#include "recording.h"
+
+/**
+ * Runs a program headless, or replays a recording (.c8r) from its first keyframe with its inputs, with a heatmap
+ * attached to the core. Prints the accesses of every memory region, the call stack traffic and the hottest data
+ * addresses, and writes the heatmap as a PPM image if asked to.
+ * Usage: chip8_heatmap [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-n hottest] [-s scale] [-o image]
+ *                      program
+ * Programs run for the given number of frames without input; recordings run for all their frames.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int frames = 3600;
+    unsigned int cycles_per_frame = 8;
+    unsigned int hottest = 16;
+    unsigned int scale = 4;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    std::string image_name;
+    std::string program_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-n") && has_value)
+        {
+            hottest = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-s") && has_value)
+        {
+            scale = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            image_name = argv[++arg];
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_heatmap [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-n hottest] "
+                "[-s scale] [-o image] program\n");
+        return 2;
+    }
+
+    auto machine = std::make_unique<Machine>();
+    auto heatmap = std::make_unique<Heatmap>();
+    machine->core.initialize();
+    std::vector<unsigned short> inputs;
+    try
+    {
+        bool is_recording = program_name.size() > 4
+                && program_name.compare(program_name.size() - 4, 4, ".c8r") == 0;
+        if (is_recording)
+        {
+            auto recording = std::make_unique<Recording>();
+            recording->load(program_name);
+            machine->core.setQuirks(recording->quirks);
+            machine->core.loadState(recording->keyframes.front().state);
+            inputs = recording->inputs;
+            cycles_per_frame = recording->cycles_per_frame;
+        }
+        else
+        {
+            machine->core.setQuirks(quirks);
+            machine->core.loadProgram(program_name);
+            inputs.assign(frames, 0);
+        }
+
+        machine->core.setHeatmap(heatmap.get());
+        for (unsigned short keys : inputs)
+        {
+            machine->runFrame(keys, cycles_per_frame);
+        }
+        machine->core.setHeatmap(nullptr);
+
+        unsigned int memory_size = getMemorySize(machine->core.getQuirks());
+        heatmap->writeSummary(stdout, memory_size, hottest);
+        if (!image_name.empty())
+        {
+            heatmap->writeImage(image_name, memory_size, scale);
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "quirk_detector.h"
+
+/**
+ * Detects the quirk profile of every program and prints it with the evidence of each profile: faults, runs in
+ * which PC escaped the program and runs that ended with a blank display.
+ * Usage: chip8_quirks [-c cache_file] [-j threads] [-f frames] program...
+ */
+int main(int argc, char *argv[])
+{
+    std::string cache_file_name;
+    unsigned int thread_count = 0;
+    unsigned int frames = 300;
+    std::vector<std::string> program_names;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cache_file_name = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "-j") && has_value)
+        {
+            thread_count = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else
+        {
+            program_names.emplace_back(argv[arg]);
+        }
+    }
+    if (program_names.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_quirks [-c cache_file] [-j threads] [-f frames] program...\n");
+        return 2;
+    }
+
+    QuirkDetector detector(cache_file_name, thread_count);
+    detector.frames = frames;
+    int failed_programs = 0;
+    for (const std::string& program_name : program_names)
+    {
+        QuirkReport report{};
+        try
+        {
+            std::vector<unsigned char> program = Core::readProgram(program_name);
+            report = detector.detect(program.data(), program.size());
+        }
+        catch (int)
+        {
+            ++failed_programs;
+            continue;
+        }
+
+        std::printf("%s: %s", program_name.c_str(), getQuirkProfileName(report.profile));
+        if (report.cached)
+        {
+            std::printf(" (cached)\n");
+            continue;
+        }
+        std::printf(report.divergent ? "\n" : " (profiles agree)\n");
+        for (size_t profile = 0; profile < static_cast<size_t>(QuirkProfile::COUNT); ++profile)
+        {
+            const QuirkEvidence& evidence = report.evidence[profile];
+            std::printf("  %-8s penalty %4d: %u invalid opcodes, %u stack faults, %u escapes, %u blank runs\n",
+                    getQuirkProfileName(static_cast<QuirkProfile>(profile)), evidence.penalty,
+                    evidence.faults.invalid_opcodes, evidence.faults.stack_overflows + evidence.faults.stack_underflows,
+                    evidence.pc_escapes, evidence.blank_runs);
+        }
+    }
+    return failed_programs ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "machine.h"
+#include "recording.h"
+
+namespace
+{
+    /**
+     * Reads an input script: the key mask of every frame as a hexadecimal number, separated by whitespace, in which
+     * bit n is set if key n is held.
+     */
+    bool readInputs(const std::string& file_name, std::vector<unsigned short>& inputs)
+    {
+        std::FILE* file = std::fopen(file_name.c_str(), "r");
+        if (!file)
+        {
+            std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+            return false;
+        }
+        unsigned int keys;
+        while (std::fscanf(file, "%x", &keys) == 1)
+        {
+            inputs.push_back(static_cast<unsigned short>(keys));
+        }
+        bool complete = std::feof(file);
+        std::fclose(file);
+        if (!complete)
+        {
+            std::cerr << "ERROR: File " << file_name << " is not an input script." << std::endl;
+        }
+        return complete;
+    }
+}
+
+/**
+ * Runs a program headless with scripted inputs and writes the session as a recording, which chip8_verify,
+ * chip8_sample and the other tools replay.
+ * Usage: chip8_record [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-k keyframe_interval] [-s seed]
+ *                     [-i input_script] -o recording program
+ * Without an input script no keys are held; with one, frames defaults to its length, and no keys are held past its
+ * end.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int frames = 0;
+    unsigned int cycles_per_frame = 8;
+    unsigned int keyframe_interval = 60;
+    std::uint64_t seed = 0;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    std::string input_name;
+    std::string output_name;
+    std::string program_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-k") && has_value)
+        {
+            keyframe_interval = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-s") && has_value)
+        {
+            seed = std::strtoull(argv[++arg], nullptr, 10);
+        }
+        else if (!std::strcmp(argv[arg], "-i") && has_value)
+        {
+            input_name = argv[++arg];
+        }
+        else if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            output_name = argv[++arg];
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty() || output_name.empty() || keyframe_interval == 0)
+    {
+        std::fprintf(stderr, "Usage: chip8_record [-f frames] [-c cycles_per_frame] [-q quirk_profile] "
+                "[-k keyframe_interval] [-s seed] [-i input_script] -o recording program\n");
+        return 2;
+    }
+
+    std::vector<unsigned short> inputs;
+    if (!input_name.empty() && !readInputs(input_name, inputs))
+    {
+        return 1;
+    }
+    if (frames == 0)
+    {
+        frames = input_name.empty() ? 3600 : static_cast<unsigned int>(inputs.size());
+    }
+    inputs.resize(frames, 0);
+
+    Machine machine{};
+    Recording recording{};
+    recording.cycles_per_frame = cycles_per_frame;
+    try
+    {
+        machine.core.initialize(seed);
+        machine.core.setQuirks(quirks);
+        machine.core.loadProgram(program_name);
+
+        Recorder recorder(machine, recording, keyframe_interval);
+        for (unsigned short keys : inputs)
+        {
+            recorder.recordFrame(keys);
+        }
+        recorder.finish();
+        recording.save(output_name);
+    }
+    catch (int)
+    {
+        return 1;
+    }
+    std::fprintf(stderr, "%zu frames, %zu keyframes\n", recording.inputs.size(), recording.keyframes.size());
+    return 0;
+}
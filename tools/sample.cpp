@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "guest_sampler.h"
+#include "machine.h"
+#include "recording.h"
+
+/**
+ * Runs a program headless, or replays a recording (.c8r) from its first keyframe with its inputs, and samples
+ * the guest call chain every interval cycles. The samples are written as folded stacks for flamegraph tools; every
+ * sample stands for interval cycles of the program.
+ * Usage: chip8_sample [-i interval] [-f frames] [-c cycles_per_frame] [-q quirk_profile] [-o output] program
+ * Programs run for the given number of frames without input; recordings run for all their frames.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int interval = 1;
+    unsigned int frames = 3600;
+    unsigned int cycles_per_frame = 8;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    std::string output_name;
+    std::string program_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-i") && has_value)
+        {
+            interval = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            output_name = argv[++arg];
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_sample [-i interval] [-f frames] [-c cycles_per_frame] [-q quirk_profile] "
+                "[-o output] program\n");
+        return 2;
+    }
+
+    Machine machine{};
+    machine.core.initialize();
+    std::vector<unsigned short> inputs;
+    try
+    {
+        bool is_recording = program_name.size() > 4
+                && program_name.compare(program_name.size() - 4, 4, ".c8r") == 0;
+        if (is_recording)
+        {
+            auto recording = std::make_unique<Recording>();
+            recording->load(program_name);
+            machine.core.setQuirks(recording->quirks);
+            machine.core.loadState(recording->keyframes.front().state);
+            inputs = recording->inputs;
+            cycles_per_frame = recording->cycles_per_frame;
+        }
+        else
+        {
+            machine.core.setQuirks(quirks);
+            machine.core.loadProgram(program_name);
+            inputs.assign(frames, 0);
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+
+    // Run frame by frame as Machine::runFrame does, sampling between cycles
+    GuestSampler sampler(interval);
+    for (unsigned short keys : inputs)
+    {
+        machine.core.getKeyboard().setKeys(keys);
+        for (unsigned int cycle = 0; cycle < cycles_per_frame; ++cycle)
+        {
+            machine.core.emulateCycle();
+            sampler.tick(machine.core);
+        }
+        machine.core.tickTimers();
+    }
+
+    std::FILE* output = stdout;
+    if (!output_name.empty())
+    {
+        output = std::fopen(output_name.c_str(), "w");
+        if (!output)
+        {
+            std::cerr << "ERROR: File " << output_name << " could not be written." << std::endl;
+            return 1;
+        }
+    }
+    sampler.writeFolded(output);
+    if (output != stdout)
+    {
+        std::fclose(output);
+    }
+    std::fprintf(stderr, "%lu samples of %u cycles over %zu frames of %u cycles\n", sampler.getSampleCount(),
+            std::max(interval, 1u), inputs.size(), cycles_per_frame);
+    return 0;
+}
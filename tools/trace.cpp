@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "machine.h"
+#include "recording.h"
+#include "trace.h"
+
+/**
+ * Runs a program headless, or replays a recording (.c8r) from its first keyframe with its inputs, and writes an
+ * instruction trace of the run, which chip8_trace_decode turns into text. Runs are deterministic, so the traces of
+ * two builds can be compared.
+ * Usage: chip8_trace [-f frames] [-c cycles_per_frame] [-q quirk_profile] -o trace program
+ * Programs run for the given number of frames without input; recordings run for all their frames.
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int frames = 3600;
+    unsigned int cycles_per_frame = 8;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    std::string trace_name;
+    std::string program_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-f") && has_value)
+        {
+            frames = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-c") && has_value)
+        {
+            cycles_per_frame = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+        }
+        else if (!std::strcmp(argv[arg], "-q") && has_value)
+        {
+            if (!parseQuirkProfile(argv[++arg], quirks))
+            {
+                std::cerr << "ERROR: Unknown quirk profile " << argv[arg] << "." << std::endl;
+                return 2;
+            }
+        }
+        else if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            trace_name = argv[++arg];
+        }
+        else
+        {
+            program_name = argv[arg];
+        }
+    }
+    if (program_name.empty() || trace_name.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_trace [-f frames] [-c cycles_per_frame] [-q quirk_profile] -o trace "
+                "program\n");
+        return 2;
+    }
+
+    auto machine = std::make_unique<Machine>();
+    machine->core.initialize();
+    std::vector<unsigned short> inputs;
+    try
+    {
+        bool is_recording = program_name.size() > 4
+                && program_name.compare(program_name.size() - 4, 4, ".c8r") == 0;
+        if (is_recording)
+        {
+            auto recording = std::make_unique<Recording>();
+            recording->load(program_name);
+            machine->core.setQuirks(recording->quirks);
+            machine->core.loadState(recording->keyframes.front().state);
+            inputs = recording->inputs;
+            cycles_per_frame = recording->cycles_per_frame;
+        }
+        else
+        {
+            machine->core.setQuirks(quirks);
+            machine->core.loadProgram(program_name);
+            inputs.assign(frames, 0);
+        }
+
+        Trace trace(trace_name, machine->core.getQuirks());
+        machine->core.setTrace(&trace);
+        for (unsigned short keys : inputs)
+        {
+            machine->runFrame(keys, cycles_per_frame);
+        }
+        machine->core.setTrace(nullptr);
+        if (trace.hasFailed())
+        {
+            return 1;
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "disassembler.h"
+#include "trace.h"
+
+namespace
+{
+    /**
+     * Writes the instruction of a cycle and the registers it changed as one line.
+     */
+    void writeLine(std::FILE* output, QuirkProfile quirks, const TraceRecord& record, unsigned short I,
+            const std::string& changes)
+    {
+        // The second word of F000 NNNN and 01NN NNNN is not traced, but it is what they load into I
+        char text[32];
+        disassemble(quirks, record.opcode, I, text, sizeof(text));
+        std::fprintf(output, "%10llu  %04X  %04X  ", static_cast<unsigned long long>(record.cycle), record.PC,
+                record.opcode);
+        if (changes.empty())
+        {
+            std::fprintf(output, "%s\n", text);
+        }
+        else
+        {
+            std::fprintf(output, "%-24s%s\n", text, changes.c_str());
+        }
+    }
+}
+
+/**
+ * Decodes a trace file written by Trace into text, one line per cycle with its PC, opcode, disassembly and the
+ * registers the instruction changed:
+ *         42  0206  7A01  ADD VA, 0x01            VA=06
+ * Lines only depend on the traced run, so the traces of two runs can be compared with diff.
+ * Usage: chip8_trace_decode [-o output] trace
+ */
+int main(int argc, char *argv[])
+{
+    std::string output_name;
+    std::string trace_name;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        bool has_value = arg + 1 < argc;
+        if (!std::strcmp(argv[arg], "-o") && has_value)
+        {
+            output_name = argv[++arg];
+        }
+        else
+        {
+            trace_name = argv[arg];
+        }
+    }
+    if (trace_name.empty())
+    {
+        std::fprintf(stderr, "Usage: chip8_trace_decode [-o output] trace\n");
+        return 2;
+    }
+
+    try
+    {
+        TraceReader reader(trace_name);
+        std::FILE* output = stdout;
+        if (!output_name.empty())
+        {
+            output = std::fopen(output_name.c_str(), "w");
+            if (!output)
+            {
+                std::cerr << "ERROR: File " << output_name << " could not be written." << std::endl;
+                return 1;
+            }
+        }
+
+        TraceRecord record{};
+        TraceRecord instruction{};
+        bool pending = false;
+        unsigned short I = 0;
+        std::string changes;
+        while (reader.next(record))
+        {
+            if (pending && record.cycle != instruction.cycle)
+            {
+                writeLine(output, reader.getQuirks(), instruction, I, changes);
+                changes.clear();
+            }
+            instruction = record;
+            pending = true;
+            if (record.reg == TraceRecord::I_REGISTER)
+            {
+                char change[16];
+                std::snprintf(change, sizeof(change), " I=%04X", record.value);
+                changes += change;
+                I = record.value;
+            }
+            else if (record.reg != TraceRecord::NO_REGISTER)
+            {
+                char change[16];
+                std::snprintf(change, sizeof(change), " V%X=%02X", record.reg & 0x0F, record.value);
+                changes += change;
+            }
+        }
+        if (pending)
+        {
+            writeLine(output, reader.getQuirks(), instruction, I, changes);
+        }
+        if (output != stdout)
+        {
+            std::fclose(output);
+        }
+    }
+    catch (int)
+    {
+        return 1;
+    }
+    return 0;
+}
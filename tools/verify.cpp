@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "verifier.h"
+
+/**
+ * Verifies recordings against this build of the core by re-simulating all of their segments in parallel.
+ * Usage: chip8_verify [-j threads] recording...
+ */
+int main(int argc, char *argv[])
+{
+    unsigned int thread_count = 0;
+    int failed_recordings = 0;
+
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        std::string file_name = argv[arg];
+        if (file_name == "-j" && arg + 1 < argc)
+        {
+            thread_count = static_cast<unsigned int>(std::strtoul(argv[++arg], nullptr, 10));
+            continue;
+        }
+
+        Recording recording{};
+        try
+        {
+            recording.load(file_name);
+        }
+        catch (int)
+        {
+            ++failed_recordings;
+            continue;
+        }
+
+        int failed_segments = 0;
+        for (const SegmentResult& result : verifyRecording(recording, thread_count))
+        {
+            if (!result.passed())
+            {
+                std::printf("%s: frames %u-%u diverged (expected %016llX, got %016llX)\n", file_name.c_str(),
+                        result.first_frame, result.last_frame,
+                        static_cast<unsigned long long>(result.expected_hash),
+                        static_cast<unsigned long long>(result.actual_hash));
+                ++failed_segments;
+            }
+        }
+        std::printf("%s: %s (%zu frames, %zu segments)\n", file_name.c_str(), failed_segments ? "FAILED" : "OK",
+                recording.inputs.size(), recording.keyframes.empty() ? 0 : recording.keyframes.size() - 1);
+        if (failed_segments)
+        {
+            ++failed_recordings;
+        }
+    }
+
+    return failed_recordings ? 1 : 0;
+}
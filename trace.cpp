@@ -0,0 +1,274 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "trace.h"
+
+namespace
+{
+    const unsigned char MAGIC[4] = {'C', '8', 'T', 'R'};
+
+    void putVarint(std::vector<unsigned char>& buffer, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            buffer.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back(static_cast<unsigned char>(value));
+    }
+
+    /**
+     * Maps a signed 16-bit difference to an unsigned one, small either way: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+     */
+    unsigned short zigzag(unsigned short difference)
+    {
+        return static_cast<unsigned short>(difference << 1 ^ (difference & 0x8000 ? 0xFFFF : 0));
+    }
+
+    unsigned short unzigzag(unsigned short value)
+    {
+        return static_cast<unsigned short>(value >> 1 ^ (value & 1 ? 0xFFFF : 0));
+    }
+
+    bool getVarint(std::FILE* file, std::uint64_t& value)
+    {
+        value = 0;
+        for (unsigned int shift = 0; shift < 64; shift += 7)
+        {
+            int byte = std::fgetc(file);
+            if (byte == EOF)
+            {
+                return false;
+            }
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool getBytes(std::FILE* file, unsigned int count, unsigned short& value)
+    {
+        value = 0;
+        for (unsigned int byte = 0; byte < count; ++byte)
+        {
+            int next = std::fgetc(file);
+            if (next == EOF)
+            {
+                return false;
+            }
+            value = static_cast<unsigned short>(value << 8 | next);
+        }
+        return true;
+    }
+}
+
+/**
+ * Creates the trace file and starts the writer thread.
+ * @param file_name - the name of the file to write
+ * @param quirks - the quirk profile of the traced core, which the decoder disassembles with
+ */
+Trace::Trace(const std::string& file_name, QuirkProfile quirks) : records(new TraceRecord[CAPACITY]),
+        file(std::fopen(file_name.c_str(), "wb")), file_name(file_name)
+{
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+        throw(errno);
+    }
+    unsigned char header[sizeof(MAGIC) + 2];
+    std::memcpy(header, MAGIC, sizeof(MAGIC));
+    header[sizeof(MAGIC)] = VERSION;
+    header[sizeof(MAGIC) + 1] = static_cast<unsigned char>(quirks);
+    failed = std::fwrite(header, 1, sizeof(header), file) != sizeof(header);
+    writer = std::thread(&Trace::write, this);
+}
+
+/**
+ * Waits for the writer to write every record pushed so far, and closes the file. The core must no longer push
+ * records.
+ */
+Trace::~Trace()
+{
+    stopping.store(true, std::memory_order_release);
+    writer.join();
+    if (std::fclose(file) != 0 || failed)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be written." << std::endl;
+    }
+}
+
+/**
+ * Returns whether writing the file failed, after which records are still taken from the ring but dropped.
+ */
+bool Trace::hasFailed() const
+{
+    return failed;
+}
+
+/**
+ * The writer thread: encodes the records that the core published, in batches, until the trace is destroyed.
+ */
+void Trace::write()
+{
+    std::vector<unsigned char> buffer;
+    buffer.reserve(CAPACITY * 8);
+    TraceRecord previous{0, 0, 0, TraceRecord::NO_REGISTER, 0};
+    bool first = true;
+    size_t position = 0;
+    while (true)
+    {
+        // Everything is published before stopping is set, so reading stopping first cannot miss records
+        bool stop = stopping.load(std::memory_order_acquire);
+        size_t end = published.load(std::memory_order_acquire);
+        if (position == end)
+        {
+            if (stop)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            continue;
+        }
+
+        buffer.clear();
+        for (; position != end; ++position)
+        {
+            const TraceRecord& record = records[position & (CAPACITY - 1)];
+            unsigned char flags = record.reg == TraceRecord::NO_REGISTER ? 0 : REGISTER;
+            size_t flags_index = buffer.size();
+            buffer.push_back(0);
+            if (!first && record.cycle == previous.cycle)
+            {
+                flags |= SAME_INSTRUCTION;
+            }
+            else
+            {
+                if (!first && record.cycle == previous.cycle + 1)
+                {
+                    flags |= NEXT_CYCLE;
+                }
+                else
+                {
+                    putVarint(buffer, record.cycle - previous.cycle);
+                }
+                auto pc_difference = static_cast<unsigned short>(record.PC - previous.PC - 2);
+                if (pc_difference == 0)
+                {
+                    flags |= NEXT_PC;
+                }
+                else
+                {
+                    putVarint(buffer, zigzag(pc_difference));
+                }
+                buffer.push_back(static_cast<unsigned char>(record.opcode >> 8));
+                buffer.push_back(static_cast<unsigned char>(record.opcode));
+            }
+            if (flags & REGISTER)
+            {
+                buffer.push_back(record.reg);
+                if (record.reg == TraceRecord::I_REGISTER)
+                {
+                    buffer.push_back(static_cast<unsigned char>(record.value >> 8));
+                }
+                buffer.push_back(static_cast<unsigned char>(record.value));
+            }
+            buffer[flags_index] = flags;
+            previous = record;
+            first = false;
+        }
+        tail.store(position, std::memory_order_release);
+        if (!failed && std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())
+        {
+            failed = true;
+        }
+    }
+}
+
+/**
+ * Opens a trace file and reads its header.
+ * @param file_name - the name of a file written by Trace
+ */
+TraceReader::TraceReader(const std::string& file_name) : file(std::fopen(file_name.c_str(), "rb"))
+{
+    if (!file)
+    {
+        std::cerr << "ERROR: File " << file_name << " could not be read." << std::endl;
+        throw(errno);
+    }
+    unsigned char header[sizeof(MAGIC) + 2];
+    if (std::fread(header, 1, sizeof(header), file) != sizeof(header) || std::memcmp(header, MAGIC, sizeof(MAGIC))
+            || header[sizeof(MAGIC)] != Trace::VERSION)
+    {
+        std::cerr << "ERROR: File " << file_name << " is not a trace file." << std::endl;
+        std::fclose(file);
+        errno = EINVAL;
+        throw(errno);
+    }
+    quirks = static_cast<QuirkProfile>(header[sizeof(MAGIC) + 1]);
+}
+
+TraceReader::~TraceReader()
+{
+    std::fclose(file);
+}
+
+/**
+ * Returns the quirk profile of the traced core.
+ */
+QuirkProfile TraceReader::getQuirks() const
+{
+    return quirks;
+}
+
+/**
+ * Reads the next record.
+ * @param record - receives the record
+ * @return false at the end of the file, or if it ends in the middle of a record
+ */
+bool TraceReader::next(TraceRecord& record)
+{
+    int flags = std::fgetc(file);
+    if (flags == EOF)
+    {
+        return false;
+    }
+    record = previous;
+    if (!(flags & Trace::SAME_INSTRUCTION))
+    {
+        std::uint64_t delta = 1;
+        if (!(flags & Trace::NEXT_CYCLE) && !getVarint(file, delta))
+        {
+            return false;
+        }
+        record.cycle = previous.cycle + delta;
+        std::uint64_t pc_difference = 0;
+        if (!(flags & Trace::NEXT_PC) && !getVarint(file, pc_difference))
+        {
+            return false;
+        }
+        record.PC = static_cast<unsigned short>(previous.PC + 2
+                + unzigzag(static_cast<unsigned short>(pc_difference)));
+        if (!getBytes(file, 2, record.opcode))
+        {
+            return false;
+        }
+    }
+    record.reg = TraceRecord::NO_REGISTER;
+    record.value = 0;
+    if (flags & Trace::REGISTER)
+    {
+        int reg = std::fgetc(file);
+        if (reg == EOF || !getBytes(file, reg == TraceRecord::I_REGISTER ? 2 : 1, record.value))
+        {
+            return false;
+        }
+        record.reg = static_cast<unsigned char>(reg);
+    }
+    previous = record;
+    return true;
+}
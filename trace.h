@@ -0,0 +1,124 @@
+#ifndef CHIP8_EMU_TRACE_H
+#define CHIP8_EMU_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include "quirks.h"
+
+/**
+ * One record of an instruction trace: the instruction a core executed in a cycle, and a register it changed. An
+ * instruction that changes several registers gets a record for each, all with the same cycle; one that changes
+ * none gets a single record with NO_REGISTER.
+ */
+struct TraceRecord
+{
+    static constexpr unsigned char I_REGISTER = 16;
+    static constexpr unsigned char NO_REGISTER = 0xFF;
+
+    std::uint64_t cycle;
+    unsigned short PC;
+    unsigned short opcode;
+    unsigned char reg;
+    unsigned short value;
+};
+
+/**
+ * An instruction trace of one core, attached with Core::setTrace(). The core pushes records into a lock-free
+ * single-producer ring, and a writer thread delta-encodes them into a file, so that tracing costs the emulation
+ * thread little more than a store per instruction. When the writer falls behind by a whole ring, the core waits for
+ * it rather than losing records. The file is complete once the trace is destroyed; TraceReader decodes it.
+ *
+ * File format: the magic number "C8TR", a version byte and the quirk profile, followed by the records. Every record
+ * starts with a byte of flags:
+ *  - SAME_INSTRUCTION: cycle, PC and opcode are those of the previous record; otherwise
+ *    - NEXT_CYCLE: the cycle follows the previous one, else the difference follows as a varint
+ *    - NEXT_PC: the PC is 2 after the previous one, else the difference from that follows as a zigzag varint
+ *    - the opcode, big-endian
+ *  - REGISTER: the register follows, and its value as a byte for V0-VF or big-endian for I
+ */
+class Trace
+{
+public:
+    static constexpr size_t CAPACITY = 1 << 16;
+    static constexpr unsigned char VERSION = 1;
+    static constexpr unsigned char SAME_INSTRUCTION = 0x01;
+    static constexpr unsigned char NEXT_CYCLE = 0x02;
+    static constexpr unsigned char NEXT_PC = 0x04;
+    static constexpr unsigned char REGISTER = 0x08;
+
+    Trace(const std::string& file_name, QuirkProfile quirks);
+    ~Trace();
+    Trace(const Trace&) = delete;
+    Trace& operator=(const Trace&) = delete;
+
+    /**
+     * Adds a record of the current cycle.
+     */
+    void push(unsigned short PC, unsigned short opcode, unsigned char reg, unsigned short value)
+    {
+        if (head - cached_tail == CAPACITY)
+        {
+            while ((cached_tail = tail.load(std::memory_order_acquire)) == head - CAPACITY)
+            {
+                std::this_thread::yield();
+            }
+        }
+        records[head & (CAPACITY - 1)] = {cycle, PC, opcode, reg, value};
+        published.store(++head, std::memory_order_release);
+    }
+
+    /**
+     * Ends the records of the current cycle.
+     */
+    void endCycle()
+    {
+        ++cycle;
+    }
+
+    bool hasFailed() const;
+
+private:
+    std::unique_ptr<TraceRecord[]> records;
+    std::FILE* file;
+    std::string file_name;
+
+    // Written by the core only
+    alignas(64) size_t head = 0;
+    size_t cached_tail = 0;
+    std::uint64_t cycle = 0;
+    std::atomic<size_t> published{0};
+
+    // Written by the writer only
+    alignas(64) std::atomic<size_t> tail{0};
+    std::atomic<bool> failed{false};
+
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    void write();
+};
+
+/**
+ * Reads the records of a trace file in order.
+ */
+class TraceReader
+{
+    std::FILE* file;
+    QuirkProfile quirks = QuirkProfile::DEFAULT;
+    TraceRecord previous{0, 0, 0, TraceRecord::NO_REGISTER, 0};
+
+public:
+    explicit TraceReader(const std::string& file_name);
+    ~TraceReader();
+    TraceReader(const TraceReader&) = delete;
+    TraceReader& operator=(const TraceReader&) = delete;
+
+    QuirkProfile getQuirks() const;
+    bool next(TraceRecord& record);
+};
+
+#endif //CHIP8_EMU_TRACE_H
@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include "verifier.h"
+
+/**
+ * Re-simulates every segment of the specified recording in parallel.
+ * Each segment starts from its keyframe, replays its inputs and is compared against the state hash of the
+ * next keyframe, which is recomputed by this build of the core.
+ * @param recording - the recording to verify
+ * @param thread_count - the number of worker threads, or 0 to use one per hardware thread
+ * @return the result of every segment, in recording order
+ */
+std::vector<SegmentResult> verifyRecording(const Recording& recording, unsigned int thread_count)
+{
+    size_t segment_count = recording.keyframes.empty() ? 0 : recording.keyframes.size() - 1;
+    std::vector<SegmentResult> results(segment_count);
+    std::atomic<size_t> next_segment{0};
+
+    auto worker = [&recording, &results, &next_segment, segment_count]()
+    {
+        auto machine = std::make_unique<Machine>();
+        auto expected = std::make_unique<Machine>();
+        machine->core.setQuirks(recording.quirks);
+        for (size_t segment = next_segment++; segment < segment_count; segment = next_segment++)
+        {
+            const Recording::Keyframe& first = recording.keyframes[segment];
+            const Recording::Keyframe& last = recording.keyframes[segment + 1];
+
+            machine->core.loadState(first.state);
+            for (unsigned int frame = first.frame; frame < last.frame; ++frame)
+            {
+                machine->runFrame(recording.inputs[frame], recording.cycles_per_frame);
+            }
+            expected->core.loadState(last.state);
+
+            results[segment] = {first.frame, last.frame, expected->core.hashState(), machine->core.hashState()};
+        }
+    };
+
+    if (thread_count == 0)
+    {
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+    thread_count = static_cast<unsigned int>(std::min<size_t>(thread_count, segment_count));
+
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    return results;
+}
@@ -0,0 +1,26 @@
+#ifndef CHIP8_EMU_VERIFIER_H
+#define CHIP8_EMU_VERIFIER_H
+
+#include "recording.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * The outcome of re-simulating one segment of a recording.
+ */
+struct SegmentResult
+{
+    unsigned int first_frame;
+    unsigned int last_frame;
+    std::uint64_t expected_hash;
+    std::uint64_t actual_hash;
+
+    bool passed() const
+    {
+        return expected_hash == actual_hash;
+    }
+};
+
+std::vector<SegmentResult> verifyRecording(const Recording& recording, unsigned int thread_count = 0);
+
+#endif //CHIP8_EMU_VERIFIER_H